@@ -28,6 +28,7 @@
 #include "fityk/fityk.h"
 #include "fityk/ui_api.h"
 #include "gnuplot.h"
+#include "server.h"
 #if HAVE_CONFIG_H
 #  include <config.h> // VERSION, HAVE_LIBREADLINE, etc
 #endif
@@ -251,6 +252,8 @@ int main(int argc, char **argv)
     bool enable_plot = true;
     bool quit = false;
     string script_string;
+    string server_socket;
+    int n_engines = 4;
     for (int i = 1; i < argc; ++i) {
         if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
             printf(
@@ -260,7 +263,9 @@ int main(int argc, char **argv)
               "  -c, --cmd=<str>       script passed in as string\n"
               "  -I, --no-init         don't process $HOME/.fityk/init file\n"
               "  -n, --no-plot         disable plotting (gnuplot)\n"
-              "  -q, --quit            don't enter interactive shell\n");
+              "  -q, --quit            don't enter interactive shell\n"
+              "  --server=<socket>     serve requests on Unix domain socket\n"
+              "  --engines=<n>         number of engines in server mode\n");
             return 0;
         } else if (!strcmp(argv[i], "-V") || !strcmp(argv[i], "--version")) {
             printf("fityk version " VERSION "\n");
@@ -290,12 +295,41 @@ int main(int argc, char **argv)
         } else if (!strcmp(argv[i], "-q") || !strcmp(argv[i], "--quit")) {
             argv[i] = 0;
             quit = true;
+        } else if (!strncmp(argv[i], "--server=", 9)) {
+            server_socket = string(argv[i] + 9);
+            argv[i] = 0;
+        } else if (!strncmp(argv[i], "--engines=", 10)) {
+            n_engines = atoi(argv[i] + 10);
+            argv[i] = 0;
+            if (n_engines < 1) {
+                fprintf(stderr, "Number of engines must be positive\n");
+                return 1;
+            }
         } else if (strlen(argv[i]) > 1 && argv[i][0] == '-') {
             fprintf(stderr, "Unknown option %s\n", argv[i]);
             return 1;
         }
     }
 
+    if (!server_socket.empty()) {
+        if (!script_string.empty()) {
+            fprintf(stderr, "Option --cmd can't be used with --server\n");
+            return 1;
+        }
+        for (int i = 1; i < argc; ++i)
+            if (argv[i]) {
+                fprintf(stderr, "Unexpected argument: %s\n", argv[i]);
+                return 1;
+            }
+        string init_file;
+        if (exec_init_file) {
+            init_file = get_config_dir() + startup_commands_filename();
+            if (access(init_file.c_str(), R_OK) != 0)
+                init_file.clear();
+        }
+        return run_server(server_socket, n_engines, init_file);
+    }
+
     ftk = new Fityk;
     // set callbacks
     if (enable_plot)
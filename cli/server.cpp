@@ -0,0 +1,377 @@
+// This file is part of fityk program. Copyright 2001-2013 Marcin Wojdyr
+// Licence: GNU General Public License ver. 2+
+
+// Server mode of cfityk (cfityk --server=SOCKET).
+//
+// The server keeps a pool of Fityk engines. Each client connection gets
+// one engine for the lifetime of the connection; the engine is reset
+// when the connection is closed and returned to the pool.
+//
+// All messages, in both directions, are frames: a header line
+// "<type> <length>\n" followed by <length> bytes of payload.
+// Requests (client -> server):
+//   C  command: a single line, as typed in the interactive shell,
+//   S  script: many lines, execution stops at the first error,
+//   R  reset the engine (re-running the init file).
+// The reply consists of any number of frames with output:
+//   N  normal message,  W  warning or error,  Q  echo of input,
+// followed by a D frame with the status of the request: "ok", "error"
+// or "syntax-error". After "quit" the server closes the connection.
+// Requests longer than kMaxRequestSize are rejected and the connection
+// is closed.
+
+#include "server.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "fityk/fityk.h"
+#include "fityk/ui_api.h"
+#include "fityk/logic.h"
+#include "fityk/settings.h"
+
+using namespace std;
+using namespace fityk;
+
+#ifdef _WIN32
+
+int run_server(const string&, int, const string&)
+{
+    fprintf(stderr, "Server mode is not supported on this platform.\n");
+    return 1;
+}
+
+#else
+
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+const size_t kMaxRequestSize = 64 * 1024 * 1024;
+
+struct Connection
+{
+    int fd;
+    bool broken; // set when writing to the socket failed
+};
+
+// Engines do not know about connections, so the show_message callback
+// finds the client through the thread that executes the request.
+thread_local Connection* current_connection = NULL;
+
+bool write_all(int fd, const char* buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool read_all(int fd, char* buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = read(fd, buf, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+void send_frame(Connection* conn, char type, const string& payload)
+{
+    if (conn->broken)
+        return;
+    char header[32];
+    int n = snprintf(header, sizeof(header), "%c %lu\n",
+                     type, (unsigned long) payload.size());
+    string frame(header, n);
+    frame += payload;
+    if (!write_all(conn->fd, frame.c_str(), frame.size()))
+        conn->broken = true;
+}
+
+enum ReadStatus
+{
+    kFrameRead,
+    kNoFrame, // end of input or malformed header
+    kFrameTooLong // the length in header exceeds kMaxRequestSize
+};
+
+ReadStatus read_frame(int fd, char* type, string* payload)
+{
+    char header[32];
+    int pos = 0;
+    for (;;) {
+        if (pos == (int) sizeof(header) - 1 || !read_all(fd, header+pos, 1))
+            return kNoFrame;
+        if (header[pos] == '\n')
+            break;
+        ++pos;
+    }
+    header[pos] = '\0';
+    char *endptr;
+    unsigned long len = strtoul(header + 1, &endptr, 10);
+    if (pos < 3 || header[1] != ' ' || *endptr != '\0')
+        return kNoFrame;
+    if (len > kMaxRequestSize)
+        return kFrameTooLong;
+    *type = header[0];
+    payload->resize(len);
+    if (len != 0 && !read_all(fd, &(*payload)[0], len))
+        return kNoFrame;
+    return kFrameRead;
+}
+
+void server_show_message(UiApi::Style style, const string& s)
+{
+    if (current_connection == NULL) // e.g. output of the init file
+        return;
+    char type = 'N';
+    if (style == UiApi::kWarning)
+        type = 'W';
+    else if (style == UiApi::kQuoted || style == UiApi::kInput)
+        type = 'Q';
+    send_frame(current_connection, type, s);
+}
+
+const char* status_str(UiApi::Status status)
+{
+    switch (status) {
+        case UiApi::kStatusOk: return "ok";
+        case UiApi::kStatusExecuteError: return "error";
+        case UiApi::kStatusSyntaxError: return "syntax-error";
+    }
+    return "error";
+}
+
+// executes script line by line, handles continuation lines ending with '\'
+UiApi::Status exec_script(UiApi* ui, const string& script)
+{
+    string s;
+    size_t start = 0;
+    while (start < script.size()) {
+        size_t end = script.find('\n', start);
+        if (end == string::npos)
+            end = script.size();
+        s.append(script, start, end - start);
+        start = end + 1;
+        if (!s.empty() && *(s.end()-1) == '\r')
+            s.resize(s.size()-1);
+        if (!s.empty() && *(s.end()-1) == '\\') {
+            s.resize(s.size()-1);
+            continue;
+        }
+        UiApi::Status r = ui->exec_and_log(s);
+        if (r != UiApi::kStatusOk)
+            return r;
+        s.clear();
+    }
+    if (!s.empty())
+        return ui->exec_and_log(s);
+    return UiApi::kStatusOk;
+}
+
+} // anonymous namespace
+
+class EnginePool
+{
+public:
+    EnginePool(int n, const string& init_file);
+    // waits until an engine is available
+    Fityk* acquire();
+    // resets the engine and makes it available again
+    void release(Fityk* ftk);
+    void reset(Fityk* ftk);
+private:
+    vector<Fityk*> idle_;
+    string init_file_;
+    mutex mutex_;
+    condition_variable available_;
+
+    void run_init_file(Fityk* ftk);
+};
+
+EnginePool::EnginePool(int n, const string& init_file)
+    : init_file_(init_file)
+{
+    for (int i = 0; i < n; ++i) {
+        Fityk *ftk = new Fityk;
+        ftk->get_ui_api()->connect_show_message(server_show_message);
+        // chdir() in one engine would change paths in all of them
+        ftk->priv()->mutable_settings_mgr()->lock_cwd();
+        run_init_file(ftk);
+        idle_.push_back(ftk);
+    }
+}
+
+void EnginePool::run_init_file(Fityk* ftk)
+{
+    if (init_file_.empty())
+        return;
+    try {
+        ftk->get_ui_api()->exec_fityk_script(init_file_);
+    } catch (const exception& e) {
+        fprintf(stderr, "Error in init file: %s\n", e.what());
+    }
+}
+
+Fityk* EnginePool::acquire()
+{
+    unique_lock<mutex> lock(mutex_);
+    while (idle_.empty())
+        available_.wait(lock);
+    Fityk* ftk = idle_.back();
+    idle_.pop_back();
+    return ftk;
+}
+
+void EnginePool::reset(Fityk* ftk)
+{
+    Connection* conn = current_connection;
+    current_connection = NULL; // the client doesn't need to see it
+    try {
+        ftk->execute("reset");
+    } catch (const exception& e) {
+        fprintf(stderr, "Error in reset: %s\n", e.what());
+    }
+    run_init_file(ftk);
+    current_connection = conn;
+}
+
+void EnginePool::release(Fityk* ftk)
+{
+    reset(ftk);
+    lock_guard<mutex> lock(mutex_);
+    idle_.push_back(ftk);
+    available_.notify_one();
+}
+
+EnginePool* create_engine_pool(int n_engines, const string& init_file)
+{
+    return new EnginePool(n_engines, init_file);
+}
+
+void serve_connection(EnginePool* pool, int fd)
+{
+    Connection conn = { fd, false };
+    Fityk* ftk = pool->acquire();
+    UiApi* ui = ftk->get_ui_api();
+    current_connection = &conn;
+    char type;
+    string payload;
+    bool quit = false;
+    try {
+        while (!quit && !conn.broken) {
+            ReadStatus r = read_frame(fd, &type, &payload);
+            if (r == kFrameTooLong) {
+                send_frame(&conn, 'W', "Request too long, the limit is "
+                                       + S(kMaxRequestSize) + " bytes.");
+                send_frame(&conn, 'D', "error");
+            }
+            if (r != kFrameRead)
+                break;
+            UiApi::Status status = UiApi::kStatusOk;
+            try {
+                if (type == 'C')
+                    status = ui->exec_and_log(payload);
+                else if (type == 'S')
+                    status = exec_script(ui, payload);
+                else if (type == 'R')
+                    pool->reset(ftk);
+                else {
+                    send_frame(&conn, 'W',
+                               string("Unknown request type: ") + type);
+                    status = UiApi::kStatusSyntaxError;
+                }
+            } catch (const ExitRequestedException&) {
+                quit = true;
+            } catch (const exception& e) {
+                send_frame(&conn, 'W', e.what());
+                status = UiApi::kStatusExecuteError;
+            }
+            send_frame(&conn, 'D', status_str(status));
+        }
+    } catch (const exception& e) {
+        // e.g. bad_alloc when sending a large output; drop the client,
+        // an exception leaving this thread would terminate the server
+        fprintf(stderr, "Closing connection after error: %s\n", e.what());
+    }
+    current_connection = NULL;
+    close(fd);
+    pool->release(ftk);
+}
+
+
+int run_server(const string& socket_path, int n_engines,
+               const string& init_file)
+{
+    // a client that disconnects should not kill the server
+    signal(SIGPIPE, SIG_IGN);
+    // stop on Ctrl-C, interrupting computations is not useful here
+    signal(SIGINT, SIG_DFL);
+
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", socket_path.c_str());
+        return 1;
+    }
+    strcpy(addr.sun_path, socket_path.c_str());
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) {
+        perror("socket");
+        return 1;
+    }
+    // remove socket left by a previous server, but never a regular file
+    struct stat st;
+    if (stat(socket_path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(socket_path.c_str());
+    if (bind(sock, (sockaddr*) &addr, sizeof(addr)) != 0
+            || listen(sock, 64) != 0) {
+        perror(socket_path.c_str());
+        close(sock);
+        return 1;
+    }
+
+    // never deleted, engines can be in use by detached threads until exit
+    EnginePool *pool = create_engine_pool(n_engines, init_file);
+    fprintf(stderr, "Listening on %s (%d engines).\n",
+            socket_path.c_str(), n_engines);
+    for (;;) {
+        int fd = accept(sock, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            perror("accept");
+            break;
+        }
+        thread(serve_connection, pool, fd).detach();
+    }
+    close(sock);
+    unlink(socket_path.c_str());
+    return 1;
+}
+
+#endif // _WIN32
@@ -0,0 +1,25 @@
+// This file is part of fityk program. Copyright 2001-2013 Marcin Wojdyr
+// Licence: GNU General Public License ver. 2+
+
+#ifndef FITYK_SERVER_H_
+#define FITYK_SERVER_H_
+
+#include <string>
+
+/// Listens on Unix domain socket socket_path and executes requests
+/// from clients using a pool of n_engines Fityk instances.
+/// init_file (if not empty) is executed in each engine after it is created
+/// or reset. Returns only on error, with non-zero exit status.
+int run_server(const std::string& socket_path, int n_engines,
+               const std::string& init_file);
+
+#ifndef _WIN32
+// building blocks of run_server(), exposed for tests
+class EnginePool;
+EnginePool* create_engine_pool(int n_engines, const std::string& init_file);
+/// Executes requests from the client connected to socket fd until the client
+/// disconnects or sends "quit", then closes fd.
+void serve_connection(EnginePool* pool, int fd);
+#endif
+
+#endif
@@ -31,7 +31,8 @@ GAfit::GAfit(Full* F, const char* fname)
      std_dev_stop(0), iter_with_no_progresss_stop(0),
      autoplot_indiv_nr(-1),
      pop(0), opop(0),
-     best_indiv(0)
+     best_indiv(0),
+     no_progress_iters_(0)
 {
     /*
     irpar["population-size"] = IntRange (&popsize, 2, 9999);
@@ -89,6 +90,7 @@ double GAfit::run_method(std::vector<realt>* best_a)
             best = i;
     }
     best_indiv = *best;
+    no_progress_iters_ = 0;
 
     assert (pop && opop);
     if (elitism >= popsize) {
@@ -123,7 +125,7 @@ void GAfit::mutation()
 {
     for (vector<Individual>::iterator i = pop->begin(); i != pop->end(); ++i) {
         if (mutate_all_genes) {
-            if (rand() < RAND_MAX * p_mutation) {
+            if (F_->rng().rand_0_1() < p_mutation) {
                 for (int j = 0; j < na_; ++j)
                     i->g[j] = draw_a_from_distribution(j, mutation_type,
                                                             mutation_strength);
@@ -131,7 +133,7 @@ void GAfit::mutation()
             }
         } else
             for (int j = 0; j < na_; ++j)
-                if (rand() < RAND_MAX * p_mutation) {
+                if (F_->rng().rand_0_1() < p_mutation) {
                     i->g[j] = draw_a_from_distribution(j, mutation_type,
                                                             mutation_strength);
                     compute_wssr_for_ind (i);
@@ -142,8 +144,9 @@ void GAfit::mutation()
 void GAfit::crossover()
 {
     for (vector<Individual>::iterator i = pop->begin(); i != pop->end(); ++i)
-        if (rand() < RAND_MAX / 2 * p_crossover) {
-            vector<Individual>::iterator i2 = pop->begin() + rand()%pop->size();
+        if (F_->rng().rand_0_1() < p_crossover / 2) {
+            vector<Individual>::iterator i2 =
+                pop->begin() + F_->rng().rand_int(pop->size());
             switch (crossover_type) {
                 case 'u':
                     uniform_crossover (i, i2);
@@ -179,14 +182,14 @@ void GAfit::uniform_crossover (vector<Individual>::iterator c1,
                                vector<Individual>::iterator c2)
 {
     for (int i = 0; i < na_; ++i)
-        if (rand() % 2)
+        if (F_->rng().rand_bool())
             swap(c1->g[i], c2->g[i]);
 }
 
 void GAfit::one_point_crossover (vector<Individual>::iterator c1,
                                  vector<Individual>::iterator c2)
 {
-    int p = rand() % na_;
+    int p = F_->rng().rand_int(na_);
     for (int j = 0; j < p; ++j)
             swap(c1->g[j], c2->g[j]);
 }
@@ -194,8 +197,8 @@ void GAfit::one_point_crossover (vector<Individual>::iterator c1,
 void GAfit::two_points_crossover (vector<Individual>::iterator c1,
                                   vector<Individual>::iterator c2)
 {
-    int p1 = rand() % na_;
-    int p2 = rand() % na_;
+    int p1 = F_->rng().rand_int(na_);
+    int p2 = F_->rng().rand_int(na_);
     for (int j = min(p1, p2); j < max(p1, p2); ++j)
             swap(c1->g[j], c2->g[j]);
 }
@@ -203,7 +206,7 @@ void GAfit::two_points_crossover (vector<Individual>::iterator c1,
 void GAfit::arithmetic_crossover1 (vector<Individual>::iterator c1,
                                    vector<Individual>::iterator c2)
 {
-    realt a = rand_0_1();
+    realt a = F_->rng().rand_0_1();
     for (int j = 0; j < na_; ++j) {
         c1->g[j] = a * c1->g[j] + (1 - a) * c2->g[j];
         c2->g[j] = (1 - a) * c1->g[j] + a * c2->g[j];
@@ -214,7 +217,7 @@ void GAfit::arithmetic_crossover2 (vector<Individual>::iterator c1,
                                    vector<Individual>::iterator c2)
 {
     for (int j = 0; j < na_; ++j) {
-        realt a = rand_0_1();
+        realt a = F_->rng().rand_0_1();
         c1->g[j] = a * c1->g[j] + (1 - a) * c2->g[j];
         c2->g[j] = (1 - a) * c1->g[j] + a * c2->g[j];
     }
@@ -281,7 +284,7 @@ void GAfit::do_rank_scoring(vector<Individual> *popp)
 {
     // rank in population is assigned to phase_2_score
     // e.g. 0 - the best, 1 - second, (popp.size() - 1) - worst
-    static vector<Individual*> ind_p;
+    vector<Individual*> ind_p;
     ind_p.resize(popp->size());
     for (unsigned int i = 0; i < popp->size(); ++i)
         ind_p[i] = &(*popp)[i];
@@ -302,15 +305,16 @@ void GAfit::roulette_wheel_selection(vector<int>& next)
     roulette[size(*pop) - 1] = RAND_MAX; //end of preparing roulette
     for (vector<int>::iterator i = next.begin(); i != next.end(); ++i)
         *i = lower_bound (roulette.begin(), roulette.end(),
-                         static_cast<unsigned int>(rand())) - roulette.begin();
+                  static_cast<unsigned int>(F_->rng().rand_0_1() * RAND_MAX))
+             - roulette.begin();
 }
 
 void GAfit::tournament_selection(vector<int>& next)
 {
     for (vector<int>::iterator i = next.begin(); i != next.end(); ++i) {
-        int best = rand() % pop->size();
+        int best = F_->rng().rand_int(pop->size());
         for (int j = 1; j < tournament_size; ++j) {
-            int n = rand() % pop->size();
+            int n = F_->rng().rand_int(pop->size());
             if ((*pop)[n].raw_score < (*pop)[best].raw_score)
                 best = n;
         }
@@ -353,7 +357,7 @@ void GAfit::deterministic_sampling_selection(vector<int>& next)
     vector<int>::iterator r = SRS_and_DS_common (next);
     if (r == next.end())
         return;
-    static vector<Remainder_and_ptr> rem;
+    vector<Remainder_and_ptr> rem;
     rem.resize(pop->size());
     for (unsigned int i = 0; i < pop->size(); ++i) {
         rem[i].ind = i;
@@ -427,7 +431,6 @@ realt GAfit::max_in_window ()
 
 bool GAfit::termination_criteria_and_print_info(int iter)
 {
-    static int no_progress_iters = 0;
     realt sum = 0;
     realt min = pop->front().raw_score;
     tmp_max = min;
@@ -453,9 +456,9 @@ bool GAfit::termination_criteria_and_print_info(int iter)
                 + ", std dev. " + S(std_dev));
     if (min < best_indiv.raw_score) {
         best_indiv = *ibest;
-        no_progress_iters = 0;
+        no_progress_iters_ = 0;
     } else
-        no_progress_iters ++;
+        no_progress_iters_++;
 
     //checking stop conditions
     bool stop = false;
@@ -467,8 +470,9 @@ bool GAfit::termination_criteria_and_print_info(int iter)
         stop = true;
     }
     if (iter_with_no_progresss_stop > 0
-          && no_progress_iters >= iter_with_no_progresss_stop) {
-        F_->msg("No progress in " + S(no_progress_iters) + " iterations. Stop");
+          && no_progress_iters_ >= iter_with_no_progresss_stop) {
+        F_->msg("No progress in " + S(no_progress_iters_)
+                + " iterations. Stop");
         stop = true;
     }
     return stop;
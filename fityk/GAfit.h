@@ -46,6 +46,7 @@ private:
     int iteration;
     Individual best_indiv;
     realt tmp_max;
+    int no_progress_iters_; // for iter_with_no_progresss_stop
     std::map<char, std::string> Crossover_enum;
     std::map<char, std::string> Selection_enum;
 
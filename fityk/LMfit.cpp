@@ -41,6 +41,7 @@ double LMfit::run_method(std::vector<realt>* best_a)
     compute_derivatives(a_orig_, fitted_datas_, alpha_, beta_);
 
     int small_change_counter = 0;
+    lambda_ = lambda;
     for (int iter = 0; !common_termination_criteria(); iter++) {
         prepare_next_parameters(lambda, *best_a); // -> temp_beta_
         double new_chi2 = compute_wssr(temp_beta_, fitted_datas_);
@@ -65,6 +66,7 @@ double LMfit::run_method(std::vector<realt>* best_a)
 
             compute_derivatives(*best_a, fitted_datas_, alpha_, beta_);
             lambda /= F_->get_settings()->lm_lambda_down_factor;
+            lambda_ = lambda;
         }
 
         else { // worse fitting
@@ -75,6 +77,7 @@ double LMfit::run_method(std::vector<realt>* best_a)
                 break;
             }
             lambda *= F_->get_settings()->lm_lambda_up_factor;
+            lambda_ = lambda;
         }
 
         iteration_plot(*best_a, chi2);
@@ -97,7 +100,11 @@ void LMfit::prepare_next_parameters(double lambda, const vector<realt> &a)
     }
 
     // Matrix solution (Ax=b)  temp_alpha_ * da == temp_beta_
-    jordan_solve(temp_alpha_, temp_beta_, na_);
+    {
+        Profiler* prof = F_->mgr.active_profiler();
+        ScopedProfile sp(prof ? &prof->phase(Profiler::kSolve) : NULL, na_);
+        jordan_solve(temp_alpha_, temp_beta_, na_);
+    }
 
     for (int i = 0; i < na_; i++)
         // put new a[] into temp_beta_[]
@@ -33,8 +33,8 @@ const char *command_list[] = {
 
 const char* info_args[] = {
     "version", "compiler", "variables", "types", "functions",
-    "dataset_count", "view", "fit_history",
-    "filename", "title", "data",
+    "dataset_count", "view", "fit_history", "profile",
+    "filename", "title", "data", "data_store", "memory",
     "formula", "gnuplot_formula",
     "simplified_formula", "simplified_gnuplot_formula",
     "models", "state", "history_summary", "peaks", "peaks_err",
@@ -792,31 +792,45 @@ void add_to_datasets(const Full* F_, vector<int>& datasets, int n)
 
 bool Parser::parse_statement(Lexer& lex)
 {
-    st_.datasets.clear();
-    st_.with_args.clear();
-    st_.vdlist.clear();
-    st_.commands.resize(1);
-    st_.commands[0].args.clear();
-    st_.commands[0].defined_tp.reset();
+    if (lex.peek_token().type == kTokenNop) {
+        st_ = Statement();
+        return false;
+    }
+    vector<int> datasets;
+    parse_datasets(lex, datasets);
+    parse_statement_body(lex, datasets);
+    return true;
+}
 
+void Parser::parse_datasets(Lexer& lex, vector<int>& datasets) const
+{
+    datasets.clear();
     Token first = lex.peek_token();
-    if (first.type == kTokenNop)
-        return false;
     if (first.type == kTokenDataset) {
         lex.get_token();
         Token t = lex.get_token();
         if (t.type == kTokenDataset || t.type == kTokenColon) {
-            add_to_datasets(F_, st_.datasets, first.value.i);
+            add_to_datasets(F_, datasets, first.value.i);
             while (t.type == kTokenDataset) {
-                add_to_datasets(F_, st_.datasets, t.value.i);
+                add_to_datasets(F_, datasets, t.value.i);
                 t = lex.get_expected_token(kTokenDataset, kTokenColon);
             }
         } else {
             lex.go_back(first);
         }
     }
-    if (st_.datasets.empty())
-        st_.datasets.push_back(F_->dk.default_idx());
+    if (datasets.empty())
+        datasets.push_back(F_->dk.default_idx());
+}
+
+void Parser::parse_statement_body(Lexer& lex, const vector<int>& datasets)
+{
+    st_.datasets = datasets;
+    st_.with_args.clear();
+    st_.vdlist.clear();
+    st_.commands.resize(1);
+    st_.commands[0].args.clear();
+    st_.commands[0].defined_tp.reset();
 
     if (lex.peek_token().type == kTokenLname &&
             is_command(lex.peek_token(), "w","ith")) {
@@ -835,8 +849,6 @@ bool Parser::parse_statement(Lexer& lex)
     if (lex.peek_token().type != kTokenNop)
         lex.throw_syntax_error(S("unexpected token: `")
                                + tokentype2str(lex.peek_token().type) + "'");
-
-    return true;
 }
 
 
@@ -79,6 +79,13 @@ public:
     // Returns false if no tokens are left.
     bool parse_statement(Lexer& lex);
 
+    // parse_statement() = parse_datasets() + parse_statement_body().
+    // Parses optional "@n @m:" prefix, returns the default dataset if
+    // there is no prefix.
+    void parse_datasets(Lexer& lex, std::vector<int>& datasets) const;
+    // Parses the rest of the statement, to be executed in given datasets.
+    void parse_statement_body(Lexer& lex, const std::vector<int>& datasets);
+
     Statement& statement() { return st_; }
 
     // Returns true on success.
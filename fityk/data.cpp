@@ -15,15 +15,31 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <algorithm>
+#include <deque>
+#include <mutex>
 
 #include <xylib/xylib.h>
 #include <xylib/cache.h>
+#include <zlib.h>
 
 using std::string;
+using std::map;
 using std::vector;
 
 namespace fityk {
 
+// std::is_sorted() is added C++0x
+template <typename T>
+bool is_vector_sorted(const vector<T>& v)
+{
+    if (v.size() <= 1)
+        return true;
+    for (typename vector<T>::const_iterator i = v.begin()+1; i != v.end(); ++i)
+            if (*i < *(i-1))
+                return false;
+    return true;
+}
+
 // filename utils
 string get_file_basename(const string& path)
 {
@@ -37,17 +53,131 @@ string get_file_basename(const string& path)
 }
 
 
+long SpillStore::write(const void* buf, size_t size)
+{
+    if (!file_) {
+        file_ = tmpfile();
+        if (!file_)
+            throw ExecuteError("Cannot create temporary file for datasets.");
+    }
+    // first fit
+    long offset = end_;
+    for (map<long, size_t>::iterator i = free_.begin(); i != free_.end(); ++i)
+        if (i->second >= size) {
+            offset = i->first;
+            if (i->second > size)
+                free_[offset + size] = i->second - size;
+            free_.erase(i);
+            break;
+        }
+    if (fseek(file_, offset, SEEK_SET) != 0 ||
+            fwrite(buf, 1, size, file_) != size) {
+        release(offset, size);
+        throw ExecuteError("Writing dataset to temporary file failed.");
+    }
+    if (offset == end_)
+        end_ += size;
+    return offset;
+}
+
+bool SpillStore::read(long offset, void* buf, size_t size)
+{
+    return file_ && fseek(file_, offset, SEEK_SET) == 0 &&
+           fread(buf, 1, size, file_) == size;
+}
+
+void SpillStore::release(long offset, size_t size)
+{
+    if (size == 0)
+        return;
+    // merge with adjacent free extents
+    map<long, size_t>::iterator next = free_.lower_bound(offset);
+    if (next != free_.end() && offset + (long) size == next->first) {
+        size += next->second;
+        free_.erase(next++);
+    }
+    if (next != free_.begin()) {
+        map<long, size_t>::iterator prev = next;
+        --prev;
+        if (prev->first + (long) prev->second == offset) {
+            offset = prev->first;
+            size += prev->second;
+            free_.erase(prev);
+        }
+    }
+    if (offset + (long) size >= end_)
+        end_ = offset; // the file is not truncated, the space is reused
+    else
+        free_[offset] = size;
+}
+
+
 Data::Data(BasicContext* ctx, Model *model)
         : ctx_(ctx), model_(model),
-          x_step_(0.), has_sigma_(false), xps_source_energy_(0.)
+          x_step_(0.), has_sigma_(false), xps_source_energy_(0.),
+          spill_store_(NULL), spill_offset_(0), spill_size_(0), spilled_n_(0),
+          last_use_(0)
 {
 }
 
 Data::~Data()
 {
+    release_spilled();
     model_->destroy();
 }
 
+size_t Data::memory_usage() const
+{
+    return p_.capacity() * sizeof(Point) + active_.capacity() * sizeof(int);
+}
+
+void Data::spill(SpillStore* store)
+{
+    if (spill_store_ || p_.empty())
+        return;
+    uLong src_len = p_.size() * sizeof(Point);
+    uLongf dest_len = compressBound(src_len);
+    vector<Bytef> buf(dest_len);
+    // level 1 - fast compression, the file is temporary anyway
+    if (compress2(&buf[0], &dest_len, (const Bytef*) &p_[0], src_len, 1)
+            != Z_OK)
+        throw ExecuteError("Compressing dataset failed.");
+    spill_offset_ = store->write(&buf[0], dest_len);
+    spill_store_ = store;
+    spill_size_ = dest_len;
+    spilled_n_ = p_.size();
+    vector<Point>().swap(p_);
+    vector<int>().swap(active_);
+}
+
+void Data::unspill()
+{
+    if (!spill_store_)
+        return;
+    vector<Bytef> buf(spill_size_);
+    bool ok = spill_store_->read(spill_offset_, &buf[0], spill_size_);
+    size_t n = spilled_n_;
+    release_spilled();
+    p_.resize(n);
+    uLongf len = n * sizeof(Point);
+    if (!ok || uncompress((Bytef*) &p_[0], &len, &buf[0], buf.size()) != Z_OK
+            || len != n * sizeof(Point)) {
+        p_.clear();
+        throw ExecuteError("Reading dataset from temporary file failed.");
+    }
+    update_active_p();
+}
+
+void Data::release_spilled()
+{
+    if (!spill_store_)
+        return;
+    spill_store_->release(spill_offset_, spill_size_);
+    spill_store_ = NULL;
+    spill_offset_ = 0;
+    spill_size_ = spilled_n_ = 0;
+}
+
 
 string Data::get_info() const
 {
@@ -75,6 +205,7 @@ string Data::get_info() const
 // does not clear model
 void Data::clear()
 {
+    release_spilled();
     spec_ = LoadSpec();
     title_ = "";
     p_.clear();
@@ -118,18 +249,29 @@ int Data::load_arrays(const vector<realt> &x, const vector<realt> &y,
 {
     assert(x.size() == y.size());
     assert(sigma.empty() || sigma.size() == y.size());
+    return load_arrays(x.data(), y.data(), sigma.empty() ? NULL : sigma.data(),
+                       y.size(), title);
+}
+
+// Points are copied directly from the caller's arrays. When the same
+// dataset is re-loaded with the same number of points, no memory
+// is allocated.
+int Data::load_arrays(const realt* x, const realt* y, const realt* sigma,
+                      int n, const string &title)
+{
     clear();
     title_ = title;
-    p_.resize(y.size());
-    if (sigma.empty())
-        for (size_t i = 0; i != y.size(); ++i)
+    p_.resize(n);
+    if (sigma == NULL)
+        for (int i = 0; i != n; ++i)
             p_[i] = Point(x[i], y[i]);
     else {
-        for (size_t i = 0; i != y.size(); ++i)
+        for (int i = 0; i != n; ++i)
             p_[i] = Point(x[i], y[i], sigma[i]);
         has_sigma_ = true;
     }
-    sort_points();
+    if (!is_vector_sorted(p_))
+        sort_points();
     find_step();
     post_load();
     return p_.size();
@@ -142,6 +284,12 @@ void Data::set_points(const vector<Point> &p)
     after_transform();
 }
 
+void Data::set_points(vector<Point>&& p)
+{
+    p_.swap(p);
+    after_transform(); // sorts points if needed
+}
+
 void Data::revert()
 {
     if (spec_.path.empty())
@@ -212,6 +360,54 @@ void Data::add_one_point(realt x, realt y, realt sigma)
     }
 }
 
+// Adds many points at once, copying them directly from the caller's arrays.
+// If sigma is NULL, it is set according to the default_sigma option,
+// as in load_arrays().
+// If the batch is sorted and starts at or after the last point (typical
+// for data acquired on the fly) the points are appended, otherwise
+// the sorted batch is merged into p_.
+// In both cases the cost is linear, unlike calling add_one_point() in a loop.
+void Data::add_points(const realt* x, const realt* y, const realt* sigma,
+                      int n)
+{
+    if (n <= 0)
+        return;
+    size_t old_size = p_.size();
+    bool appending = p_.empty() || !(x[0] < p_.back().x);
+    bool sqrt_sigma = sigma == NULL &&
+                      ctx_->get_settings()->default_sigma == "sqrt";
+    p_.resize(old_size + n);
+    for (int i = 0; i != n; ++i) {
+        realt s = sigma != NULL ? sigma[i]
+                                : (sqrt_sigma && y[i] > 1. ? sqrt(y[i]) : 1.);
+        p_[old_size + i] = Point(x[i], y[i], s);
+        if (i > 0 && x[i] < x[i-1])
+            appending = false;
+    }
+    if (!appending) {
+        vector<Point>::iterator middle = p_.begin() + old_size;
+        stable_sort(middle, p_.end());
+        inplace_merge(p_.begin(), middle, p_.end());
+        find_step();
+        update_active_p();
+        return;
+    }
+    for (size_t i = old_size; i != p_.size(); ++i)
+        if (p_[i].is_active)
+            active_.push_back(i);
+    // (fast) x_step_ update, checking only the new steps
+    if (old_size < 2)
+        find_step();
+    else if (x_step_ != 0) {
+        double max_diff = 1e-4 * fabs(x_step_);
+        for (size_t i = old_size; i != p_.size(); ++i)
+            if (fabs((p_[i].x - p_[i-1].x) - x_step_) >= max_diff) {
+                x_step_ = 0.;
+                break;
+            }
+    }
+}
+
 void Data::update_active_for_one_point(int idx)
 {
     vector<int>::iterator a = lower_bound(active_.begin(), active_.end(), idx);
@@ -236,12 +432,70 @@ static string tr_opt(string options)
     return options;
 }
 
+// xylib::Cache is a process-wide singleton without locking, so calls from
+// Fityk instances running in different threads must be serialized
+static std::mutex xylib_cache_mutex;
+
+// xylib doesn't report how much memory its cache takes. We remember
+// estimated sizes of files recently loaded through the cache (the most
+// recent first), assuming that xylib keeps get_max_size() of them.
+struct CachedFileSize
+{
+    string key;
+    size_t bytes;
+};
+static std::deque<CachedFileSize> xylib_cache_sizes;
+
+static
+size_t estimate_xylib_dataset_size(const xylib::DataSet* ds)
+{
+    size_t n = 0;
+    for (int i = 0; i < ds->get_block_count(); ++i) {
+        const xylib::Block* block = ds->get_block(i);
+        n += (size_t) block->get_point_count() * block->get_column_count();
+    }
+    return n * sizeof(double);
+}
+
+static
+dataset_shared_ptr load_with_xylib_cache(const string& path,
+                                         const string& format,
+                                         const string& options)
+{
+    std::lock_guard<std::mutex> lock(xylib_cache_mutex);
+    dataset_shared_ptr xyds = xylib::cached_load_file(path, format, options);
+    string key = path + '\0' + format + '\0' + options;
+    for (std::deque<CachedFileSize>::iterator i = xylib_cache_sizes.begin();
+            i != xylib_cache_sizes.end(); ++i)
+        if (i->key == key) {
+            xylib_cache_sizes.erase(i);
+            break;
+        }
+    CachedFileSize item = { key, estimate_xylib_dataset_size(xyds.get()) };
+    xylib_cache_sizes.push_front(item);
+    size_t max_size = xylib::Cache::Get()->get_max_size();
+    if (xylib_cache_sizes.size() > max_size)
+        xylib_cache_sizes.resize(max_size);
+    return xyds;
+}
+
+size_t Data::loader_cache_usage(int* n_files)
+{
+    std::lock_guard<std::mutex> lock(xylib_cache_mutex);
+    size_t bytes = 0;
+    for (const CachedFileSize& item : xylib_cache_sizes)
+        bytes += item.bytes;
+    if (n_files)
+        *n_files = xylib_cache_sizes.size();
+    return bytes;
+}
+
 int Data::count_blocks(const string& filename,
                        const string& format, const string& options)
 {
     try {
-        dataset_shared_ptr xyds(xylib::cached_load_file(filename,
-                                                     format, tr_opt(options)));
+        dataset_shared_ptr xyds(load_with_xylib_cache(filename,
+                                                      format, tr_opt(options)));
         return xyds->get_block_count();
     } catch (const std::runtime_error& e) {
         throw ExecuteError(e.what());
@@ -253,8 +507,8 @@ int Data::count_columns(const string& filename,
                         int first_block)
 {
     try {
-        dataset_shared_ptr xyds(xylib::cached_load_file(filename,
-                                                     format, tr_opt(options)));
+        dataset_shared_ptr xyds(load_with_xylib_cache(filename,
+                                                      format, tr_opt(options)));
         return xyds->get_block(first_block)->get_column_count();
     } catch (const std::runtime_error& e) {
         throw ExecuteError(e.what());
@@ -286,7 +540,7 @@ void Data::load_file(const LoadSpec& spec)
     try {
         string ds_options = tr_opt(spec.options);
         dataset_shared_ptr xyds(
-            xylib::cached_load_file(spec.path, spec.format, ds_options));
+            load_with_xylib_cache(spec.path, spec.format, ds_options));
         verify_options(xyds.get(), ds_options);
         clear(); //removing previous file
         vector<int> bb = spec.blocks.empty() ? vector1(0) : spec.blocks;
@@ -360,18 +614,6 @@ void Data::load_file(const LoadSpec& spec)
 }
 
 
-// std::is_sorted() is added C++0x
-template <typename T>
-bool is_vector_sorted(const vector<T>& v)
-{
-    if (v.size() <= 1)
-        return true;
-    for (typename vector<T>::const_iterator i = v.begin()+1; i != v.end(); ++i)
-            if (*i < *(i-1))
-                return false;
-    return true;
-}
-
 void Data::after_transform()
 {
     if (!is_vector_sorted(p_))
@@ -459,8 +701,10 @@ void Data::sort_points()
 std::pair<int,int> Data::get_index_range(const RealRange& range) const
 {
     //pre: p_.x is sorted, active_ is sorted
-    int p1 = lower_bound(p_.begin(), p_.end(), Point(range.lo,0)) - p_.begin();
-    int p2 = upper_bound(p_.begin(), p_.end(), Point(range.hi,0)) - p_.begin();
+    int p1 = lower_bound_idx(p_, range.lo, x_step_);
+    int p2 = upper_bound_idx(p_, range.hi, x_step_);
+    if (active_.size() == p_.size()) // all points are active, active_[i]==i
+        return std::make_pair(p1, std::min(p2 + 1, (int) p_.size()));
     int a1 = lower_bound(active_.begin(), active_.end(), p1) - active_.begin();
     int a2 = upper_bound(active_.begin(), active_.end(), p2) - active_.begin();
     return std::make_pair(a1, a2);
@@ -468,7 +712,7 @@ std::pair<int,int> Data::get_index_range(const RealRange& range) const
 
 vector<Point>::const_iterator Data::get_point_at(double x) const
 {
-    return lower_bound (p_.begin(), p_.end(), Point(x,0));
+    return p_.begin() + lower_bound_idx(p_, x, x_step_);
 }
 
 double Data::get_x_min() const
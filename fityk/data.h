@@ -5,7 +5,9 @@
 #define FITYK_DATA_H_
 #include <string>
 #include <vector>
+#include <cstdio>
 #include <limits.h>
+#include <map>
 #include <utility>
 #include "common.h"
 
@@ -20,6 +22,30 @@ class Model;
 
 FITYK_API std::string get_file_basename(std::string const& path);
 
+/// Temporary file shared by spilled datasets (see Data::spill()).
+/// Space freed by datasets that are loaded back or deleted is reused.
+class FITYK_API SpillStore
+{
+public:
+    SpillStore() : file_(NULL), end_(0) {}
+    ~SpillStore() { if (file_) fclose(file_); }
+    /// writes size bytes to the file and returns the offset
+    long write(const void* buf, size_t size);
+    /// reads the data written by write(); doesn't release the space
+    bool read(long offset, void* buf, size_t size);
+    /// marks the space as free
+    void release(long offset, size_t size);
+    /// size of the file, including free space
+    long file_size() const { return end_; }
+
+private:
+    FILE* file_;
+    long end_;
+    std::map<long, size_t> free_; // free extents: offset -> size
+
+    DISALLOW_COPY_AND_ASSIGN(SpillStore);
+};
+
 /// dataset
 class FITYK_API Data
 {
@@ -31,6 +57,8 @@ public :
                              const std::string& format,
                              const std::string& options,
                              int first_block);
+    /// estimated memory (in bytes) taken by files cached by xylib
+    static size_t loader_cache_usage(int* n_files);
 
     Data(BasicContext *ctx, Model *model);
     ~Data();
@@ -41,11 +69,15 @@ public :
     int load_arrays(const std::vector<realt>& x, const std::vector<realt>& y,
                     const std::vector<realt>& sigma,
                     const std::string& title);
+    int load_arrays(const realt* x, const realt* y, const realt* sigma, int n,
+                    const std::string& title);
     //void load_data_sum(const std::vector<const Data*>& dd,
     //                   const std::string& op);
     void set_points(const std::vector<Point>& p);
+    void set_points(std::vector<Point>&& p);
     void clear();
     void add_one_point(realt x, realt y, realt sigma);
+    void add_points(const realt* x, const realt* y, const realt* sigma, int n);
     realt get_x(int n) const { return p_[active_[n]].x; }
     realt get_y(int n) const { return p_[active_[n]].y; }
     realt get_sigma (int n) const { return p_[active_[n]].sigma; }
@@ -85,6 +117,21 @@ public :
     const Model* model() const { return model_; }
     double xps_source_energy() const { return xps_source_energy_; }
 
+    // points can be moved to a compressed temporary file to save memory
+    // (used by DataKeeper, other code should not see spilled datasets)
+    bool is_spilled() const { return spill_store_ != NULL; }
+    void spill(SpillStore* store);
+    void unspill();
+    size_t spilled_size() const { return spill_size_; }
+    // number of points, also of a spilled dataset
+    size_t point_count() const
+                { return is_spilled() ? spilled_n_ : p_.size(); }
+    size_t memory_usage() const; // approximate size of points in bytes
+    size_t active_memory_usage() const // part of memory_usage()
+                                { return active_.capacity() * sizeof(int); }
+    unsigned long last_use() const { return last_use_; }
+    void set_last_use(unsigned long n) { last_use_ = n; }
+
 private:
     const BasicContext* ctx_;
     Model* const model_;
@@ -95,8 +142,14 @@ private:
     std::vector<Point> p_;
     std::vector<int> active_;
     double xps_source_energy_;
+    SpillStore* spill_store_; // NULL if points are in memory
+    long spill_offset_; // position of compressed points in spill_store_
+    size_t spill_size_; // size of compressed points in spill_store_
+    size_t spilled_n_; // number of spilled points
+    unsigned long last_use_; // set by DataKeeper
 
     void post_load();
+    void release_spilled();
     void verify_options(const xylib::DataSet* ds, const std::string& options);
     DISALLOW_COPY_AND_ASSIGN(Data);
 };
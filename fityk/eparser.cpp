@@ -81,6 +81,19 @@ const char* function_name(int op)
         case OP_DT_AVG_SAME_X: return "avg_same_x";
         case OP_DT_SHIRLEY_BG: return "shirley_bg";
         case OP_DT_SNIP_BG: return "snip_bg";
+        case OP_DT_FFT_RE: return "fft_re";
+        case OP_DT_FFT_IM: return "fft_im";
+        case OP_DT_FFT_AMP: return "fft_amp";
+        case OP_DT_CONVOLVE: return "convolve";
+        case OP_DT_DECONVOLVE: return "deconvolve";
+        case OP_DT_LOWPASS: return "lowpass";
+        case OP_DT_SAVITZKY_GOLAY: return "savitzky_golay";
+        case OP_DT_MOVING_AVG: return "moving_avg";
+        case OP_DT_MEDIAN_FILTER: return "median_filter";
+        case OP_DT_WHITTAKER: return "whittaker";
+        case OP_DT_RESAMPLE: return "resample";
+        case OP_DT_RESAMPLE_CUBIC: return "resample_cubic";
+        case OP_DT_REBIN: return "rebin";
         // 2-args functions
         case OP_MOD: return "mod";
         case OP_MIN2: return "min2";
@@ -128,7 +141,9 @@ int get_function_narg(int op)
         case OP_XINDEX:
         case OP_DT_SUM_SAME_X:
         case OP_DT_AVG_SAME_X:
-        case OP_DT_SHIRLEY_BG:
+        case OP_DT_FFT_RE:
+        case OP_DT_FFT_IM:
+        case OP_DT_FFT_AMP:
             return 1;
         // 2-args functions
         case OP_MOD:
@@ -139,7 +154,20 @@ int get_function_narg(int op)
         case OP_DVOIGT_DY:
         case OP_RANDNORM:
         case OP_RANDU:
+        case OP_DT_CONVOLVE:
+        case OP_DT_LOWPASS:
+        case OP_DT_MOVING_AVG:
+        case OP_DT_MEDIAN_FILTER:
+        case OP_DT_WHITTAKER:
+        case OP_DT_RESAMPLE:
+        case OP_DT_RESAMPLE_CUBIC:
+        case OP_DT_REBIN:
             return 2;
+        case OP_DT_DECONVOLVE:
+            return 3;
+        case OP_DT_SHIRLEY_BG:
+        case OP_DT_SAVITZKY_GOLAY:
+            return 4;
         case OP_DT_SNIP_BG:
             return 5;
         // Fityk functions
@@ -825,6 +853,32 @@ void ExpressionParser::parse_expr(Lexer& lex, int default_ds,
                         put_function(OP_DT_SHIRLEY_BG);
                     else if (mode == kDatasetTrMode && word == "snip_bg")
                         put_function(OP_DT_SNIP_BG);
+                    else if (mode == kDatasetTrMode && word == "fft_re")
+                        put_function(OP_DT_FFT_RE);
+                    else if (mode == kDatasetTrMode && word == "fft_im")
+                        put_function(OP_DT_FFT_IM);
+                    else if (mode == kDatasetTrMode && word == "fft_amp")
+                        put_function(OP_DT_FFT_AMP);
+                    else if (mode == kDatasetTrMode && word == "convolve")
+                        put_function(OP_DT_CONVOLVE);
+                    else if (mode == kDatasetTrMode && word == "deconvolve")
+                        put_function(OP_DT_DECONVOLVE);
+                    else if (mode == kDatasetTrMode && word == "lowpass")
+                        put_function(OP_DT_LOWPASS);
+                    else if (mode == kDatasetTrMode && word == "savitzky_golay")
+                        put_function(OP_DT_SAVITZKY_GOLAY);
+                    else if (mode == kDatasetTrMode && word == "moving_avg")
+                        put_function(OP_DT_MOVING_AVG);
+                    else if (mode == kDatasetTrMode && word == "median_filter")
+                        put_function(OP_DT_MEDIAN_FILTER);
+                    else if (mode == kDatasetTrMode && word == "whittaker")
+                        put_function(OP_DT_WHITTAKER);
+                    else if (mode == kDatasetTrMode && word == "resample")
+                        put_function(OP_DT_RESAMPLE);
+                    else if (mode == kDatasetTrMode && word == "resample_cubic")
+                        put_function(OP_DT_RESAMPLE_CUBIC);
+                    else if (mode == kDatasetTrMode && word == "rebin")
+                        put_function(OP_DT_REBIN);
 
                     else
                         lex.throw_syntax_error("unknown function: " + word);
@@ -877,8 +931,9 @@ void ExpressionParser::parse_expr(Lexer& lex, int default_ds,
                     if (mode != kDatasetTrMode)
                         lex.get_expected_token(kTokenDot);
                     int n = token.value.i;
-                    if (n == Lexer::kAll || n == Lexer::kNew)
-                        lex.throw_syntax_error("@*/@+ not allowed at RHS");
+                    // @* at RHS stands for the dataset being transformed
+                    if (n == Lexer::kNew)
+                        lex.throw_syntax_error("@+ not allowed at RHS");
                     vm_.append_code(OP_DATASET);
                     vm_.append_code(n);
                     expected_ = kOperator;
@@ -918,6 +973,19 @@ void ExpressionParser::parse_expr(Lexer& lex, int default_ds,
                 if (!opstack_.empty()) {
                     int top = opstack_.back();
                     if (is_function(top)) {
+                        // shirley_bg(@n) = shirley_bg(@n, 50, 1e-6, 0)
+                        if (top == OP_DT_SHIRLEY_BG) {
+                            int& n_commas = opstack_[opstack_.size()-2];
+                            if (n_commas == 0) {
+                                vm_.append_number(50);
+                                vm_.append_number(1e-6);
+                                n_commas += 2;
+                            }
+                            if (n_commas == 2) {
+                                vm_.append_number(0);
+                                ++n_commas;
+                            }
+                        }
                         pop_onto_que();
                         int n = opstack_.back() + 1;
                         opstack_.pop_back();
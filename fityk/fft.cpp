@@ -0,0 +1,362 @@
+// This file is part of fityk program. Copyright 2001-2013 Marcin Wojdyr
+// Licence: GNU General Public License ver. 2+
+
+#define BUILDING_LIBFITYK
+#include "fft.h"
+
+#include <math.h>
+#include <assert.h>
+
+using namespace std;
+
+namespace fityk {
+
+// larger prime factors are handled by Bluestein's algorithm
+static const int kMaxRadix = 13;
+
+FftPlan::FftPlan(int n)
+    : n_(n), conv_plan_(NULL)
+{
+    assert(n > 0);
+    int rest = n;
+    while (rest % 4 == 0) {
+        factors_.push_back(4);
+        rest /= 4;
+    }
+    for (int p = 2; p <= kMaxRadix; ++p)
+        while (rest % p == 0) {
+            factors_.push_back(p);
+            rest /= p;
+        }
+    if (rest == 1) {
+        // twiddle factors exp(-2 pi i jk/len) for each level, stored
+        // in the order in which they are used, followed by p roots of unity
+        int len = n;
+        for (size_t level = 0; level != factors_.size(); ++level) {
+            int p = factors_[level];
+            int m = len / p;
+            tw_offsets_.push_back(twiddles_.size());
+            for (int j = 1; j < p; ++j)
+                for (int k = 0; k < m; ++k)
+                    twiddles_.push_back(polar(1., -2 * M_PI * j * k / len));
+            for (int r = 0; r < p; ++r)
+                twiddles_.push_back(polar(1., -2 * M_PI * r / p));
+            len = m;
+        }
+    } else {
+        factors_.clear();
+        int m = 1;
+        while (m < 2 * n - 1)
+            m *= 2;
+        conv_plan_ = new FftPlan(m);
+        chirp_.resize(n);
+        for (int k = 0; k < n; ++k) {
+            // k^2 mod 2n keeps the argument of sin/cos small
+            long long k2 = (long long) k * k % (2 * n);
+            chirp_[k] = polar(1., -M_PI * k2 / n);
+        }
+        chirp_ft_.assign(m, Complex(0., 0.));
+        chirp_ft_[0] = conj(chirp_[0]);
+        for (int k = 1; k < n; ++k)
+            chirp_ft_[k] = chirp_ft_[m-k] = conj(chirp_[k]);
+        conv_plan_->transform(chirp_ft_, false);
+    }
+}
+
+FftPlan::~FftPlan()
+{
+    delete conv_plan_;
+}
+
+void FftPlan::transform(vector<Complex>& data, bool inverse) const
+{
+    assert((int) data.size() == n_);
+    if (conv_plan_ != NULL) {
+        bluestein(data, inverse);
+    } else if (n_ > 1) {
+        vector<Complex> out(n_);
+        recurse(&data[0], &out[0], n_, 1, 0, inverse);
+        data.swap(out);
+    }
+}
+
+namespace {
+
+// std::complex multiplication handles inf/nan according to C99 Annex G,
+// what makes it several times slower
+inline Complex mul(const Complex& a, const Complex& b)
+{
+    return Complex(a.real() * b.real() - a.imag() * b.imag(),
+                   a.real() * b.imag() + a.imag() * b.real());
+}
+
+// twiddle factor for the forward or inverse transform
+template<bool Inverse>
+inline Complex twiddle(const Complex* tw, int k)
+{
+    return Inverse ? conj(tw[k]) : tw[k];
+}
+
+// -i*d in forward transform, i*d in inverse
+template<bool Inverse>
+inline Complex mul_minus_i(const Complex& d)
+{
+    return Inverse ? Complex(-d.imag(), d.real())
+                   : Complex(d.imag(), -d.real());
+}
+
+// tw[(j-1)*m+k] == exp(-2 pi i jk/(p*m)), tw[(p-1)*m+r] == exp(-2 pi i r/p)
+
+template<bool Inverse>
+void radix2(Complex* out, int m, const Complex* tw)
+{
+    for (int k = 0; k < m; ++k) {
+        Complex t = mul(twiddle<Inverse>(tw, k), out[k+m]);
+        out[k+m] = out[k] - t;
+        out[k] += t;
+    }
+}
+
+template<bool Inverse>
+void radix4(Complex* out, int m, const Complex* tw)
+{
+    for (int k = 0; k < m; ++k) {
+        Complex t0 = out[k];
+        Complex t1 = mul(twiddle<Inverse>(tw, k), out[k+m]);
+        Complex t2 = mul(twiddle<Inverse>(tw, m+k), out[k+2*m]);
+        Complex t3 = mul(twiddle<Inverse>(tw, 2*m+k), out[k+3*m]);
+        Complex a0 = t0 + t2;
+        Complex a1 = t0 - t2;
+        Complex a2 = t1 + t3;
+        Complex a3 = mul_minus_i<Inverse>(t1 - t3);
+        out[k] = a0 + a2;
+        out[k+m] = a1 + a3;
+        out[k+2*m] = a0 - a2;
+        out[k+3*m] = a1 - a3;
+    }
+}
+
+template<bool Inverse>
+void radix3(Complex* out, int m, const Complex* tw)
+{
+    const double s60 = 0.86602540378443864676; // sin(2 pi/3)
+    for (int k = 0; k < m; ++k) {
+        Complex t0 = out[k];
+        Complex t1 = mul(twiddle<Inverse>(tw, k), out[k+m]);
+        Complex t2 = mul(twiddle<Inverse>(tw, m+k), out[k+2*m]);
+        Complex a = t1 + t2;
+        Complex b = mul_minus_i<Inverse>(t1 - t2) * s60;
+        Complex c = t0 - a * 0.5;
+        out[k] = t0 + a;
+        out[k+m] = c + b;
+        out[k+2*m] = c - b;
+    }
+}
+
+template<bool Inverse>
+void radix5(Complex* out, int m, const Complex* tw)
+{
+    const double c1 = 0.30901699437494742410;  // cos(2 pi/5)
+    const double c2 = -0.80901699437494742410; // cos(4 pi/5)
+    const double s1 = 0.95105651629515357212;  // sin(2 pi/5)
+    const double s2 = 0.58778525229247312917;  // sin(4 pi/5)
+    for (int k = 0; k < m; ++k) {
+        Complex t0 = out[k];
+        Complex t1 = mul(twiddle<Inverse>(tw, k), out[k+m]);
+        Complex t2 = mul(twiddle<Inverse>(tw, m+k), out[k+2*m]);
+        Complex t3 = mul(twiddle<Inverse>(tw, 2*m+k), out[k+3*m]);
+        Complex t4 = mul(twiddle<Inverse>(tw, 3*m+k), out[k+4*m]);
+        Complex a1 = t1 + t4;
+        Complex b1 = t1 - t4;
+        Complex a2 = t2 + t3;
+        Complex b2 = t2 - t3;
+        Complex r1 = t0 + a1 * c1 + a2 * c2;
+        Complex r2 = t0 + a1 * c2 + a2 * c1;
+        Complex i1 = mul_minus_i<Inverse>(b1 * s1 + b2 * s2);
+        Complex i2 = mul_minus_i<Inverse>(b1 * s2 - b2 * s1);
+        out[k] = t0 + a1 + a2;
+        out[k+m] = r1 + i1;
+        out[k+2*m] = r2 + i2;
+        out[k+3*m] = r2 - i2;
+        out[k+4*m] = r1 - i1;
+    }
+}
+
+// generic radix p, O(p^2) per butterfly
+template<bool Inverse>
+void radix_p(Complex* out, int p, int m, const Complex* tw)
+{
+    Complex roots[kMaxRadix];
+    for (int r = 0; r < p; ++r)
+        roots[r] = twiddle<Inverse>(tw, (p-1)*m + r);
+    for (int k = 0; k < m; ++k) {
+        Complex t[kMaxRadix];
+        t[0] = out[k];
+        for (int j = 1; j < p; ++j)
+            t[j] = mul(twiddle<Inverse>(tw, (j-1)*m + k), out[j*m+k]);
+        for (int q = 0; q < p; ++q) {
+            Complex sum = t[0];
+            int r = 0;
+            for (int j = 1; j < p; ++j) {
+                r += q;
+                if (r >= p)
+                    r -= p;
+                sum += mul(t[j], roots[r]); // r == j*q mod p
+            }
+            out[q*m+k] = sum;
+        }
+    }
+}
+
+} // anonymous namespace
+
+// Recursive decimation in time. Input: in[0], in[stride], ...,
+// output: n coefficients in out. At each level n == n_ / stride.
+void FftPlan::recurse(const Complex* in, Complex* out, int n, int stride,
+                      int level, bool inverse) const
+{
+    const int p = factors_[level];
+    const int m = n / p;
+    if (m == 1) {
+        for (int j = 0; j < p; ++j)
+            out[j] = in[j * stride];
+    } else {
+        for (int j = 0; j < p; ++j)
+            recurse(in + j * stride, out + j * m, m, stride * p, level + 1,
+                    inverse);
+    }
+    // out[j*m+k] is now the k-th coefficient of the j-th subsequence
+    const Complex* tw = &twiddles_[tw_offsets_[level]];
+    if (p == 2) {
+        if (inverse)
+            radix2<true>(out, m, tw);
+        else
+            radix2<false>(out, m, tw);
+    } else if (p == 3) {
+        if (inverse)
+            radix3<true>(out, m, tw);
+        else
+            radix3<false>(out, m, tw);
+    } else if (p == 4) {
+        if (inverse)
+            radix4<true>(out, m, tw);
+        else
+            radix4<false>(out, m, tw);
+    } else if (p == 5) {
+        if (inverse)
+            radix5<true>(out, m, tw);
+        else
+            radix5<false>(out, m, tw);
+    } else {
+        if (inverse)
+            radix_p<true>(out, p, m, tw);
+        else
+            radix_p<false>(out, p, m, tw);
+    }
+}
+
+// DFT as a convolution with a chirp, computed with power-of-2 FFT
+void FftPlan::bluestein(vector<Complex>& data, bool inverse) const
+{
+    // inverse DFT(x) == conj(DFT(conj(x)))
+    if (inverse)
+        for (int k = 0; k < n_; ++k)
+            data[k] = conj(data[k]);
+    int m = conv_plan_->size();
+    vector<Complex> a(m, Complex(0., 0.));
+    for (int k = 0; k < n_; ++k)
+        a[k] = mul(data[k], chirp_[k]);
+    conv_plan_->transform(a, false);
+    for (int k = 0; k < m; ++k)
+        a[k] = mul(a[k], chirp_ft_[k]);
+    conv_plan_->transform(a, true);
+    for (int k = 0; k < n_; ++k)
+        data[k] = mul(chirp_[k], a[k]) / double(m);
+    if (inverse)
+        for (int k = 0; k < n_; ++k)
+            data[k] = conj(data[k]);
+}
+
+// For even n, the real sequence is packed into a complex sequence
+// of length n/2: z[k] = x[2k] + i x[2k+1], and the coefficients
+// are separated after the transform.
+RealFft::RealFft(int n)
+    : n_(n), plan_(n % 2 == 0 ? n / 2 : n)
+{
+    if (n % 2 == 0) {
+        w_.resize(n / 2 + 1);
+        for (int k = 0; k <= n / 2; ++k)
+            w_[k] = polar(1., -2 * M_PI * k / n);
+    }
+}
+
+void RealFft::forward(const vector<double>& in, vector<Complex>* out) const
+{
+    assert((int) in.size() == n_);
+    out->resize(n_ / 2 + 1);
+    if (n_ % 2 != 0) {
+        vector<Complex> z(in.begin(), in.end());
+        plan_.transform(z, false);
+        copy(z.begin(), z.begin() + n_ / 2 + 1, out->begin());
+        return;
+    }
+    const int h = n_ / 2;
+    vector<Complex> z(h);
+    for (int k = 0; k < h; ++k)
+        z[k] = Complex(in[2*k], in[2*k+1]);
+    plan_.transform(z, false);
+    for (int k = 0; k <= h; ++k) {
+        Complex zk = z[k % h];
+        Complex zc = conj(z[(h - k) % h]);
+        Complex even = (zk + zc) * 0.5;
+        Complex odd = (zk - zc) * Complex(0., -0.5);
+        (*out)[k] = even + mul(w_[k], odd);
+    }
+}
+
+void RealFft::inverse(const vector<Complex>& in, vector<double>* out) const
+{
+    assert((int) in.size() == n_ / 2 + 1);
+    out->resize(n_);
+    if (n_ % 2 != 0) {
+        vector<Complex> z(n_);
+        for (int k = 0; k <= n_ / 2; ++k)
+            z[k] = in[k];
+        for (int k = n_ / 2 + 1; k < n_; ++k)
+            z[k] = conj(in[n_-k]);
+        plan_.transform(z, true);
+        for (int k = 0; k < n_; ++k)
+            (*out)[k] = z[k].real() / n_;
+        return;
+    }
+    const int h = n_ / 2;
+    vector<Complex> z(h);
+    for (int k = 0; k < h; ++k) {
+        Complex xc = conj(in[h-k]);
+        Complex even = (in[k] + xc) * 0.5;
+        Complex odd = mul((in[k] - xc) * 0.5, conj(w_[k]));
+        z[k] = even + Complex(-odd.imag(), odd.real()); // even + i*odd
+    }
+    plan_.transform(z, true);
+    for (int k = 0; k < h; ++k) {
+        (*out)[2*k] = z[k].real() / h;
+        (*out)[2*k+1] = z[k].imag() / h;
+    }
+}
+
+int fft_good_size(int n)
+{
+    for (int m = max(n, 2); ; ++m) {
+        if (m % 2 != 0)
+            continue;
+        int rest = m;
+        const int primes[] = { 2, 3, 5 };
+        for (int p : primes)
+            while (rest % p == 0)
+                rest /= p;
+        if (rest == 1)
+            return m;
+    }
+}
+
+} // namespace fityk
@@ -0,0 +1,69 @@
+// This file is part of fityk program. Copyright 2001-2013 Marcin Wojdyr
+// Licence: GNU General Public License ver. 2+
+
+#ifndef FITYK_FFT_H_
+#define FITYK_FFT_H_
+
+#include <complex>
+#include <vector>
+#include "fityk.h" // FITYK_API
+
+namespace fityk {
+
+typedef std::complex<double> Complex;
+
+/// Discrete Fourier transform of any length in O(N log N).
+/// Mixed-radix Cooley-Tukey algorithm is used if all prime factors
+/// of the length are small, otherwise Bluestein's algorithm.
+class FITYK_API FftPlan
+{
+public:
+    explicit FftPlan(int n);
+    ~FftPlan();
+    int size() const { return n_; }
+    /// in-place transform, exp(-2 pi i jk/n) (forward) or exp(+...) (inverse);
+    /// the inverse transform is not normalized
+    void transform(std::vector<Complex>& data, bool inverse) const;
+
+private:
+    int n_;
+    std::vector<int> factors_;
+    std::vector<Complex> twiddles_; // see the constructor
+    std::vector<int> tw_offsets_; // offsets of twiddles_ for each level
+    // used only by Bluestein's algorithm
+    FftPlan* conv_plan_;
+    std::vector<Complex> chirp_;   // exp(-pi i k^2/n)
+    std::vector<Complex> chirp_ft_; // FFT of the conjugated chirp
+
+    FftPlan(const FftPlan&); // disallow copy
+    void operator=(const FftPlan&);
+    void recurse(const Complex* in, Complex* out, int n, int stride,
+                 int level, bool inverse) const;
+    void bluestein(std::vector<Complex>& data, bool inverse) const;
+};
+
+/// FFT of real sequences of length n. For even n, it uses complex FFT
+/// of length n/2.
+class FITYK_API RealFft
+{
+public:
+    explicit RealFft(int n);
+    int size() const { return n_; }
+    /// returns coefficients 0..n/2 (the rest are conjugates)
+    void forward(const std::vector<double>& in,
+                 std::vector<Complex>* out) const;
+    /// inverse of forward(), normalized by 1/n
+    void inverse(const std::vector<Complex>& in,
+                 std::vector<double>* out) const;
+
+private:
+    int n_;
+    FftPlan plan_;
+    std::vector<Complex> w_; // exp(-2 pi i k/n), k=0..n/2, for even n
+};
+
+/// the smallest even number >= n with no prime factors other than 2, 3, 5
+FITYK_API int fft_good_size(int n);
+
+} // namespace fityk
+#endif // FITYK_FFT_H_
@@ -4,8 +4,14 @@
 #define BUILDING_LIBFITYK
 #include "fit.h"
 
+#include <stdio.h>
 #include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 // Valgrind may not like the way boost::math::erfc_inv is initialized, see
 // https://svn.boost.org/trac/boost/ticket/10005
@@ -50,10 +56,193 @@ int count_points(const vector<Data*>& datas)
     return n;
 }
 
+/// one iteration in the fit trace
+struct FitTraceRecord
+{
+    int iteration;
+    realt wssr;
+    realt lambda;
+    int evaluations;
+    double wall;      // wall-clock time since the start of fit()
+    double cpu;       // CPU time since the start of fit()
+    double step_norm; // distance between parameters of this and previous record
+    vector<realt> a;
+};
+
+/// Writes fit trace records as JSON Lines in a background thread,
+/// so that fitting doesn't wait for the disk or the callback.
+/// The destructor writes all pending records.
+class FitTraceWriter
+{
+public:
+    FitTraceWriter(const string& method, FILE *file,
+                   t_fit_trace_callback *callback, void *user_data)
+        : method_(method), file_(file), callback_(callback),
+          user_data_(user_data), done_(false),
+          thread_(&FitTraceWriter::run, this) {}
+    ~FitTraceWriter();
+    void push(FitTraceRecord& r);
+private:
+    string method_;
+    FILE *file_; // can be NULL
+    t_fit_trace_callback *callback_; // can be NULL
+    void *user_data_;
+    mutex mutex_;
+    condition_variable cond_;
+    vector<FitTraceRecord> queue_;
+    bool done_;
+    thread thread_; // must be the last member, it starts running in ctor
+
+    void run();
+    string to_json(const FitTraceRecord& r) const;
+};
+
+FitTraceWriter::~FitTraceWriter()
+{
+    {
+        lock_guard<mutex> lock(mutex_);
+        done_ = true;
+    }
+    cond_.notify_one();
+    thread_.join();
+    if (file_)
+        fclose(file_);
+}
+
+void FitTraceWriter::push(FitTraceRecord& r)
+{
+    {
+        lock_guard<mutex> lock(mutex_);
+        queue_.push_back(FitTraceRecord());
+        swap(queue_.back(), r);
+    }
+    cond_.notify_one();
+}
+
+void FitTraceWriter::run()
+{
+    vector<FitTraceRecord> batch;
+    for (;;) {
+        {
+            unique_lock<mutex> lock(mutex_);
+            while (queue_.empty() && !done_)
+                cond_.wait(lock);
+            if (queue_.empty())
+                break;
+            batch.swap(queue_);
+        }
+        for (const FitTraceRecord& r : batch) {
+            string line = to_json(r);
+            if (file_) {
+                fputs(line.c_str(), file_);
+                fputc('\n', file_);
+            }
+            if (callback_)
+                (*callback_)(line.c_str(), user_data_);
+        }
+        batch.clear();
+    }
+}
+
+// JSON has no NaN and infinity
+static void append_json_number(string& s, double x)
+{
+    if (std::isfinite(x))
+        s += format1<double,32>("%.17g", x);
+    else
+        s += "null";
+}
+
+string FitTraceWriter::to_json(const FitTraceRecord& r) const
+{
+    string s = "{\"method\": \"" + method_ + "\", \"iteration\": "
+               + S(r.iteration) + ", \"wssr\": ";
+    append_json_number(s, r.wssr);
+    s += ", \"lambda\": ";
+    append_json_number(s, r.lambda);
+    s += ", \"evaluations\": " + S(r.evaluations);
+    s += format1<double,32>(", \"wall\": %.6f", r.wall);
+    s += format1<double,32>(", \"cpu\": %.6f", r.cpu);
+    s += ", \"step_norm\": ";
+    append_json_number(s, r.step_norm);
+    s += ", \"parameters\": [";
+    for (size_t i = 0; i != r.a.size(); ++i) {
+        if (i != 0)
+            s += ", ";
+        append_json_number(s, r.a[i]);
+    }
+    s += "]}";
+    return s;
+}
+
+static double wall_time()
+{
+    typedef chrono::steady_clock clock;
+    return chrono::duration<double>(clock::now().time_since_epoch()).count();
+}
+
 Fit::Fit(Full *F, const string& m)
     : name(m), F_(F),
-      evaluations_(0), na_(0), last_refresh_time_(0)
+      evaluations_(0), lambda_(0), na_(0), last_refresh_time_(0),
+      interrupt_mark_(0), best_wssr_(0), progress_callback_(NULL),
+      progress_data_(NULL), cancel_(NULL), trace_iter_(0), wall_start_(0)
+{
+}
+
+Fit::~Fit()
+{
+}
+
+// returns NULL if neither option fit_trace nor trace callback is set
+FitTraceWriter* Fit::open_trace()
+{
+    const string& path = F_->get_settings()->fit_trace;
+    t_fit_trace_callback *callback = F_->fit_trace_callback();
+    if (path.empty() && callback == NULL)
+        return NULL;
+    FILE *file = NULL;
+    if (!path.empty()) {
+        file = fopen(path.c_str(), "a");
+        if (file == NULL)
+            throw ExecuteError("Cannot open fit trace file: " + path);
+    }
+    return new FitTraceWriter(name, file, callback, F_->fit_trace_data());
+}
+
+void Fit::update_best_wssr(realt wssr, const vector<realt>& A)
+{
+    if (wssr < best_wssr_) {
+        best_wssr_ = wssr;
+        if (trace_)
+            best_a_ = A;
+    }
+}
+
+void Fit::trace_iteration()
+{
+    FitTraceRecord r;
+    r.iteration = ++trace_iter_;
+    r.wssr = best_wssr_;
+    r.lambda = lambda_;
+    r.evaluations = evaluations_;
+    r.wall = wall_time() - wall_start_;
+    r.cpu = elapsed();
+    const vector<realt>& a = best_a_.empty() ? a_orig_ : best_a_;
+    realt sum = 0;
+    for (size_t i = 0; i < a.size() && i < last_traced_a_.size(); ++i)
+        sum += (a[i] - last_traced_a_[i]) * (a[i] - last_traced_a_[i]);
+    r.step_norm = sqrt(sum);
+    last_traced_a_ = a;
+    r.a = a;
+    trace_->push(r);
+}
+
+void Fit::set_observer(t_fit_progress_callback *callback, void *user_data,
+                       const atomic<bool> *cancel)
 {
+    progress_callback_ = callback;
+    progress_data_ = user_data;
+    cancel_ = cancel;
 }
 
 /// dof = degrees of freedom = (number of points - number of parameters)
@@ -134,6 +323,10 @@ int Fit::compute_deviates(const vector<realt> &A, double *deviates)
     int ntot = 0;
     for (const Data* data : fitted_datas_)
         ntot += compute_deviates_for_data(data, deviates + ntot);
+    realt wssr = 0;
+    for (int i = 0; i < ntot; ++i)
+        wssr += deviates[i] * deviates[i];
+    update_best_wssr(wssr, A);
     return ntot;
 }
 
@@ -160,6 +353,8 @@ realt Fit::compute_wssr(const vector<realt> &A,
         wssr += compute_wssr_for_data(data, weigthed);
     }
     ++evaluations_;
+    if (weigthed)
+        update_best_wssr(wssr, A);
     return wssr;
 }
 
@@ -258,6 +453,7 @@ void Fit::compute_derivatives_for(const Data* data,
     // faster than a single loop over all points for large number of points.
     const int kMaxTileSize = 1024;
     vector<realt> dy_da;
+    Profiler* prof = F_->mgr.active_profiler();
     for (int tstart = 0; tstart < data->get_n(); tstart += kMaxTileSize) {
         const int dyn = na_+1;
         int tsize = min(data->get_n() - tstart, kMaxTileSize);
@@ -268,6 +464,8 @@ void Fit::compute_derivatives_for(const Data* data,
         dy_da.resize(tsize*dyn);
         fill(dy_da.begin(), dy_da.end(), 0.);
         data->model()->compute_model_with_derivs(xx, yy, dy_da);
+        ScopedProfile sp(prof ? &prof->phase(Profiler::kJacobian) : NULL,
+                         tsize);
         for (int i = 0; i != tsize; ++i) {
             realt inv_sig = 1.0 / data->get_sigma(tstart+i);
             realt dy_sig = (data->get_y(tstart+i) - yy[i]) * inv_sig;
@@ -332,6 +530,7 @@ realt Fit::compute_wssr_gradient(const vector<realt> &A,
     fill(grad, grad+na_, 0.0);
     for (const Data* data : datas)
         wssr += compute_wssr_gradient_for(data, grad);
+    update_best_wssr(wssr, A);
     return wssr;
 }
 
@@ -363,16 +562,16 @@ realt Fit::draw_a_from_distribution(int gpos, char distribution, realt mult)
     realt dv = 0;
     switch (distribution) {
         case 'g':
-            dv = rand_gauss();
+            dv = F_->rng().rand_gauss();
             break;
         case 'l':
-            dv = rand_cauchy();
+            dv = F_->rng().rand_cauchy();
             break;
         case 'b':
-            dv = rand_bool() ? -1 : 1;
+            dv = F_->rng().rand_bool() ? -1 : 1;
             break;
         default: // 'u' - uniform
-            dv = rand_1_1();
+            dv = F_->rng().rand_1_1();
             break;
     }
     return F_->mgr.variation_of_a(gpos, dv * mult);
@@ -392,33 +591,55 @@ void Fit::fit(int max_eval, const vector<Data*>& datas)
 {
     // initialization
     start_time_ = clock();
+    wall_start_ = wall_time();
     last_refresh_time_ = time(0);
     ComputeUI compute_ui(F_->ui());
     update_par_usage(datas);
     fitted_datas_ = datas;
     a_orig_ = F_->mgr.parameters();
+    trace_.reset(open_trace());
+    trace_iter_ = 0;
+    best_a_.clear();
+    last_traced_a_ = a_orig_;
     F_->fit_manager()->push_param_history(a_orig_);
     evaluations_ = 0;
-    fityk::user_interrupt = 0;
+    interrupt_mark_ = fityk::user_interrupt;
     max_eval_ = (max_eval > 0 ? max_eval
                               : F_->get_settings()->max_wssr_evaluations);
     int nu = count(par_usage_.begin(), par_usage_.end(), true);
     F_->msg("Fitting " + S(nu) + " (of " + S(na_) + ") parameters to "
             + S(count_points(datas)) + " points ...");
-    initial_wssr_ = compute_wssr(a_orig_, fitted_datas_);
-    best_shown_wssr_ = initial_wssr_;
+    lambda_ = 0;
+    best_wssr_ = HUGE_VAL;
     const SettingsMgr *sm = F_->settings_mgr();
-    if (F_->get_verbosity() >= 1)
-        F_->ui()->mesg("Method: " + name + ". Initial WSSR="
-                       + sm->format_double(initial_wssr_));
-
-    // here the work is done
     vector<realt> best_a;
-    realt wssr = run_method(&best_a);
+    realt wssr;
+    try {
+        initial_wssr_ = compute_wssr(a_orig_, fitted_datas_);
+        best_shown_wssr_ = initial_wssr_;
+        if (F_->get_verbosity() >= 1)
+            F_->ui()->mesg("Method: " + name + ". Initial WSSR="
+                           + sm->format_double(initial_wssr_));
+
+        // here the work is done
+        int levels = F_->get_settings()->fit_coarse_levels;
+        wssr = levels > 0 ? run_coarse_to_fine(levels, &best_a)
+                          : run_method(&best_a);
+    } catch (...) {
+        trace_.reset(); // don't keep the file open until the next fit
+        throw;
+    }
 
     // finalization
     F_->msg(name + ": " + S(evaluations_) + " evaluations, "
             + format1<double,16>("%.2f", elapsed()) + " s. of CPU time.");
+    last_result_ = FitResult();
+    last_result_.cancelled = (cancel_ != NULL && *cancel_);
+    last_result_.initial_wssr = initial_wssr_;
+    last_result_.wssr = min(wssr, initial_wssr_);
+    last_result_.evaluations = evaluations_;
+    last_result_.elapsed = elapsed();
+    trace_.reset(); // waits until all records are written
     if (wssr < initial_wssr_) {
         F_->fit_manager()->push_param_history(best_a);
         F_->mgr.put_new_parameters(best_a);
@@ -435,6 +656,116 @@ void Fit::fit(int max_eval, const vector<Data*>& datas)
     }
 }
 
+// Returns a new dataset with active points of data averaged in groups of
+// bin_size points. Sigma of the mean is sqrt(sum of sigma^2)/n.
+// The model of the new dataset refers to the same functions as data->model().
+static Data* make_binned_data(Full* F, const Data* data, int bin_size)
+{
+    Model *model = F->mgr.create_model();
+    model->get_ff() = data->model()->get_ff();
+    model->get_zz() = data->model()->get_zz();
+    Data *binned = new Data(F, model);
+    const vector<Point>& points = data->points();
+    vector<Point> pp;
+    pp.reserve(data->get_n() / bin_size + 1);
+    realt sx = 0, sy = 0, ss = 0;
+    int k = 0;
+    for (size_t i = 0; i <= points.size(); ++i) {
+        bool active = i < points.size() && points[i].is_active;
+        if (active) {
+            const Point& p = points[i];
+            sx += p.x;
+            sy += p.y;
+            ss += p.sigma * p.sigma;
+            ++k;
+        }
+        // a bin ends at the end of each range of active points,
+        // so it never spans an excluded region
+        if (k != 0 && (k == bin_size || !active)) {
+            pp.push_back(Point(sx / k, sy / k, sqrt(ss) / k));
+            sx = sy = ss = 0;
+            k = 0;
+        }
+    }
+    binned->set_points(pp);
+    return binned;
+}
+
+// Coarse-to-fine fitting. Level L fits data binned by 4^L points,
+// starting from the parameters found at level L+1. Each level is a complete
+// run of the fitting method, with its own termination criteria, but all
+// levels share the limit of evaluations (max_eval_).
+// Levels that would have too few points are skipped.
+realt Fit::run_coarse_to_fine(int levels, vector<realt>* best_a)
+{
+    const vector<Data*> datas = fitted_datas_;
+    const vector<realt> a_start = a_orig_;
+    const realt wssr_start = initial_wssr_;
+    const SettingsMgr *sm = F_->settings_mgr();
+    int nu = count(par_usage_.begin(), par_usage_.end(), true);
+    const int max_eval = max_eval_;
+    int total_eval = 0;
+    // sets max_eval_ to the evaluations left, keeping `reserved' for later,
+    // returns false if none left (1 is not enough, some methods need one
+    // evaluation at the end)
+    auto limit_evaluations = [&](int reserved) {
+        if (max_eval <= 0)
+            return true;
+        max_eval_ = max_eval - total_eval - reserved;
+        return max_eval_ > 1;
+    };
+    for (int level = levels; level > 0; --level) {
+        int bin_size = 1 << (2 * level);
+        vector<unique_ptr<Data>> storage;
+        vector<Data*> binned;
+        for (const Data* data : datas) {
+            storage.push_back(unique_ptr<Data>(
+                                    make_binned_data(F_, data, bin_size)));
+            binned.push_back(storage.back().get());
+        }
+        int np = count_points(binned);
+        if (np < 4 * nu || np == count_points(datas))
+            continue;
+        // one evaluation is left for the initial WSSR of level 0
+        if (!limit_evaluations(1))
+            break;
+        fitted_datas_ = binned;
+        evaluations_ = 0;
+        best_wssr_ = HUGE_VAL;
+        initial_wssr_ = compute_wssr(a_orig_, fitted_datas_);
+        best_shown_wssr_ = initial_wssr_;
+        F_->msg("Level " + S(level) + ": " + S(np) + " points, WSSR="
+                + sm->format_double(initial_wssr_));
+        realt wssr = run_method(best_a);
+        total_eval += evaluations_;
+        if (wssr < initial_wssr_)
+            a_orig_ = *best_a;
+        if (stop_requested())
+            break;
+    }
+
+    // the original resolution
+    fitted_datas_ = datas;
+    evaluations_ = 0;
+    best_wssr_ = HUGE_VAL;
+    initial_wssr_ = compute_wssr(a_orig_, fitted_datas_);
+    best_shown_wssr_ = initial_wssr_;
+    realt wssr;
+    if (stop_requested() || !limit_evaluations(0)) {
+        *best_a = a_orig_;
+        wssr = initial_wssr_;
+    } else {
+        F_->msg("Level 0: " + S(count_points(datas)) + " points, WSSR="
+                + sm->format_double(initial_wssr_));
+        wssr = run_method(best_a);
+    }
+    evaluations_ += total_eval;
+    max_eval_ = max_eval;
+    a_orig_ = a_start;
+    initial_wssr_ = wssr_start;
+    return wssr;
+}
+
 // sets na_ and par_usage_ based on F_->mgr and datas
 void Fit::update_par_usage(const vector<Data*>& datas)
 {
@@ -446,27 +777,41 @@ void Fit::update_par_usage(const vector<Data*>& datas)
     na_ = F_->mgr.parameters().size();
 
     par_usage_ = vector<bool>(na_, false);
-    for (int idx = 0; idx < na_; ++idx) {
-        int var_idx = F_->mgr.gpos_to_vpos(idx);
-        for (const Data* data : datas) {
-            if (data->model()->is_dependent_on_var(var_idx)) {
-                par_usage_[idx] = true;
-                break; //go to next idx
-            }
-        }
+    const vector<Variable*>& variables = F_->mgr.variables();
+    for (const Data* data : datas) {
+        vector<bool> mask = data->model()->var_dependency_mask();
+        for (size_t i = 0; i != variables.size(); ++i)
+            if (mask[i] && variables[i]->gpos() >= 0)
+                par_usage_[variables[i]->gpos()] = true;
     }
     if (count(par_usage_.begin(), par_usage_.end(), true) == 0)
         throw ExecuteError("No parametrized functions are used in the model.");
 }
 
+bool Fit::stop_requested() const
+{
+    return fityk::user_interrupt != interrupt_mark_ ||
+           (cancel_ != NULL && *cancel_);
+}
+
 /// checks termination criteria common for all fitting methods
-bool Fit::common_termination_criteria() const
+bool Fit::common_termination_criteria()
 {
     bool stop = false;
-    if (fityk::user_interrupt) {
+    if (fityk::user_interrupt != interrupt_mark_) {
         F_->msg ("Fitting stopped manually.");
         stop = true;
     }
+    if (cancel_ != NULL && *cancel_) {
+        F_->msg ("Fitting cancelled.");
+        stop = true;
+    }
+    if (progress_callback_ != NULL) {
+        FitProgress p = { evaluations_, best_wssr_, lambda_, elapsed() };
+        (*progress_callback_)(p, progress_data_);
+    }
+    if (trace_)
+        trace_iteration();
     double max_time = F_->get_settings()->max_fitting_time;
     if (max_time > 0 && elapsed() >= max_time) {
         F_->msg("Maximum processor time exceeded.");
@@ -606,6 +951,43 @@ double FitManager::get_standard_error(const Variable* var) const
     return errors_cache_[var->gpos()];
 }
 
+size_t ParameterHistoryMgr::HistoryItem::bytes() const
+{
+    return sizeof(HistoryItem) + values.capacity() * sizeof(realt)
+           + changes.capacity() * sizeof(changes[0]);
+}
+
+vector<realt> ParameterHistoryMgr::get_item(int n) const
+{
+    int k = n;
+    while (!param_history_[k].keyframe)
+        --k;
+    vector<realt> aa = param_history_[k].values;
+    for (++k; k <= n; ++k) {
+        const vector<pair<int,realt> >& changes = param_history_[k].changes;
+        for (vector<pair<int,realt> >::const_iterator i = changes.begin();
+                                                    i != changes.end(); ++i)
+            aa[i->first] = i->second;
+    }
+    return aa;
+}
+
+bool ParameterHistoryMgr::item_equals(int n, const vector<realt>& aa) const
+{
+    if (n == get_param_history_size() - 1)
+        return last_ == aa;
+    return get_item(n) == aa;
+}
+
+void ParameterHistoryMgr::clear_param_history()
+{
+    param_history_.clear();
+    param_hist_ptr_ = 0;
+    last_.clear();
+    since_keyframe_ = 0;
+    bytes_ = 0;
+}
+
 /// loads vector of parameters from the history
 /// "relative" is used for undo/redo commands
 /// if history is not empty and current parameters are different from
@@ -615,36 +997,83 @@ double FitManager::get_standard_error(const Variable* var) const
 void ParameterHistoryMgr::load_param_history(int item_nr, bool relative)
 {
     if (item_nr == -1 && relative && !param_history_.empty() && //undo
-            param_history_[param_hist_ptr_] != F_->mgr.parameters())
+            !item_equals(param_hist_ptr_, F_->mgr.parameters()))
         item_nr = 0; // load parameters from param_hist_ptr_
     if (relative)
         item_nr += param_hist_ptr_;
     else if (item_nr < 0)
         item_nr += param_history_.size();
-    if (item_nr < 0 || item_nr >= size(param_history_))
+    if (item_nr < 0 || item_nr >= get_param_history_size())
         throw ExecuteError("There is no parameter history item #"
                             + S(item_nr) + ".");
-    F_->mgr.put_new_parameters(param_history_[item_nr]);
+    F_->mgr.put_new_parameters(get_item(item_nr));
     param_hist_ptr_ = item_nr;
 }
 
 bool ParameterHistoryMgr::can_undo() const
 {
     return !param_history_.empty()
-        && (param_hist_ptr_ > 0 || param_history_[0] != F_->mgr.parameters());
+        && (param_hist_ptr_ > 0 || !item_equals(0, F_->mgr.parameters()));
 }
 
 bool ParameterHistoryMgr::push_param_history(const vector<realt>& aa)
 {
     param_hist_ptr_ = param_history_.size() - 1;
-    if (param_history_.empty() || param_history_.back() != aa) {
-        param_history_.push_back(aa);
-        ++param_hist_ptr_;
-        return true;
-    } else
+    if (!param_history_.empty() && last_ == aa)
         return false;
+    HistoryItem item;
+    item.keyframe = true;
+    if (!param_history_.empty() && last_.size() == aa.size()
+            && since_keyframe_ < kKeyframeInterval) {
+        for (size_t i = 0; i != aa.size(); ++i)
+            if (aa[i] != last_[i])
+                item.changes.push_back(make_pair((int) i, aa[i]));
+        // a delta bigger than a full copy is not worth it
+        if (2 * item.changes.size() <= aa.size())
+            item.keyframe = false;
+        else
+            vector<pair<int,realt> >().swap(item.changes);
+    }
+    if (item.keyframe) {
+        item.values = aa;
+        since_keyframe_ = 0;
+    } else
+        ++since_keyframe_;
+    bytes_ += item.bytes();
+    param_history_.push_back(item);
+    last_ = aa;
+    ++param_hist_ptr_;
+    evict_old_items();
+    return true;
 }
 
+// removes the oldest items while the history takes more memory than allowed;
+// the last item is always kept
+void ParameterHistoryMgr::evict_old_items()
+{
+    double max_mb = F_->get_settings()->max_history_memory;
+    if (max_mb <= 0)
+        return;
+    size_t max_bytes = (size_t) (max_mb * 1024 * 1024);
+    while (bytes_ > max_bytes && param_history_.size() > 1) {
+        HistoryItem& second = param_history_[1];
+        if (!second.keyframe) {
+            // the item that becomes the first one must be a keyframe
+            vector<realt> aa = get_item(1);
+            bytes_ -= second.bytes();
+            second.keyframe = true;
+            second.values.swap(aa);
+            vector<pair<int,realt> >().swap(second.changes);
+            bytes_ += second.bytes();
+            since_keyframe_ = min(since_keyframe_,
+                                  (int) param_history_.size() - 2);
+        }
+        bytes_ -= param_history_.front().bytes();
+        param_history_.pop_front();
+        if (param_hist_ptr_ > 0)
+            --param_hist_ptr_;
+    }
+}
 
 string ParameterHistoryMgr::param_history_info() const
 {
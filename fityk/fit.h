@@ -4,8 +4,12 @@
 #ifndef FITYK_FIT_H_
 #define FITYK_FIT_H_
 #include <vector>
+#include <deque>
+#include <memory>
 #include <string>
+#include <utility>
 #include <time.h>
+#include <atomic>
 #include "common.h"
 
 namespace fityk {
@@ -13,6 +17,7 @@ namespace fityk {
 class Data;
 class Full;
 class Variable;
+class FitTraceWriter;
 
 int count_points(const std::vector<Data*>& datas);
 
@@ -23,7 +28,7 @@ public:
     const std::string name;
 
     Fit(Full *F, const std::string& m);
-    virtual ~Fit() {}
+    virtual ~Fit();
     void fit(int max_iter, const std::vector<Data*>& datas);
     std::string get_goodness_info(const std::vector<Data*>& datas);
     int get_dof(const std::vector<Data*>& datas);
@@ -53,12 +58,18 @@ public:
     realt compute_r_squared(const std::vector<realt> &A,
                            const std::vector<Data*>& datas);
     bool is_param_used(int n) const { return par_usage_[n]; }
+    // used by Fityk::start_fit(): callback called in each iteration
+    // and a flag that stops fitting (any of them can be NULL)
+    void set_observer(t_fit_progress_callback *callback, void *user_data,
+                      const std::atomic<bool> *cancel);
+    const FitResult& last_result() const { return last_result_; }
 protected:
     Full *F_;
     std::vector<Data*> fitted_datas_;
     int evaluations_; // zeroed in fit() initialization, ++'ed in other places
     realt initial_wssr_; // set (only) at the beginning of fit()
     std::vector<realt> a_orig_;
+    realt lambda_; // reported in FitProgress, set only by LMfit
     int na_; ///number of fitted parameters, equal to par_usage_.size()
     // getters, see the comments below for the variables
     int max_eval() const { return max_eval_; }
@@ -66,7 +77,9 @@ protected:
 
     virtual double run_method(std::vector<realt>* best_a) = 0;
     std::string iteration_info(realt wssr); // changes best_shown_wssr_
-    bool common_termination_criteria() const;
+    // also calls the progress callback and writes the fit trace,
+    // should be called once per iteration
+    bool common_termination_criteria();
     void compute_derivatives(const std::vector<realt> &A,
                           const std::vector<Data*>& datas,
                           std::vector<realt>& alpha, std::vector<realt>& beta);
@@ -83,10 +96,28 @@ private:
     int max_eval_; // it is set before calling run_method()
     time_t last_refresh_time_;
     clock_t start_time_;
+    int interrupt_mark_; // value of user_interrupt at the start of fit()
     std::vector<bool> par_usage_;
     realt best_shown_wssr_; // for iteration_info()
+    realt best_wssr_; // the lowest WSSR computed since the start of fit()
+    t_fit_progress_callback *progress_callback_;
+    void *progress_data_;
+    const std::atomic<bool> *cancel_;
+    FitResult last_result_;
+    // fit trace (option fit_trace), set only during fit()
+    std::unique_ptr<FitTraceWriter> trace_;
+    int trace_iter_;
+    double wall_start_;
+    std::vector<realt> best_a_; // parameters with best_wssr_, only if trace_
+    std::vector<realt> last_traced_a_;
 
     double elapsed() const; // CPU time elapsed since the start of fit()
+    void update_best_wssr(realt wssr, const std::vector<realt>& A);
+    FitTraceWriter* open_trace();
+    void trace_iteration();
+    bool stop_requested() const; // interrupted or cancelled
+    // fits binned copies of fitted_datas_ before fitting the original data
+    realt run_coarse_to_fine(int levels, std::vector<realt>* best_a);
 
     // compute_*_for() does the same as compute_*() but for one dataset
     void compute_derivatives_for(const Data *data,
@@ -98,25 +129,49 @@ private:
 };
 
 /// handles parameter history
+/// Items are stored as sparse changes relative to the previous item,
+/// with a full copy (keyframe) every kKeyframeInterval items or when
+/// the number of parameters changes. When the history takes more memory
+/// than the max_history_memory option allows, the oldest items are removed.
 class FITYK_API ParameterHistoryMgr
 {
 public:
-    ParameterHistoryMgr(Full *F) : F_(F), param_hist_ptr_(0) {}
+    ParameterHistoryMgr(Full *F) : F_(F), param_hist_ptr_(0),
+                                   since_keyframe_(0), bytes_(0) {}
     bool push_param_history(const std::vector<realt>& aa);
-    void clear_param_history() { param_history_.clear(); param_hist_ptr_ = 0; }
+    void clear_param_history();
     int get_param_history_size() const { return param_history_.size(); }
     void load_param_history(int item_nr, bool relative);
     bool has_param_history_rel_item(int rel_nr) const
-        { return is_index(param_hist_ptr_ + rel_nr, param_history_); }
+        { int n = param_hist_ptr_ + rel_nr;
+          return n >= 0 && n < (int) param_history_.size(); }
     bool can_undo() const;
     std::string param_history_info() const;
-    const std::vector<realt>& get_item(int n) const {return param_history_[n];}
+    // reconstructs n-th item from the nearest preceding keyframe
+    std::vector<realt> get_item(int n) const;
     int get_active_nr() const { return param_hist_ptr_; }
+    // approximate memory (in bytes) taken by the history
+    size_t memory_usage() const { return bytes_; }
 protected:
     Full *F_;
 private:
-    std::vector<std::vector<realt> > param_history_; /// old parameter vectors
+    static const int kKeyframeInterval = 16;
+    struct HistoryItem
+    {
+        bool keyframe;
+        std::vector<realt> values; // all parameters, only in keyframes
+        // (index, new value) pairs, changes since the previous item
+        std::vector<std::pair<int,realt> > changes;
+        size_t bytes() const;
+    };
+    std::deque<HistoryItem> param_history_; /// old parameter vectors
     int param_hist_ptr_; /// points to the current/last parameter vector
+    std::vector<realt> last_; /// full copy of the last item
+    int since_keyframe_; /// number of delta items after the last keyframe
+    size_t bytes_; /// sum of bytes() of all items
+
+    bool item_equals(int n, const std::vector<realt>& aa) const;
+    void evict_old_items();
 };
 
 /// gives access to fitting methods, enables swithing between them
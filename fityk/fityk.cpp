@@ -9,6 +9,9 @@
 
 #include <cassert>
 #include <cstring>
+#include <atomic>
+#include <memory>
+#include <thread>
 
 #include "common.h"
 #include "ui.h"
@@ -36,18 +39,9 @@ using namespace std;
             throw; \
     }
 
-// not thread-safe, but let's keep it simple
-static FILE* message_sink_ = NULL;
-
 namespace {
 using namespace fityk;
 
-void write_message_to_file(UserInterface::Style style, string const& s)
-{
-    if (message_sink_ && style != UserInterface::kInput)
-        fprintf(message_sink_, "%s\n", s.c_str());
-}
-
 realt get_wssr_or_ssr(const Full* priv, int dataset, bool weigthed)
 {
     if (dataset == ALL_DATASETS) {
@@ -103,6 +97,7 @@ struct FitykInternalData
 {
     bool owns;
     UiApi::t_show_message_callback* old_message_callback;
+    vector<realt> bufx, bufy; // reused in get_model_values()
 };
 
 
@@ -187,6 +182,57 @@ const vector<realt>& Fityk::all_parameters() const
     return priv_->mgr.parameters();
 }
 
+realt Fityk::get_parameter(int n) const  throw(ExecuteError)
+{
+    try {
+        if (!is_index(n, priv_->mgr.parameters()))
+            throw ExecuteError("wrong parameter index: " + S(n));
+        return priv_->mgr.parameters()[n];
+    }
+    CATCH_EXECUTE_ERROR
+    return 0.;
+}
+
+void Fityk::set_parameter(int n, realt value)  throw(ExecuteError)
+{
+    try {
+        if (!is_index(n, priv_->mgr.parameters()))
+            throw ExecuteError("wrong parameter index: " + S(n));
+        priv_->mgr.put_new_parameter(n, value);
+        priv_->outdated_plot();
+    }
+    CATCH_EXECUTE_ERROR
+}
+
+void Fityk::set_parameters(const vector<realt>& values)  throw(ExecuteError)
+{
+    set_parameters(values.data(), size(values));
+}
+
+void Fityk::set_parameters(const realt* values, int num)  throw(ExecuteError)
+{
+    try {
+        if (num != size(priv_->mgr.parameters()))
+            throw ExecuteError("set_parameters(): got " + S(num) + " values, "
+                       "expected " + S(priv_->mgr.parameters().size()));
+        priv_->mgr.put_new_parameters(values, num);
+        priv_->outdated_plot();
+    }
+    CATCH_EXECUTE_ERROR
+}
+
+void Fityk::get_parameters(realt* out, int num) const  throw(ExecuteError)
+{
+    try {
+        const vector<realt>& pp = priv_->mgr.parameters();
+        if (num != size(pp))
+            throw ExecuteError("get_parameters(): " + S(num) + " values "
+                               "requested, there are " + S(pp.size()));
+        copy(pp.begin(), pp.end(), out);
+    }
+    CATCH_EXECUTE_ERROR
+}
+
 vector<Var*> Fityk::all_variables() const
 {
     const vector<Variable*>& variables = priv_->mgr.variables();
@@ -241,6 +287,51 @@ vector<realt> Fityk::get_model_vector(vector<realt> const& x, int dataset)
     return yy;
 }
 
+void Fityk::get_model_values(int dataset, const realt* x, realt* y, int num)
+                                                          throw(ExecuteError)
+{
+    try {
+        const Model* model = priv_->dk.get_model(hd(priv_, dataset));
+        p_->bufx.assign(x, x + num);
+        p_->bufy.assign(num, 0.);
+        model->compute_model(p_->bufx, p_->bufy);
+        copy(p_->bufy.begin(), p_->bufy.end(), y);
+    }
+    CATCH_EXECUTE_ERROR
+}
+
+void Fityk::get_data_column(int dataset, char column, realt* out, int num)
+                                                          throw(ExecuteError)
+{
+    try {
+        const vector<Point>& pp = priv_->dk.data(hd(priv_, dataset))->points();
+        if (num != size(pp))
+            throw ExecuteError("get_data_column(): " + S(num) + " values "
+                               "requested, dataset has " + S(pp.size()));
+        switch (column) {
+            case 'x':
+                for (int i = 0; i != num; ++i)
+                    out[i] = pp[i].x;
+                break;
+            case 'y':
+                for (int i = 0; i != num; ++i)
+                    out[i] = pp[i].y;
+                break;
+            case 's':
+                for (int i = 0; i != num; ++i)
+                    out[i] = pp[i].sigma;
+                break;
+            case 'a':
+                for (int i = 0; i != num; ++i)
+                    out[i] = pp[i].is_active ? 1. : 0.;
+                break;
+            default:
+                throw ExecuteError(S("wrong column: ") + column);
+        }
+    }
+    CATCH_EXECUTE_ERROR
+}
+
 const Var* Fityk::get_variable(string const& name) const  throw(ExecuteError)
 {
     try {
@@ -298,6 +389,16 @@ void Fityk::load_data(int dataset,
     CATCH_EXECUTE_ERROR
 }
 
+void Fityk::load_data(int dataset,
+                      const realt* x, const realt* y, const realt* sigma,
+                      int num, string const& title)     throw(ExecuteError)
+{
+    try {
+        priv_->dk.data(dataset)->load_arrays(x, y, sigma, num, title);
+    }
+    CATCH_EXECUTE_ERROR
+}
+
 void Fityk::add_point(realt x, realt y, realt sigma, int dataset)
                                                           throw(ExecuteError)
 {
@@ -307,6 +408,115 @@ void Fityk::add_point(realt x, realt y, realt sigma, int dataset)
     CATCH_EXECUTE_ERROR
 }
 
+void Fityk::add_points(vector<realt> const& x,
+                       vector<realt> const& y,
+                       vector<realt> const& sigma,
+                       int dataset, int max_eval)   throw(ExecuteError)
+{
+    try {
+        if (x.size() != y.size() ||
+                (!sigma.empty() && x.size() != sigma.size()))
+            throw ExecuteError("add_points: arrays of different lengths");
+        add_points(x.data(), y.data(), sigma.empty() ? NULL : sigma.data(),
+                   x.size(), dataset, max_eval);
+    }
+    CATCH_EXECUTE_ERROR
+}
+
+void Fityk::add_points(const realt* x, const realt* y, const realt* sigma,
+                       int num, int dataset, int max_eval)  throw(ExecuteError)
+{
+    try {
+        Data* data = priv_->dk.data(hd(priv_, dataset));
+        data->add_points(x, y, sigma, num);
+        if (max_eval > 0) {
+            priv_->get_fit()->fit(max_eval, vector1(data));
+            priv_->outdated_plot();
+        }
+    }
+    CATCH_EXECUTE_ERROR
+}
+
+struct FitJobData
+{
+    std::thread thread;
+    std::atomic<bool> cancel_flag;
+    std::atomic<bool> done;
+    FitResult result;
+};
+
+FitJob::~FitJob()
+{
+    cancel();
+    wait();
+    delete d_;
+}
+
+void FitJob::cancel()
+{
+    d_->cancel_flag = true;
+}
+
+void FitJob::wait()
+{
+    if (d_->thread.joinable())
+        d_->thread.join();
+}
+
+bool FitJob::is_done() const
+{
+    return d_->done;
+}
+
+const FitResult& FitJob::result()
+{
+    wait();
+    return d_->result;
+}
+
+static void run_fit_job(Full* F, Fit* fit, vector<Data*> datas, int max_eval,
+                        t_fit_progress_callback *callback, void *user_data,
+                        FitJobData *d)
+{
+    fit->set_observer(callback, user_data, &d->cancel_flag);
+    try {
+        fit->fit(max_eval, datas);
+        d->result = fit->last_result();
+        F->outdated_plot();
+    } catch (const std::exception& e) {
+        d->result.error = e.what();
+    }
+    fit->set_observer(NULL, NULL, NULL);
+    d->done = true;
+}
+
+void Fityk::set_fit_trace_callback(t_fit_trace_callback *func,
+                                   void *user_data)
+{
+    priv_->set_fit_trace_callback(func, user_data);
+}
+
+FitJob* Fityk::start_fit(int max_eval, int dataset,
+                         t_fit_progress_callback *callback, void *user_data)
+                                                          throw(ExecuteError)
+{
+    try {
+        vector<Data*> datas;
+        if (dataset == ALL_DATASETS)
+            datas = priv_->dk.datas();
+        else
+            datas.push_back(priv_->dk.data(hd(priv_, dataset)));
+        unique_ptr<FitJobData> d(new FitJobData);
+        d->cancel_flag = false;
+        d->done = false;
+        d->thread = std::thread(run_fit_job, priv_, priv_->get_fit(), datas,
+                                max_eval, callback, user_data, d.get());
+        return new FitJob(d.release());
+    }
+    CATCH_EXECUTE_ERROR
+    return NULL;
+}
+
 vector<Point> const& Fityk::get_data(int dataset)  throw(ExecuteError)
 {
     static const vector<Point> empty;
@@ -322,8 +532,8 @@ void Fityk::redir_messages(FILE *stream)
 {
     if (stream) {
         UiApi::t_show_message_callback* old
-          = priv_->ui()->connect_show_message(write_message_to_file);
-        if (old != write_message_to_file)
+          = priv_->ui()->connect_show_message(NULL);
+        if (old != NULL)
             p_->old_message_callback = old;
     } else {
         // note: if redir_messages() is used for the first time,
@@ -331,7 +541,7 @@ void Fityk::redir_messages(FILE *stream)
         p_->old_message_callback =
             priv_->ui()->connect_show_message(p_->old_message_callback);
     }
-    message_sink_ = stream;
+    priv_->ui()->set_message_sink(stream);
 }
 
 void Fityk::set_option_as_string(const string& opt, const string& val)
@@ -489,8 +699,14 @@ void fityk_load_data(Fityk *f, int dataset,
                      double *x, double *y, double *sigma, int num,
                      const char* title)
 {
-    f->load_data(dataset, vector<realt>(x, x+num), vector<realt>(y, y+num),
-                 vector<realt>(sigma, sigma+num), title);
+    f->load_data(dataset, x, y, sigma, num, title ? title : "");
+}
+
+void fityk_add_points(Fityk *f, int dataset,
+                      double *x, double *y, double *sigma, int num,
+                      int max_eval)
+{
+    f->add_points(x, y, sigma, num, dataset, max_eval);
 }
 
 const char* fityk_last_error(const Fityk *f)
@@ -528,6 +744,26 @@ int fityk_get_parameter_count(const Fityk* f)
     return f->get_parameter_count();
 }
 
+realt fityk_get_parameter(const Fityk* f, int n)
+{
+    return f->get_parameter(n);
+}
+
+void fityk_set_parameter(Fityk* f, int n, realt value)
+{
+    f->set_parameter(n, value);
+}
+
+void fityk_get_parameters(const Fityk* f, realt* out, int num)
+{
+    f->get_parameters(out, num);
+}
+
+void fityk_set_parameters(Fityk* f, const realt* values, int num)
+{
+    f->set_parameters(values, num);
+}
+
 const Var* fityk_get_variable(const Fityk* f, const char* name)
 {
     return f->get_variable(name);
@@ -552,6 +788,18 @@ realt fityk_get_model_value(Fityk *f, realt x, int dataset)
     return f->get_model_value(x, dataset);
 }
 
+void fityk_get_model_values(Fityk *f, int dataset,
+                            const realt* x, realt* y, int num)
+{
+    f->get_model_values(dataset, x, y, num);
+}
+
+void fityk_get_data_column(Fityk *f, int dataset, char column,
+                           realt* out, int num)
+{
+    f->get_data_column(dataset, column, out, num);
+}
+
 realt fityk_get_wssr(Fityk *f, int dataset) { return f->get_wssr(dataset); }
 realt fityk_get_ssr(Fityk *f, int dataset) { return f->get_ssr(dataset); }
 realt fityk_get_rsquared(Fityk *f, int dataset)
@@ -578,4 +826,9 @@ realt fityk_value_at(const Func *func, realt x)
     return func->value_at(x);
 }
 
+void fityk_values_at(const Func *func, const realt* x, realt* y, int num)
+{
+    func->values_at(x, y, num);
+}
+
 } // extern "C"
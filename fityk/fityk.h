@@ -125,6 +125,8 @@ public:
     virtual realt get_param_value(const std::string& param) const
                                                     throw(ExecuteError) = 0;
     virtual realt value_at(realt x) const = 0;
+    /// multiple point version of value_at(), writes num values to y
+    virtual void values_at(const realt* x, realt* y, int num) const = 0;
 protected:
     Func(const std::string name_) : name(name_) {}
 };
@@ -166,6 +168,59 @@ struct FITYK_API LoadSpec
 };
 
 
+/// state of fitting, passed to the callback given to Fityk::start_fit()
+struct FITYK_API FitProgress
+{
+    int evaluations;  /// number of WSSR evaluations so far
+    realt wssr;       /// the lowest WSSR found so far
+    realt lambda;     /// current lambda in Levenberg-Marquardt, 0 otherwise
+    double elapsed;   /// CPU time (in seconds) since the start of fitting
+};
+
+/// outcome of fitting started with Fityk::start_fit()
+struct FITYK_API FitResult
+{
+    bool cancelled;   /// stopped by FitJob::cancel()
+    realt initial_wssr;
+    realt wssr;       /// WSSR for the parameters after fitting
+    int evaluations;
+    double elapsed;
+    std::string error; /// error message if fitting failed, empty otherwise
+    FitResult() : cancelled(false), initial_wssr(0), wssr(0),
+                  evaluations(0), elapsed(0) {}
+};
+
+typedef void t_fit_progress_callback(const FitProgress& p, void *user_data);
+
+/// receives fit trace: one JSON object (without newline) per iteration,
+/// see Fityk::set_fit_trace_callback()
+typedef void t_fit_trace_callback(const char* json, void *user_data);
+
+struct FitJobData;
+
+/// fitting running in a background thread, see Fityk::start_fit().
+/// Deleting the job cancels fitting and waits for the thread to finish.
+class FITYK_API FitJob
+{
+public:
+    ~FitJob();
+    /// ask the fitting method to stop after the current iteration
+    void cancel();
+    /// block until fitting is finished
+    void wait();
+    /// true if fitting is finished (wait() would not block)
+    bool is_done() const;
+    /// wait() and return the outcome of fitting
+    const FitResult& result();
+private:
+    FitJobData *d_;
+    explicit FitJob(FitJobData *d) : d_(d) {}
+    friend class Fityk;
+    // disallow copy and assign
+    FitJob(const FitJob&);
+    void operator=(const FitJob&);
+};
+
 /// the public API to libfityk
 class FITYK_API Fityk
 {
@@ -196,10 +251,49 @@ public:
                    std::vector<realt> const& sigma,
                    std::string const& title="")  throw(ExecuteError);
 
+    /// load data from C arrays (sigma can be NULL), without temporary copies
+    void load_data(int dataset,
+                   const realt* x, const realt* y, const realt* sigma, int num,
+                   std::string const& title="")  throw(ExecuteError);
+
     /// add one data point to dataset
     void add_point(realt x, realt y, realt sigma, int dataset=DEFAULT_DATASET)
                                                      throw(ExecuteError);
 
+    /// add many data points to dataset in one call (x doesn't need to be
+    /// sorted, but appending sorted points is the fastest).
+    /// If sigma is empty, it is set according to option default_sigma.
+    /// If max_eval > 0, it is followed by fitting the dataset with
+    /// not more than max_eval evaluations (useful for live data).
+    void add_points(std::vector<realt> const& x,
+                    std::vector<realt> const& y,
+                    std::vector<realt> const& sigma,
+                    int dataset=DEFAULT_DATASET, int max_eval=0)
+                                                     throw(ExecuteError);
+
+    /// add_points() for C arrays (sigma can be NULL), without temporary copies
+    void add_points(const realt* x, const realt* y, const realt* sigma,
+                    int num, int dataset=DEFAULT_DATASET, int max_eval=0)
+                                                     throw(ExecuteError);
+
+    /// Start fitting in a background thread and return immediately.
+    /// Fits dataset (or all datasets together if dataset=ALL_DATASETS)
+    /// with the current fitting method, max_eval=0 means the value of
+    /// option max_wssr_evaluations. If callback is not NULL, it is called
+    /// from the background thread in each iteration.
+    /// This Fityk object must not be used until the job is done.
+    /// The caller owns the returned job.
+    FitJob* start_fit(int max_eval=0, int dataset=DEFAULT_DATASET,
+                      t_fit_progress_callback *callback=NULL,
+                      void *user_data=NULL)  throw(ExecuteError);
+
+    /// Sets callback that gets the same JSON records that are written
+    /// to the file given in the option fit_trace (the option and the callback
+    /// can be used together). The callback is called from a separate thread,
+    /// the fitting doesn't wait for it. All records of one fit are delivered
+    /// before the fit returns. NULL disables the callback.
+    void set_fit_trace_callback(t_fit_trace_callback *func, void *user_data);
+
     // @}
 
     /// @name (alternative to exceptions) handling of program errors
@@ -238,7 +332,6 @@ public:
     /// redirect output to file or stdout/stderr; called with NULL reverts
     /// previous call(s).
     /// Internally uses UiApi::set_show_message().
-    /// Bugs: can't be used with more than one Fityk instance at the same time.
     void redir_messages(std::FILE *stream);
 
     /// print string in the output of GUI/CLI (useful for embedded Lua)
@@ -274,7 +367,10 @@ public:
     /// returns dataset set by the "use" command
     int get_default_dataset() const;
 
-    /// get data points
+    /// get data points; the reference is valid only until the next command
+    /// is executed: the command can change the dataset or, if option
+    /// max_data_memory is set, move it to a temporary file (the vector
+    /// is then empty). Copy the points if they are needed longer.
     std::vector<Point> const& get_data(int dataset=DEFAULT_DATASET)
                                                          throw(ExecuteError);
 
@@ -284,6 +380,22 @@ public:
     /// returns global array of parameters (values of simple-variables)
     const std::vector<realt>& all_parameters() const;
 
+    /// returns value of parameter n (n is Var::gpos() of simple-variable)
+    realt get_parameter(int n) const  throw(ExecuteError);
+
+    /// set value of parameter n, without parsing any command
+    void set_parameter(int n, realt value)  throw(ExecuteError);
+
+    /// set values of all parameters at once, the size of values must be
+    /// equal to get_parameter_count(); model is recalculated only once
+    void set_parameters(const std::vector<realt>& values)  throw(ExecuteError);
+
+    /// pointer version of set_parameters(), num values are read
+    void set_parameters(const realt* values, int num)  throw(ExecuteError);
+
+    /// copy all parameters to out, num must be equal to get_parameter_count()
+    void get_parameters(realt* out, int num) const  throw(ExecuteError);
+
     /// returns all $variables
     std::vector<Var*> all_variables() const;
 
@@ -309,6 +421,15 @@ public:
     get_model_vector(std::vector<realt> const& x, int dataset=DEFAULT_DATASET)
                                                          throw(ExecuteError);
 
+    /// get_model_vector() that writes num values to caller's array y
+    void get_model_values(int dataset, const realt* x, realt* y, int num)
+                                                         throw(ExecuteError);
+
+    /// copy column ('x', 'y', 's' or 'a') of data to caller's array;
+    /// num must be equal to the number of points
+    void get_data_column(int dataset, char column, realt* out, int num)
+                                                         throw(ExecuteError);
+
     /// get coordinates of rectangle set by the plot command
     /// side is one of L(eft), R(ight), T(op), B(ottom)
     double get_view_boundary(char side);
@@ -398,9 +519,14 @@ FITYK_API Fityk* fityk_create();
 FITYK_API void fityk_delete(Fityk *f);
 /* returns 0 on ExitRequestedException */
 FITYK_API int fityk_execute(Fityk *f, const char* command);
+/* sigma can be NULL */
 FITYK_API void fityk_load_data(Fityk *f, int dataset,
                                double *x, double *y, double *sigma, int num,
                                const char* title);
+/* sigma can be NULL */
+FITYK_API void fityk_add_points(Fityk *f, int dataset,
+                                double *x, double *y, double *sigma, int num,
+                                int max_eval);
 /* returns NULL if no error happened since fityk_clear_last_error() */
 FITYK_API const char* fityk_last_error(const Fityk *f);
 FITYK_API void fityk_clear_last_error(Fityk *f);
@@ -409,11 +535,21 @@ FITYK_API char* fityk_get_info(Fityk *f, const char *s, int dataset);
 FITYK_API realt fityk_calculate_expr(Fityk *f, const char* s, int dataset);
 FITYK_API int fityk_get_dataset_count(const Fityk *f);
 FITYK_API int fityk_get_parameter_count(const Fityk* f);
+FITYK_API realt fityk_get_parameter(const Fityk* f, int n);
+FITYK_API void fityk_set_parameter(Fityk* f, int n, realt value);
+/* num must be equal to fityk_get_parameter_count() */
+FITYK_API void fityk_get_parameters(const Fityk* f, realt* out, int num);
+FITYK_API void fityk_set_parameters(Fityk* f, const realt* values, int num);
 FITYK_API const Var* fityk_get_variable(const Fityk* f, const char* name);
 FITYK_API const Func* fityk_get_function(const Fityk* f, const char* name);
 /* get data point, returns NULL if index is out of range */
 FITYK_API const Point* fityk_get_data_point(Fityk *f, int dataset, int index);
 FITYK_API realt fityk_get_model_value(Fityk *f, realt x, int dataset);
+FITYK_API void fityk_get_model_values(Fityk *f, int dataset,
+                                      const realt* x, realt* y, int num);
+/* column is one of 'x', 'y', 's', 'a', num is the number of points */
+FITYK_API void fityk_get_data_column(Fityk *f, int dataset, char column,
+                                     realt* out, int num);
 FITYK_API realt fityk_get_wssr(Fityk *f, int dataset);
 FITYK_API realt fityk_get_ssr(Fityk *f, int dataset);
 FITYK_API realt fityk_get_rsquared(Fityk *f, int dataset);
@@ -425,6 +561,8 @@ FITYK_API realt* fityk_get_covariance_matrix(Fityk *f, int dataset);
 FITYK_API realt fityk_var_value(const Var *var);
 FITYK_API const char* fityk_var_name(const Func *func, const char *param);
 FITYK_API realt fityk_value_at(const Func *func, realt x);
+FITYK_API void fityk_values_at(const Func *func,
+                               const realt* x, realt* y, int num);
 
 #ifdef __cplusplus
 } // extern "C"
@@ -13,9 +13,6 @@ using namespace std;
 
 namespace fityk {
 
-vector<realt> Function::bufx_(1);
-vector<realt> Function::bufy_(1);
-
 Function::Function(const Settings* settings,
                    const string &name_,
                    const Tplate::Ptr tp,
@@ -25,7 +22,9 @@ Function::Function(const Settings* settings,
       settings_(settings),
       tp_(tp),
       av_(vars.size()),
-      center_idx_(-1)
+      center_idx_(-1),
+      bufx_(1),
+      bufy_(1)
 {
 }
 
@@ -42,21 +41,44 @@ void Function::init()
 void Function::do_precomputations(const vector<Variable*> &variables)
 {
     //precondition: recalculate() for all variables
-    multi_.clear();
-    for (int i = 0; i < used_vars_.get_count(); ++i) {
+    const int nu = used_vars_.get_count();
+    bool current = (size(used_chain_ids_) == nu);
+    for (int i = 0; i < nu; ++i) {
         const Variable *v = variables[used_vars_.get_idx(i)];
         av_[i] = v->value();
-        for (const Variable::ParMult& pm : v->recursive_derivatives())
-            multi_.push_back(Multi(i, pm));
+        if (current && v->chain_id() != used_chain_ids_[i])
+            current = false;
+    }
+    if (current) {
+        // the structure of multi_ is the same, update only multipliers
+        // (and positions of parameters, mirror-variables in UDFs are not
+        // renumbered when parameters are erased)
+        vector<Multi>::iterator m = multi_.begin();
+        for (int i = 0; i < nu; ++i) {
+            const Variable *v = variables[used_vars_.get_idx(i)];
+            for (const Variable::ParMult& pm : v->recursive_derivatives()) {
+                m->p = pm.p;
+                m->mult = pm.mult;
+                ++m;
+            }
+        }
+    } else {
+        multi_.clear();
+        used_chain_ids_.resize(nu);
+        for (int i = 0; i < nu; ++i) {
+            const Variable *v = variables[used_vars_.get_idx(i)];
+            used_chain_ids_[i] = v->chain_id();
+            for (const Variable::ParMult& pm : v->recursive_derivatives())
+                multi_.push_back(Multi(i, pm));
+        }
     }
     this->more_precomputations();
 }
 
-void Function::erased_parameter(int k)
+void Function::renumber_parameters(const vector<int>& new_gpos)
 {
     for (Multi& m : multi_)
-        if (m.p > k)
-            -- m.p;
+        m.p = new_gpos[m.p];
 }
 
 
@@ -80,6 +102,16 @@ realt Function::calculate_value(realt x) const
     return bufy_[0];
 }
 
+// x doesn't need to be sorted, function_cutoff is not applied here
+void Function::values_at(const realt* x, realt* y, int num) const
+{
+    // reuse the buffers of calculate_value(), no allocation after first call
+    bufx_.assign(x, x + num);
+    bufy_.assign(num, 0.);
+    calculate_value_in_range(bufx_, bufy_, 0, num);
+    copy(bufy_.begin(), bufy_.end(), y);
+}
+
 void Function::calculate_value_deriv(const vector<realt> &x,
                                      vector<realt> &y,
                                      vector<realt> &dy_da,
@@ -136,6 +168,14 @@ string Function::get_basic_assignment() const
     return r;
 }
 
+void Function::count_memory(size_t* cache, size_t* /*code*/) const
+{
+    *cache += sizeof(*this) + av_.capacity() * sizeof(realt)
+              + multi_.capacity() * sizeof(Multi)
+              + used_chain_ids_.capacity() * sizeof(unsigned long)
+              + (bufx_.capacity() + bufy_.capacity()) * sizeof(realt);
+}
+
 /// return sth like: %f = Linear(a0=$foo, a1=~3.5)
 string Function::get_current_assignment(const vector<Variable*> &variables,
                                         const vector<realt> &parameters) const
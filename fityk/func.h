@@ -51,7 +51,7 @@ public:
 
     void do_precomputations(const std::vector<Variable*> &variables);
     virtual void more_precomputations() {}
-    void erased_parameter(int k);
+    void renumber_parameters(const std::vector<int>& new_gpos);
     virtual bool get_nonzero_range(double /*level*/,
                       realt& /*left*/, realt& /*right*/) const { return false; }
 
@@ -70,6 +70,10 @@ public:
 
     const std::vector<realt>& av() const { return av_; }
     std::string get_basic_assignment() const;
+    /// adds approximate memory (in bytes) taken by cached values
+    /// and by bytecode to *cache and *code
+    virtual void count_memory(size_t* cache, size_t* code) const;
+
     std::string get_current_assignment(const std::vector<Variable*> &variables,
                                     const std::vector<realt> &parameters) const;
     virtual std::string get_current_formula(const std::string& x,
@@ -95,8 +99,9 @@ public:
     realt numarea(realt x1, realt x2, int nsteps) const;
 
     virtual std::string get_bytecode() const { return "No bytecode"; }
-    virtual void update_var_indices(const std::vector<Variable*>& variables)
-            { used_vars_.update_indices(variables); }
+    virtual void update_var_indices(const std::vector<Variable*>& variables,
+                                    const NameIndex* index=NULL)
+            { used_vars_.update_indices(variables, index); }
     void set_param_name(int n, const std::string &new_p)
             { used_vars_.set_name(n, new_p); }
     const IndexedVars& used_vars() const { return used_vars_; }
@@ -113,6 +118,7 @@ public:
 #endif
 
     virtual realt value_at(realt x) const { return calculate_value(x); }
+    virtual void values_at(const realt* x, realt* y, int num) const;
     int max_param_pos() const;
 
     realt calculate_value_and_deriv(realt x, std::vector<realt> &dy_da) const {
@@ -133,10 +139,14 @@ protected:
     std::vector<realt> av_;
     std::vector<Multi> multi_;
     int center_idx_;
+    // Variable::chain_id() of used variables when multi_ was built
+    std::vector<unsigned long> used_chain_ids_;
 
 private:
-    static std::vector<realt> bufx_;
-    static std::vector<realt> bufy_;
+    // one-element buffers for calculate_value(realt) and similar functions,
+    // per-instance (not static) so that separate engines can run in parallel
+    mutable std::vector<realt> bufx_;
+    mutable std::vector<realt> bufy_;
 };
 
 } // namespace fityk
@@ -382,10 +382,19 @@ int eval_one_info_arg(const Full* F, int ds, const vector<Token>& args, int n,
                 result += (i > 0 ? " %" : "%") + F->mgr.get_function(i)->name;
         else if (word == "dataset_count")
             result += S(F->dk.count());
+        else if (word == "data_store")
+            result += F->dk.store_info();
+        else if (word == "memory")
+            result += F->memory_info();
         else if (word == "view")
             result += F->view.str();
         else if (word == "fit_history")
             result += F->fit_manager()->param_history_info();
+        else if (word == "profile") {
+            if (!F->get_settings()->profiling)
+                result += "Profiling is off (set profiling=1 to enable).\n";
+            result += F->mgr.profiler().report();
+        }
         else if (word == "filename") {
             result += F->dk.data(ds)->get_filename();
         } else if (word == "title") {
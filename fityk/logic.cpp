@@ -30,7 +30,7 @@ using namespace std;
 namespace fityk {
 
 Full::Full()
-    : mgr(this), view(&dk)
+    : mgr(this), view(&dk), fit_trace_callback_(NULL), fit_trace_data_(NULL)
 {
     // reading numbers won't work with decimal points different than '.'
     setlocale(LC_NUMERIC, "C");
@@ -78,12 +78,16 @@ void Full::reset()
 {
     int verbosity = get_settings()->verbosity;
     bool autoplot = get_settings()->autoplot;
+    bool cwd_locked = settings_mgr_->cwd_locked();
+    cmd_executor_->clear_statement_cache();
     destroy();
     initialize();
     if (verbosity != get_settings()->verbosity)
         settings_mgr_->set_as_number("verbosity", verbosity);
     if (autoplot != get_settings()->autoplot)
         settings_mgr_->set_as_number("autoplot", autoplot);
+    if (cwd_locked)
+        settings_mgr_->lock_cwd();
 }
 
 void DataKeeper::remove(int d)
@@ -98,6 +102,156 @@ void DataKeeper::remove(int d)
     }
 }
 
+const vector<Data*>& DataKeeper::datas() const
+{
+    for (int i = 0; i != count(); ++i)
+        touch(i);
+    return datas_;
+}
+
+void DataKeeper::touch(int n) const
+{
+    Data *d = datas_[n];
+    if (d->is_spilled())
+        d->unspill();
+    d->set_last_use(++use_counter_);
+}
+
+void DataKeeper::limit_memory(double max_bytes)
+{
+    double total = 0;
+    vector<pair<unsigned long, int> > lru;
+    for (int i = 0; i != count(); ++i) {
+        const Data *d = datas_[i];
+        if (d->is_spilled())
+            continue;
+        total += d->memory_usage();
+        if (i != default_idx_)
+            lru.push_back(make_pair(d->last_use(), i));
+    }
+    if (total <= max_bytes)
+        return;
+    sort(lru.begin(), lru.end());
+    for (size_t i = 0; i != lru.size() && total > max_bytes; ++i) {
+        Data *d = datas_[lru[i].second];
+        total -= d->memory_usage();
+        d->spill(&spill_store_);
+    }
+}
+
+string DataKeeper::store_info() const
+{
+    int n_spilled = 0;
+    double mem = 0, disk = 0;
+    for (const Data* d : datas_) {
+        if (d->is_spilled()) {
+            ++n_spilled;
+            disk += d->spilled_size();
+        } else
+            mem += d->memory_usage();
+    }
+    return S(count()) + " datasets: " + S(count() - n_spilled)
+        + " in memory (" + format1<double,32>("%.1f MB", mem / 1e6) + "), "
+        + S(n_spilled) + " in temporary file ("
+        + format1<double,32>("%.1f MB", disk / 1e6) + ", file size: "
+        + format1<double,32>("%.1f MB", spill_store_.file_size() / 1e6) + ")";
+}
+
+double DataKeeper::memory_usage() const
+{
+    double mem = 0;
+    for (const Data* d : datas_)
+        if (!d->is_spilled())
+            mem += d->memory_usage();
+    return mem;
+}
+
+static string format_mb(double bytes)
+{
+    return format1<double,32>("%.3f MB", bytes / 1e6);
+}
+
+string DataKeeper::memory_info() const
+{
+    string s;
+    for (int i = 0; i != count(); ++i) {
+        const Data* d = datas_[i];
+        s += "\n  @" + S(i) + ": ";
+        if (d->is_spilled())
+            s += "in temporary file, " + format_mb(d->spilled_size());
+        else
+            s += S(d->points().size()) + " points, "
+                + format_mb(d->memory_usage()) + " (active: "
+                + format_mb(d->active_memory_usage()) + ")";
+    }
+    return s;
+}
+
+namespace {
+
+// approximate memory used by different parts of the engine, in bytes
+struct MemoryParts
+{
+    double data, model, history, code, lua, loader;
+    int loader_files;
+
+    double total() const
+        { return data + model + history + code + lua + loader; }
+};
+
+} // anonymous namespace
+
+static MemoryParts get_memory_parts(const Full* F, const LuaBridge* lua,
+                                    const CommandExecutor* executor)
+{
+    MemoryParts m;
+    m.data = F->dk.memory_usage();
+    size_t cache = 0, code = 0;
+    F->mgr.count_memory(&cache, &code);
+    m.model = cache;
+    m.history = F->fit_manager()->memory_usage();
+    m.code = code + executor->statement_cache_memory();
+    m.lua = lua->memory_usage();
+    m.loader = Data::loader_cache_usage(&m.loader_files);
+    return m;
+}
+
+double Full::memory_usage() const
+{
+    return get_memory_parts(this, lua_bridge_, cmd_executor_).total();
+}
+
+string Full::memory_info() const
+{
+    MemoryParts m = get_memory_parts(this, lua_bridge_, cmd_executor_);
+    string s = "datasets: " + format_mb(m.data) + dk.memory_info();
+    s += "\nmodel (" + S(mgr.variables().size()) + " variables, "
+        + S(mgr.functions().size()) + " functions): " + format_mb(m.model);
+    s += "\nparameter history (" + S(fit_manager()->get_param_history_size())
+        + " items): " + format_mb(m.history);
+    s += "\nbytecode and parsed commands: " + format_mb(m.code);
+    s += "\nLua: " + format_mb(m.lua);
+    s += "\nloader cache (" + S(m.loader_files) + " files): "
+        + format_mb(m.loader);
+    s += "\ntotal: " + format_mb(m.total());
+    double limit = get_settings()->memory_soft_limit;
+    if (limit > 0)
+        s += " (memory_soft_limit: " + S(limit) + " MB)";
+    return s;
+}
+
+void Full::check_memory_budget(double extra, const string& what) const
+{
+    double limit = get_settings()->memory_soft_limit * 1e6;
+    if (limit <= 0 || extra <= 0)
+        return;
+    double total = memory_usage() + extra;
+    if (total > limit)
+        ui_->warn(what + " may need " + format_mb(extra)
+                  + ", memory usage would be about " + format_mb(total)
+                  + ", above memory_soft_limit (" + format_mb(limit) + ").");
+}
+
 Fit* Full::get_fit() const
 {
     string method_name = get_settings()->fitting_method;
@@ -245,11 +399,14 @@ void Full::outdated_plot()
 
 bool Full::are_independent(std::vector<Data*> dd) const
 {
+    vector<vector<bool> > masks;
+    v_foreach(Data*, d, dd)
+        masks.push_back((*d)->model()->var_dependency_mask());
     for (size_t i = 0; i != mgr.variables().size(); ++i)
         if (mgr.get_variable(i)->is_simple()) {
             bool dep = false;
-            v_foreach(Data*, d, dd)
-                if ((*d)->model()->is_dependent_on_var(i)) {
+            for (size_t k = 0; k != masks.size(); ++k)
+                if (masks[k][i]) {
                     if (dep)
                         return false;
                     dep = true;
@@ -10,6 +10,7 @@
 #include "view.h"
 #include "settings.h"
 #include "data.h" // Data.model()
+#include "numfuncs.h" // RandomGenerator
 
 namespace fityk {
 
@@ -22,16 +23,20 @@ class CommandExecutor;
 class FITYK_API DataKeeper
 {
 public:
-    DataKeeper() : default_idx_(0) {}
+    DataKeeper() : default_idx_(0), use_counter_(0) {}
     void append(Data *data) { datas_.push_back(data); }
     void remove(int d);
     void clear() { purge_all_elements(datas_); }
 
-    const std::vector<Data*>& datas() const { return datas_; }
+    // all datasets are brought to memory
+    const std::vector<Data*>& datas() const;
     int count() const { return datas_.size(); }
+    /// number of points in dataset n, doesn't load spilled dataset
+    size_t point_count(int n) const
+                { index_check(n); return datas_[n]->point_count(); }
 
-    Data* data(int n) { index_check(n); return datas_[n]; }
-    const Data* data(int n) const { index_check(n); return datas_[n]; }
+    Data* data(int n) { index_check(n); touch(n); return datas_[n]; }
+    const Data* data(int n) const { index_check(n); touch(n); return datas_[n];}
 
     const Model* get_model(int n) const { return data(n)->model(); }
     Model *get_mutable_model(int n) { return data(n)->model(); }
@@ -46,9 +51,25 @@ public:
     void do_import_dataset(bool new_dataset, int slot, const LoadSpec& spec,
                            BasicContext* ctx, ModelManager &mgr);
 
+    /// Move the least recently used datasets to temporary files until
+    /// the points kept in memory take less than max_bytes.
+    /// Spilled datasets are loaded back when accessed with data(n).
+    void limit_memory(double max_bytes);
+    /// used by "info data_store"
+    std::string store_info() const;
+    /// memory (in bytes) taken by points of datasets that are in memory
+    double memory_usage() const;
+    /// one line per dataset, used by "info memory"
+    std::string memory_info() const;
+
 private:
     int default_idx_;
+    SpillStore spill_store_; // shared by all spilled datasets
     std::vector<Data*> datas_;
+    mutable unsigned long use_counter_;
+
+    // load dataset n if it was spilled and mark it as recently used
+    void touch(int n) const;
 
     /// verify that n is the valid number for get_data() and return n
     void index_check(int n) const
@@ -73,10 +94,13 @@ public:
                                 { if (get_verbosity() >= 0) ui_->mesg(s); }
     const SettingsMgr* settings_mgr() const { return settings_mgr_; }
     const Settings* get_settings() const { return &settings_mgr_->m(); }
+    /// random number generator, it's per-instance, hence mutable
+    RandomGenerator& rng() const { return rng_; }
 
 protected:
     SettingsMgr* settings_mgr_;
     UserInterface* ui_;
+    mutable RandomGenerator rng_;
 };
 
 /// Full context.
@@ -104,6 +128,21 @@ public:
     TplateMgr* get_tpm() { return tplate_mgr_; }
 
     LuaBridge* lua_bridge() { return lua_bridge_; }
+    const CommandExecutor* cmd_executor() const { return cmd_executor_; }
+
+    void set_fit_trace_callback(t_fit_trace_callback *func, void *user_data)
+        { fit_trace_callback_ = func; fit_trace_data_ = user_data; }
+    t_fit_trace_callback* fit_trace_callback() const
+        { return fit_trace_callback_; }
+    void* fit_trace_data() const { return fit_trace_data_; }
+
+    /// approximate memory (in bytes) used by datasets, model, history, etc.
+    double memory_usage() const;
+    /// used by "info memory"
+    std::string memory_info() const;
+    /// warns if the memory_soft_limit option would be exceeded after
+    /// allocating extra bytes in operation `what'
+    void check_memory_budget(double extra, const std::string& what) const;
 
     /// called after changes that (possibly) need to be reflected in the plot
     /// (IOW when plot needs to be updated). This function is also used
@@ -127,6 +166,9 @@ private:
     TplateMgr* tplate_mgr_;
     LuaBridge* lua_bridge_;
     CommandExecutor* cmd_executor_;
+    // kept in reset(), like callbacks in UserInterface
+    t_fit_trace_callback *fit_trace_callback_;
+    void *fit_trace_data_;
 
     // these two are used in ctor, dtor and reset()
     void initialize();
@@ -203,6 +203,14 @@ void LuaBridge::exec_lua_output(const string& str)
         handle_lua_error();
 }
 
+size_t LuaBridge::memory_usage() const
+{
+    if (L_ == NULL)
+        return 0;
+    return (size_t) lua_gc(L_, LUA_GCCOUNT, 0) * 1024
+           + lua_gc(L_, LUA_GCCOUNTB, 0);
+}
+
 void LuaBridge::handle_lua_error()
 {
     const char *msg = lua_tostring(L_, -1);
@@ -222,6 +230,7 @@ void LuaBridge::exec_lua_string(const std::string&) {}
 void LuaBridge::exec_lua_script(const std::string&) {}
 void LuaBridge::exec_lua_output(const std::string&) {}
 bool LuaBridge::is_lua_line_incomplete(const char*) { return true; }
+size_t LuaBridge::memory_usage() const { return 0; }
 }
 
 #endif // DISABLE_LUA
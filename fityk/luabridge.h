@@ -23,6 +23,8 @@ public:
     void exec_lua_script(const std::string& str);
     void exec_lua_output(const std::string& str);
     bool is_lua_line_incomplete(const char* str);
+    /// memory (in bytes) allocated by the Lua interpreter
+    size_t memory_usage() const;
     //lua_State* state() { return L_ };
 
 private:
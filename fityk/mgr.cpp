@@ -25,7 +25,9 @@ namespace fityk {
 ModelManager::ModelManager(const BasicContext* ctx)
     : ctx_(ctx),
       var_autoname_counter_(0),
-      func_autoname_counter_(0)
+      func_autoname_counter_(0),
+      deps_dirty_(true),
+      graph_ready_(false)
 {
     assert(ctx != NULL);
 }
@@ -53,17 +55,18 @@ void ModelManager::delete_model(Model *m)
 
 void ModelManager::sort_variables()
 {
-    for (vector<Variable*>::iterator i = variables_.begin();
-            i != variables_.end(); ++i)
-        (*i)->set_var_idx(variables_);
+    deps_dirty_ = true;
+    for (Variable* var : variables_)
+        var->set_var_idx(variables_, &var_index_);
     int pos = 0;
     while (pos < size(variables_)) {
         int M = variables_[pos]->used_vars().get_max_idx();
         if (M > pos) {
             swap(variables_[pos], variables_[M]);
-            for (vector<Variable*>::iterator i = variables_.begin();
-                    i != variables_.end(); ++i)
-                (*i)->set_var_idx(variables_);
+            var_index_[variables_[pos]->name] = pos;
+            var_index_[variables_[M]->name] = M;
+            for (Variable* var : variables_)
+                var->set_var_idx(variables_, &var_index_);
         } else
             ++pos;
     }
@@ -128,6 +131,7 @@ void ModelManager::eval_tilde(vector<int>::iterator op,
     ++op;
     // the rest of ops is to be deleted after reading
     double value = nums[*op];
+    deps_dirty_ = true;
     Variable *tilde_var = new Variable(next_var_name(), parameters_.size());
     if (*(op+1) == OP_TILDE) {  // TILDE,NUMBER,N1,TILDE -> SYMBOL,N2
         code.erase(op, op+2);
@@ -139,6 +143,7 @@ void ModelManager::eval_tilde(vector<int>::iterator op,
         code.erase(op, op+5);
     }
     parameters_.push_back(value);
+    var_index_[tilde_var->name] = variables_.size();
     variables_.push_back(tilde_var);
 }
 
@@ -195,25 +200,85 @@ int ModelManager::make_variable(const string &name, VMData* vd)
     }
 }
 
-bool ModelManager::is_variable_referred(int i, string *first_referrer)
+// returns number of references to each variable from variables and functions
+vector<int> ModelManager::count_references() const
+{
+    vector<int> refs(variables_.size(), 0);
+    for (const Variable* var : variables_)
+        for (int idx : var->used_vars().indices())
+            ++refs[idx];
+    for (const Function* func : functions_)
+        for (int idx : func->used_vars().indices())
+            ++refs[idx];
+    return refs;
+}
+
+// returns name of the first variable (not marked as removed) or function
+// that refers to variables_[i], or empty string
+string ModelManager::find_referrer(int i, const vector<bool>& removed) const
 {
     // A variable can be referred only by variables with larger index.
-    for (int j = i+1; j < size(variables_); ++j) {
-        if (variables_[j]->used_vars().has_idx(i)) {
-            if (first_referrer)
-                *first_referrer = "$" + variables_[j]->name;
-            return true;
-        }
+    for (int j = i+1; j < size(variables_); ++j)
+        if (!removed[j] && variables_[j]->used_vars().has_idx(i))
+            return "$" + variables_[j]->name;
+    for (const Function* func : functions_)
+        if (func->used_vars().has_idx(i))
+            return "%" + func->name;
+    return "";
+}
+
+// returns mask of variables on which uv depends (directly or indirectly)
+vector<bool> ModelManager::find_dependencies(const IndexedVars& uv) const
+{
+    vector<bool> deps(variables_.size(), false);
+    for (int idx : uv.indices())
+        deps[idx] = true;
+    // variables used by variables_[i] have indices < i
+    for (int i = size(variables_) - 1; i >= 0; --i)
+        if (deps[i])
+            for (int idx : variables_[i]->used_vars().indices())
+                deps[idx] = true;
+    return deps;
+}
+
+void ModelManager::erase_variables(const vector<bool>& removed)
+{
+    int n = 0;
+    for (size_t i = 0; i != variables_.size(); ++i) {
+        if (removed[i])
+            delete variables_[i];
+        else
+            variables_[n++] = variables_[i];
     }
-    for (vector<Function*>::iterator j = functions_.begin();
-            j != functions_.end(); ++j) {
-        if ((*j)->used_vars().has_idx(i)) {
-            if (first_referrer)
-                *first_referrer = "%" + (*j)->name;
-            return true;
-        }
+    variables_.resize(n);
+    index_variables();
+}
+
+void ModelManager::erase_functions(const vector<bool>& removed)
+{
+    int n = 0;
+    for (size_t i = 0; i != functions_.size(); ++i) {
+        if (removed[i])
+            delete functions_[i];
+        else
+            functions_[n++] = functions_[i];
     }
-    return false;
+    functions_.resize(n);
+    index_functions();
+}
+
+void ModelManager::index_variables()
+{
+    var_index_.clear();
+    for (int i = 0; i != size(variables_); ++i)
+        var_index_[variables_[i]->name] = i;
+}
+
+void ModelManager::index_functions()
+{
+    func_index_.clear();
+    for (int i = 0; i != size(functions_); ++i)
+        func_index_[functions_[i]->name] = i;
 }
 
 vector<string>
@@ -234,40 +299,50 @@ ModelManager::get_variable_references(const string &name) const
 // set indices corresponding to variable names in all functions and variables
 void ModelManager::reindex_all()
 {
+    deps_dirty_ = true;
     for (Variable* var : variables_)
-        var->set_var_idx(variables_);
+        var->set_var_idx(variables_, &var_index_);
     for (Function* func : functions_)
-        func->update_var_indices(variables_);
+        func->update_var_indices(variables_, &var_index_);
 }
 
 void ModelManager::remove_unreferred()
 {
-    // remove auto-delete marked variables, which are not referred by others
+    // remove auto-delete marked variables, which are not referred by others;
+    // the descending order makes variables referred only by removed
+    // variables removable
+    vector<int> refs = count_references();
+    vector<bool> removed(variables_.size(), false);
     for (int i = variables_.size()-1; i >= 0; --i)
-        if (is_auto(variables_[i]->name) && !is_variable_referred(i)) {
-            delete variables_[i];
-            variables_.erase(variables_.begin() + i);
+        if (refs[i] == 0 && is_auto(variables_[i]->name)) {
+            removed[i] = true;
+            for (int idx : variables_[i]->used_vars().indices())
+                --refs[idx];
         }
+    if (contains_element(removed, true))
+        erase_variables(removed);
 
     // re-index all functions and variables (in any case)
     reindex_all();
 
     // remove unreferred parameters
-    for (int i = size(parameters_)-1; i >= 0; --i) {
-        bool del=true;
-        for (int j = 0; j < size(variables_); ++j)
-            if (variables_[j]->gpos() == i) {
-                del=false;
-                break;
-            }
-        if (del) {
-            parameters_.erase(parameters_.begin() + i);
-            // take care about parameter indices in variables and functions
-            for (Variable* var : variables_)
-                var->erased_parameter(i);
-            for (Function* func : functions_)
-                func->erased_parameter(i);
+    vector<int> new_gpos(parameters_.size(), -1);
+    for (const Variable* var : variables_)
+        if (var->gpos() >= 0)
+            new_gpos[var->gpos()] = 0;
+    int n = 0;
+    for (int i = 0; i != size(parameters_); ++i)
+        if (new_gpos[i] != -1) {
+            parameters_[n] = parameters_[i];
+            new_gpos[i] = n++;
         }
+    if (n != size(parameters_)) {
+        parameters_.resize(n);
+        // take care about parameter indices in variables and functions
+        for (Variable* var : variables_)
+            var->renumber_parameters(new_gpos);
+        for (Function* func : functions_)
+            func->renumber_parameters(new_gpos);
     }
 }
 
@@ -275,10 +350,12 @@ void ModelManager::remove_unreferred()
 int ModelManager::add_variable(Variable* new_var, bool old_domain)
 {
     unique_ptr<Variable> var(new_var);
-    var->set_var_idx(variables_);
+    var->set_var_idx(variables_, &var_index_);
+    deps_dirty_ = true;
     int pos = find_variable_nr(var->name);
     if (pos == -1) {
         pos = variables_.size();
+        var_index_[var->name] = pos;
         variables_.push_back(var.release());
     } else {
         if (var->used_vars().depends_on(pos, variables_)) { //check for loops
@@ -330,8 +407,9 @@ int ModelManager::assign_var_copy(const string &name, const string &orig)
     assert(!name.empty());
     const Variable* ov = find_variable(orig);
     map<int,string> var_copies;
-    for (int i = 0; i < size(variables_); ++i) {
-        if (ov->used_vars().depends_on(i, variables_)) {
+    vector<bool> deps = find_dependencies(ov->used_vars());
+    for (int i = 0; i < size(deps); ++i) {
+        if (deps[i]) {
             const Variable* var_orig = variables_[i];
             string newname = name_var_copy(var_orig);
             copy_and_add_variable(newname, var_orig, var_copies);
@@ -362,21 +440,25 @@ void ModelManager::delete_variables(const vector<string> &names)
                     nn.insert(j);
     }
 
-    // Delete variables_. The descending index order is required to make
-    // is_variable_referred() and variables_.erase() work properly.
+    // Delete variables_. The descending index order is required, because
+    // a variable can be referred only by variables with larger index.
+    vector<int> refs = count_references();
+    vector<bool> removed(variables_.size(), false);
     for (set<int>::const_reverse_iterator i = nn.rbegin(); i != nn.rend(); ++i){
         // Check for dependencies.
-        string first_referrer;
-        if (is_variable_referred(*i, &first_referrer)) {
+        if (refs[*i] > 0) {
+            string msg = "can't delete $" + get_variable(*i)->name +
+                " because " + find_referrer(*i, removed) + " depends on it.";
+            erase_variables(removed);
             reindex_all();
             remove_unreferred(); // post-delete
-            throw ExecuteError("can't delete $" + get_variable(*i)->name +
-                             " because " + first_referrer + " depends on it.");
+            throw ExecuteError(msg);
         }
-
-        delete variables_[*i];
-        variables_.erase(variables_.begin() + *i);
+        removed[*i] = true;
+        for (int idx : variables_[*i]->used_vars().indices())
+            --refs[idx];
     }
+    erase_variables(removed);
 
     // post-delete
     reindex_all();
@@ -403,11 +485,10 @@ void ModelManager::delete_funcs(const vector<string>& names)
         }
     }
 
-    // Delete functions. The descending index order is needed by .erase().
-    for (set<int>::const_reverse_iterator i = nn.rbegin(); i != nn.rend(); ++i){
-        delete functions_[*i];
-        functions_.erase(functions_.begin() + *i);
-    }
+    vector<bool> removed(functions_.size(), false);
+    for (int k : nn)
+        removed[k] = true;
+    erase_functions(removed);
 
     // post-delete
     remove_unreferred();
@@ -427,23 +508,19 @@ bool ModelManager::is_function_referred(int n) const
 // post: call update_indices_in_models()
 void ModelManager::auto_remove_functions()
 {
-    int func_size = functions_.size();
-    for (int i = func_size - 1; i >= 0; --i)
-        if (is_auto(functions_[i]->name) && !is_function_referred(i)) {
-            delete functions_[i];
-            functions_.erase(functions_.begin() + i);
-        }
-    if (func_size != size(functions_)) {
+    vector<bool> removed(functions_.size(), false);
+    for (int i = 0; i != size(functions_); ++i)
+        removed[i] = is_auto(functions_[i]->name) && !is_function_referred(i);
+    if (contains_element(removed, true)) {
+        erase_functions(removed);
         remove_unreferred();
     }
 }
 
 int ModelManager::find_function_nr(const string &name) const
 {
-    for (int i = 0; i < size(functions_); ++i)
-        if (functions_[i]->name == name)
-            return i;
-    return -1;
+    unordered_map<string, int>::const_iterator it = func_index_.find(name);
+    return it != func_index_.end() ? it->second : -1;
 }
 
 const Function* ModelManager::find_function(const string &name) const
@@ -456,10 +533,8 @@ const Function* ModelManager::find_function(const string &name) const
 
 int ModelManager::find_variable_nr(const string &name) const
 {
-    for (int i = 0; i < size(variables_); ++i)
-        if (variables_[i]->name == name)
-            return i;
-    return -1;
+    unordered_map<string, int>::const_iterator it = var_index_.find(name);
+    return it != var_index_.end() ? it->second : -1;
 }
 
 const Variable* ModelManager::find_variable(const string &name) const
@@ -485,21 +560,149 @@ void ModelManager::use_parameters()
     use_external_parameters(parameters_);
 }
 
+void ModelManager::count_memory(size_t* cache, size_t* code) const
+{
+    *cache += (parameters_.capacity() + used_parameters_.capacity())
+                                                            * sizeof(realt)
+              + (par_var_start_.capacity() + par_var_list_.capacity()
+                 + par_func_start_.capacity() + par_func_list_.capacity())
+                                                            * sizeof(int)
+              + (var_mark_.capacity() + func_mark_.capacity()) / 8;
+    v_foreach (Variable*, i, variables_)
+        (*i)->count_memory(cache, code);
+    v_foreach (Function*, i, functions_)
+        (*i)->count_memory(cache, code);
+}
+
+Profiler* ModelManager::active_profiler()
+{
+    return ctx_->get_settings()->profiling ? &profiler_ : NULL;
+}
+
 void ModelManager::use_external_parameters(const vector<realt> &ext_param)
 {
+    Profiler* prof = active_profiler();
+    ScopedProfile sp(prof ? &prof->phase(Profiler::kPrecomputation) : NULL, 0);
+    if (!deps_dirty_ && ext_param.size() == used_parameters_.size()) {
+        if (!graph_ready_)
+            build_dependency_graph();
+        recalculate_changed(ext_param);
+        return;
+    }
     for (Variable* var : variables_)
         var->recalculate(variables_, ext_param);
     for (Function* func : functions_)
         func->do_precomputations(variables_);
+    used_parameters_ = ext_param;
+    deps_dirty_ = false;
+    graph_ready_ = false;
+}
+
+// Lists (start, list) give for each item i sorted numbers of parameters
+// list[start[i]] ... list[start[i+1]-1]. Makes inverse lists: items for
+// each of np parameters.
+static void invert_lists(const vector<int>& start, const vector<int>& list,
+                         int np, vector<int>& inv_start, vector<int>& inv_list)
+{
+    inv_start.assign(np + 1, 0);
+    for (int p : list)
+        ++inv_start[p + 1];
+    for (int p = 0; p != np; ++p)
+        inv_start[p + 1] += inv_start[p];
+    inv_list.resize(list.size());
+    vector<int> pos(inv_start.begin(), inv_start.end() - 1);
+    for (int i = 0; i + 1 < size(start); ++i)
+        for (int k = start[i]; k != start[i + 1]; ++k)
+            inv_list[pos[list[k]]++] = i;
+}
+
+// pre: variables_ are sorted, so variables used by variables_[i]
+//      have indices < i
+void ModelManager::build_dependency_graph()
+{
+    const int np = parameters_.size();
+    // parameters on which each variable depends, sorted
+    vector<int> vp_start(1, 0), vp_list;
+    vector<int> tmp;
+    for (int i = 0; i != size(variables_); ++i) {
+        const Variable* var = variables_[i];
+        tmp.clear();
+        if (var->gpos() >= 0)
+            tmp.push_back(var->gpos());
+        for (int idx : var->used_vars().indices()) {
+            assert(idx < i);
+            tmp.insert(tmp.end(), vp_list.begin() + vp_start[idx],
+                                  vp_list.begin() + vp_start[idx + 1]);
+        }
+        sort(tmp.begin(), tmp.end());
+        tmp.erase(unique(tmp.begin(), tmp.end()), tmp.end());
+        vp_list.insert(vp_list.end(), tmp.begin(), tmp.end());
+        vp_start.push_back(vp_list.size());
+    }
+    invert_lists(vp_start, vp_list, np, par_var_start_, par_var_list_);
+
+    // the same for functions
+    vector<int> fp_start(1, 0), fp_list;
+    for (const Function* func : functions_) {
+        tmp.clear();
+        for (int idx : func->used_vars().indices())
+            tmp.insert(tmp.end(), vp_list.begin() + vp_start[idx],
+                                  vp_list.begin() + vp_start[idx + 1]);
+        sort(tmp.begin(), tmp.end());
+        tmp.erase(unique(tmp.begin(), tmp.end()), tmp.end());
+        fp_list.insert(fp_list.end(), tmp.begin(), tmp.end());
+        fp_start.push_back(fp_list.size());
+    }
+    invert_lists(fp_start, fp_list, np, par_func_start_, par_func_list_);
+
+    var_mark_.assign(variables_.size(), false);
+    func_mark_.assign(functions_.size(), false);
+    graph_ready_ = true;
+}
+
+// recalculates variables and functions that depend on parameters which
+// changed since the last call, in the order of variables_ (topological)
+void ModelManager::recalculate_changed(const vector<realt> &ext_param)
+{
+    bool any = false;
+    for (size_t p = 0; p != ext_param.size(); ++p) {
+        // NaN is always considered changed
+        if (ext_param[p] == used_parameters_[p])
+            continue;
+        used_parameters_[p] = ext_param[p];
+        for (int k = par_var_start_[p]; k != par_var_start_[p+1]; ++k)
+            var_mark_[par_var_list_[k]] = true;
+        for (int k = par_func_start_[p]; k != par_func_start_[p+1]; ++k)
+            func_mark_[par_func_list_[k]] = true;
+        any = true;
+    }
+    if (!any)
+        return;
+    for (size_t i = 0; i != variables_.size(); ++i)
+        if (var_mark_[i]) {
+            variables_[i]->recalculate(variables_, ext_param);
+            var_mark_[i] = false;
+        }
+    for (size_t i = 0; i != functions_.size(); ++i)
+        if (func_mark_[i]) {
+            functions_[i]->do_precomputations(variables_);
+            func_mark_[i] = false;
+        }
 }
 
-void ModelManager::put_new_parameters(const vector<realt> &aa)
+void ModelManager::put_new_parameters(const realt *aa, int n)
 {
-    for (size_t i = 0; i < min(aa.size(), parameters_.size()); ++i)
+    for (int i = 0; i < min(n, size(parameters_)); ++i)
         parameters_[i] = aa[i];
     use_parameters();
 }
 
+void ModelManager::put_new_parameter(int n, realt value)
+{
+    parameters_[n] = value;
+    use_parameters();
+}
+
 void ModelManager::set_domain(int n, const RealRange& domain)
 {
     variables_[n]->domain = domain;
@@ -525,8 +728,9 @@ int ModelManager::assign_func_copy(const string &name, const string &orig)
     assert(!name.empty());
     const Function* of = find_function(orig);
     map<int,string> var_copies;
-    for (int i = 0; i < size(variables_); ++i) {
-        if (of->used_vars().depends_on(i, variables_)) {
+    vector<bool> deps = find_dependencies(of->used_vars());
+    for (int i = 0; i < size(deps); ++i) {
+        if (deps[i]) {
             const Variable* var_orig = variables_[i];
             string newname = name_var_copy(var_orig);
             copy_and_add_variable(newname, var_orig, var_copies);
@@ -548,7 +752,8 @@ int ModelManager::assign_func_copy(const string &name, const string &orig)
 
 int ModelManager::add_func(Function* func)
 {
-    func->update_var_indices(variables_);
+    func->update_var_indices(variables_, &var_index_);
+    deps_dirty_ = true;
     // if there is already function with the same name -- replace
     int nr = find_function_nr(func->name);
     if (nr != -1) {
@@ -558,6 +763,7 @@ int ModelManager::add_func(Function* func)
         ctx_->msg("%" + func->name + " replaced.");
     } else {
         nr = functions_.size();
+        func_index_[func->name] = nr;
         functions_.push_back(func);
         ctx_->msg("%" + func->name + " created.");
     }
@@ -596,7 +802,7 @@ void ModelManager::substitute_func_param(const string &name,
     int v_idx = vd->single_symbol() ? vd->code()[1]
                                     : make_variable(next_var_name(), vd);
     k->set_param_name(k->get_param_nr(param), variables_[v_idx]->name);
-    k->update_var_indices(variables_);
+    k->update_var_indices(variables_, &var_index_);
     remove_unreferred();
 }
 
@@ -636,9 +842,12 @@ void ModelManager::do_reset()
 {
     purge_all_elements(functions_);
     purge_all_elements(variables_);
+    var_index_.clear();
+    func_index_.clear();
     var_autoname_counter_ = 0;
     func_autoname_counter_ = 0;
     parameters_.clear();
+    deps_dirty_ = true;
     //don't delete models, they should unregister itself
     update_indices_in_models();
 }
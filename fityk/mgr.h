@@ -5,13 +5,16 @@
 #define FITYK_MGR_H_
 
 #include <map>
+#include <unordered_map>
 #include "fityk.h"
 #include "tplate.h" // Tplate::Ptr
+#include "profile.h"
 
 namespace fityk {
 
 class Variable;
 class Function;
+class IndexedVars;
 class BasicContext;
 class Model;
 struct FunctionSum;
@@ -72,9 +75,14 @@ public:
 
     /// calculate value and derivatives of all variables;
     /// do precomputations for all functions
+    /// (after the first call only the parts that depend on changed
+    /// parameters are recalculated)
     void use_parameters();
     void use_external_parameters(const std::vector<realt> &ext_param);
-    void put_new_parameters(const std::vector<realt> &aa);
+    void put_new_parameters(const std::vector<realt> &aa)
+                               { put_new_parameters(aa.data(), aa.size()); }
+    void put_new_parameters(const realt *aa, int n);
+    void put_new_parameter(int n, realt value);
     realt variation_of_a(int n, realt variat) const;
     std::vector<std::string>
         get_variable_references(const std::string &name) const;
@@ -82,6 +90,15 @@ public:
     void do_reset();
     std::vector<std::string> share_par_cmd(const std::string& par, bool share);
 
+    Profiler& profiler() { return profiler_; }
+    const Profiler& profiler() const { return profiler_; }
+    /// returns NULL if the profiling option is not set
+    Profiler* active_profiler();
+
+    /// adds approximate memory (in bytes) taken by parameters, variables
+    /// and functions (with cached values) to *cache and by bytecode to *code
+    void count_memory(size_t* cache, size_t* code) const;
+
     std::string next_var_name(); ///generate name for "anonymous" variable
     std::string next_func_name(); ///generate name for "anonymous" function
 
@@ -95,6 +112,27 @@ private:
     std::vector<Function*> functions_;
     int var_autoname_counter_; ///for names for "anonymous" variables
     int func_autoname_counter_; ///for names for "anonymous" functions
+    /// name -> index in variables_, updated with each change of variables_
+    std::unordered_map<std::string, int> var_index_;
+    /// name -> index in functions_, updated with each change of functions_
+    std::unordered_map<std::string, int> func_index_;
+
+    // Dependency graph used in use_external_parameters() to recalculate
+    // only variables and functions that depend on changed parameters.
+    // After any change of variables or functions (deps_dirty_) everything
+    // is recalculated; the graph is built when it is needed first time.
+    bool deps_dirty_;
+    bool graph_ready_;
+    /// parameters used in the last call to use_external_parameters()
+    std::vector<realt> used_parameters_;
+    /// indices of variables that depend on parameter p, ascending, are
+    /// par_var_list_[par_var_start_[p]] ...
+    /// par_var_list_[par_var_start_[p+1]-1]
+    std::vector<int> par_var_start_, par_var_list_;
+    /// the same for functions
+    std::vector<int> par_func_start_, par_func_list_;
+    std::vector<bool> var_mark_, func_mark_; // used in recalculate_changed()
+    Profiler profiler_;
 
     int add_variable(Variable* new_var, bool old_domain);
     void sort_variables();
@@ -103,12 +141,20 @@ private:
                               const std::map<int,std::string>& varmap);
     int add_func(Function* func);
     //std::string get_or_make_variable(const std::string& func);
-    bool is_variable_referred(int i, std::string *first_referrer = NULL);
+    std::vector<int> count_references() const;
+    std::string find_referrer(int i, const std::vector<bool>& removed) const;
+    std::vector<bool> find_dependencies(const IndexedVars& uv) const;
+    void erase_variables(const std::vector<bool>& removed);
+    void erase_functions(const std::vector<bool>& removed);
+    void index_variables();
+    void index_functions();
     void reindex_all();
     std::string name_var_copy(const Variable* v);
     void update_indices(FunctionSum& sum);
     void eval_tilde(std::vector<int>::iterator op,
                     std::vector<int>& code, const std::vector<realt>& nums);
+    void build_dependency_graph();
+    void recalculate_changed(const std::vector<realt> &ext_param);
 
 };
 
@@ -39,15 +39,26 @@ void Model::clear()
 
 /// checks if this model depends on the variable with index idx
 bool Model::is_dependent_on_var(int idx) const
+{
+    return var_dependency_mask()[idx];
+}
+
+vector<bool> Model::var_dependency_mask() const
 {
     const vector<Variable*>& vv = mgr_.variables();
+    vector<bool> mask(vv.size(), false);
     v_foreach (int, i, ff_.idx)
-        if (mgr_.get_function(*i)->used_vars().depends_on(idx, vv))
-            return true;
+        v_foreach (int, j, mgr_.get_function(*i)->used_vars().indices())
+            mask[*j] = true;
     v_foreach (int, i, zz_.idx)
-        if (mgr_.get_function(*i)->used_vars().depends_on(idx, vv))
-            return true;
-    return false;
+        v_foreach (int, j, mgr_.get_function(*i)->used_vars().indices())
+            mask[*j] = true;
+    // variables used by vv[i] have indices < i
+    for (int i = size(vv) - 1; i >= 0; --i)
+        if (mask[i])
+            v_foreach (int, j, vv[i]->used_vars().indices())
+                mask[*j] = true;
+    return mask;
 }
 
 realt Model::value(realt x) const
@@ -70,13 +81,20 @@ realt Model::zero_shift(realt x) const
 void Model::compute_model(vector<realt> &x, vector<realt> &y,
                           int ignore_func) const
 {
+    Profiler* prof = mgr_.active_profiler();
     // add x-correction to x
-    v_foreach (int, i, zz_.idx)
-        mgr_.get_function(*i)->calculate_value(x, x);
+    v_foreach (int, i, zz_.idx) {
+        const Function* f = mgr_.get_function(*i);
+        ScopedProfile sp(prof ? &prof->function_value(f) : NULL, x.size());
+        f->calculate_value(x, x);
+    }
     // add y-value to y
     v_foreach (int, i, ff_.idx)
-        if (*i != ignore_func)
-            mgr_.get_function(*i)->calculate_value(x, y);
+        if (*i != ignore_func) {
+            const Function* f = mgr_.get_function(*i);
+            ScopedProfile sp(prof ? &prof->function_value(f) : NULL, x.size());
+            f->calculate_value(x, y);
+        }
 }
 
 // returns y values in y, x is changed in place to x+Z,
@@ -93,15 +111,25 @@ void Model::compute_model_with_derivs(vector<realt> &x, vector<realt> &y,
         return;
     fill (dy_da.begin(), dy_da.end(), 0);
 
+    Profiler* prof = mgr_.active_profiler();
     // add x-correction to x
-    v_foreach (int, i, zz_.idx)
-        mgr_.get_function(*i)->calculate_value(x, x);
+    v_foreach (int, i, zz_.idx) {
+        const Function* f = mgr_.get_function(*i);
+        ScopedProfile sp(prof ? &prof->function_value(f) : NULL, x.size());
+        f->calculate_value(x, x);
+    }
 
     // calculate value and derivatives
-    v_foreach (int, i, ff_.idx)
-        mgr_.get_function(*i)->calculate_value_deriv(x, y, dy_da, false);
-    v_foreach (int, i, zz_.idx)
-        mgr_.get_function(*i)->calculate_value_deriv(x, y, dy_da, true);
+    v_foreach (int, i, ff_.idx) {
+        const Function* f = mgr_.get_function(*i);
+        ScopedProfile sp(prof ? &prof->function_deriv(f) : NULL, x.size());
+        f->calculate_value_deriv(x, y, dy_da, false);
+    }
+    v_foreach (int, i, zz_.idx) {
+        const Function* f = mgr_.get_function(*i);
+        ScopedProfile sp(prof ? &prof->function_deriv(f) : NULL, x.size());
+        f->calculate_value_deriv(x, y, dy_da, true);
+    }
 }
 
 realt Model::calculate_value_and_deriv(realt x, vector<realt> &dy_da) const
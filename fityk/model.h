@@ -69,6 +69,8 @@ public:
 
     realt numarea(realt x1, realt x2, int nsteps) const;
     bool is_dependent_on_var(int idx) const;
+    /// mask of variables on which this model depends (directly or not)
+    std::vector<bool> var_dependency_mask() const;
     int max_param_pos() const;
     realt calculate_value_and_deriv(realt x, std::vector<realt> &dy_da) const;
 
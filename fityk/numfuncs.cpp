@@ -19,7 +19,7 @@ template<typename T>
 typename vector<T>::iterator
 get_interpolation_segment(vector<T> &bb,  double x)
 {
-    static size_t hint = 0;
+    thread_local size_t hint = 0; // per-thread, it is only a hint
     assert (size(bb) > 1);
     // when outside of the range, use the first or the last segment
     if (x <= bb[1].x) {
@@ -54,6 +54,45 @@ get_interpolation_segment(vector<T> &bb,  double x)
 template vector<PointD>::iterator
 get_interpolation_segment<PointD>(vector<PointD> &bb,  double x);
 
+// guess from step arithmetic is corrected if it is off by a few points
+static const int kMaxStepCorrection = 3;
+
+int lower_bound_idx(const vector<Point>& pp, double x, double step)
+{
+    const int n = pp.size();
+    if (step > 0 && n > 0 && is_finite(x)) {
+        double t = ceil((x - pp[0].x) / step);
+        int i = t <= 0 ? 0 : (t >= n ? n : (int) t);
+        for (int k = 0; k <= kMaxStepCorrection; ++k) {
+            if (i > 0 && !(pp[i-1].x < x))
+                --i;
+            else if (i < n && pp[i].x < x)
+                ++i;
+            else
+                return i;
+        }
+    }
+    return lower_bound(pp.begin(), pp.end(), Point(x, 0)) - pp.begin();
+}
+
+int upper_bound_idx(const vector<Point>& pp, double x, double step)
+{
+    const int n = pp.size();
+    if (step > 0 && n > 0 && is_finite(x)) {
+        double t = floor((x - pp[0].x) / step) + 1;
+        int i = t <= 0 ? 0 : (t >= n ? n : (int) t);
+        for (int k = 0; k <= kMaxStepCorrection; ++k) {
+            if (i > 0 && pp[i-1].x > x)
+                --i;
+            else if (i < n && !(pp[i].x > x))
+                ++i;
+            else
+                return i;
+        }
+    }
+    return upper_bound(pp.begin(), pp.end(), Point(x, 0)) - pp.begin();
+}
+
 void prepare_spline_interpolation (vector<PointQ> &bb)
 {
     //first wroten for bb interpolation, then generalized
@@ -122,11 +161,9 @@ double get_linear_interpolation(vector<PointD> &bb, double x)
 static const double TINY = 1e-12; //only for rand_gauss() and rand_cauchy()
 
 /// normal distribution, mean=0, variance=1
-double rand_gauss()
+double RandomGenerator::rand_gauss()
 {
-    static bool is_saved = false;
-    static double saved;
-    if (!is_saved) {
+    if (!has_saved_) {
         double rsq, x1, x2;
         while(1) {
             x1 = rand_1_1();
@@ -136,16 +173,16 @@ double rand_gauss()
                 break;
         }
         double f = sqrt(-2. * log(rsq) / rsq);
-        saved = x1 * f;
-        is_saved = true;
+        saved_ = x1 * f;
+        has_saved_ = true;
         return x2 * f;
     } else {
-        is_saved = false;
-        return saved;
+        has_saved_ = false;
+        return saved_;
     }
 }
 
-double rand_cauchy()
+double RandomGenerator::rand_cauchy()
 {
     while (1) {
         double x1 = rand_1_1();
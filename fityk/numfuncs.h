@@ -5,6 +5,7 @@
 #define FITYK_NUMFUNCS_H_
 
 #include <stdlib.h>
+#include <random>
 #include "fityk.h"
 #include "common.h" // S
 
@@ -46,13 +47,36 @@ FITYK_API double get_spline_interpolation(std::vector<PointQ> &bb, double x);
 FITYK_API double get_linear_interpolation(std::vector<PointD> &bb, double x);
 FITYK_API double get_linear_interpolation(std::vector<PointQ> &bb, double x);
 
-// random number utilities
-inline double rand_1_1() { return 2.0 * rand() / RAND_MAX - 1.; }
-inline double rand_0_1() { return static_cast<double>(rand()) / RAND_MAX; }
-inline double rand_uniform(double a, double b) { return a + rand_0_1()*(b-a); }
-inline bool rand_bool() { return rand() < RAND_MAX / 2; }
-double rand_gauss();
-double rand_cauchy();
+/// The same as std::lower_bound() and std::upper_bound() for x in sorted
+/// points, returns index. If the points are evenly spaced with given step,
+/// the index is calculated in O(1). step is only a hint, it can be 0
+/// (binary search is used then) or inexact.
+FITYK_API int lower_bound_idx(const std::vector<Point>& pp, double x,
+                              double step);
+FITYK_API int upper_bound_idx(const std::vector<Point>& pp, double x,
+                              double step);
+
+/// Pseudo-random number generator. Each engine (class Full) has own instance,
+/// seeded in SettingsMgr::do_srand(), so independent engines can run
+/// in parallel threads and give reproducible results.
+class FITYK_API RandomGenerator
+{
+public:
+    RandomGenerator() : has_saved_(false), saved_(0.) {}
+    void seed(unsigned int s) { engine_.seed(s); has_saved_ = false; }
+    double rand_0_1() { return static_cast<double>(engine_()) / engine_.max(); }
+    double rand_1_1() { return 2.0 * rand_0_1() - 1.; }
+    double rand_uniform(double a, double b) { return a + rand_0_1()*(b-a); }
+    bool rand_bool() { return engine_() < engine_.max() / 2; }
+    /// random integer from [0, n)
+    int rand_int(int n) { return static_cast<int>(engine_() % n); }
+    double rand_gauss();
+    double rand_cauchy();
+private:
+    std::mt19937 engine_;
+    bool has_saved_; // rand_gauss() generates numbers in pairs
+    double saved_;
+};
 
 // very simple matrix utils
 void jordan_solve(std::vector<realt>& A, std::vector<realt>& b, int n);
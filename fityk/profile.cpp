@@ -0,0 +1,82 @@
+// This file is part of fityk program. Copyright 2001-2013 Marcin Wojdyr
+// Licence: GNU General Public License ver. 2+
+
+#define BUILDING_LIBFITYK
+#include "profile.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "func.h"
+
+using namespace std;
+
+namespace fityk {
+
+double Profiler::now()
+{
+    typedef chrono::steady_clock clock;
+    return chrono::duration<double>(clock::now().time_since_epoch()).count();
+}
+
+void Profiler::clear()
+{
+    for (int i = 0; i != kPhaseCount; ++i)
+        phases_[i] = ProfileCounter();
+    functions_.clear();
+}
+
+Profiler::FunctionStats& Profiler::function_stats(const Function* f)
+{
+    FunctionStats& stats = functions_[f->name];
+    if (stats.type.empty())
+        stats.type = f->tp()->name;
+    return stats;
+}
+
+static string counter_row(const string& name, const ProfileCounter& c)
+{
+    char buf[128];
+    snprintf(buf, sizeof(buf), "\n%-24s %10ld %13ld %10.4f",
+             name.c_str(), c.calls, c.points, c.seconds);
+    return buf;
+}
+
+string Profiler::report() const
+{
+    ProfileCounter value, deriv;
+    typedef pair<double, string> Entry; // total time, formatted rows
+    vector<Entry> entries;
+    for (const auto& i : functions_) {
+        const FunctionStats& fs = i.second;
+        value.calls += fs.value.calls;
+        value.points += fs.value.points;
+        value.seconds += fs.value.seconds;
+        deriv.calls += fs.deriv.calls;
+        deriv.points += fs.deriv.points;
+        deriv.seconds += fs.deriv.seconds;
+        string name = "%" + i.first + " (" + fs.type + ")";
+        string rows;
+        if (fs.value.calls != 0)
+            rows += counter_row(name + " value", fs.value);
+        if (fs.deriv.calls != 0)
+            rows += counter_row(name + " deriv", fs.deriv);
+        entries.push_back(Entry(fs.value.seconds + fs.deriv.seconds, rows));
+    }
+    string s = "phase                         calls        points   time [s]";
+    s += counter_row("precomputation", phases_[kPrecomputation]);
+    s += counter_row("function values", value);
+    s += counter_row("derivatives", deriv);
+    s += counter_row("J^T J", phases_[kJacobian]);
+    s += counter_row("linear solve", phases_[kSolve]);
+    if (!entries.empty()) {
+        sort(entries.begin(), entries.end(), greater<Entry>());
+        s += "\nfunction";
+        for (const Entry& e : entries)
+            s += e.second;
+    }
+    return s;
+}
+
+} // namespace fityk
@@ -0,0 +1,77 @@
+// This file is part of fityk program. Copyright 2001-2013 Marcin Wojdyr
+// Licence: GNU General Public License ver. 2+
+
+#ifndef FITYK_PROFILE_H_
+#define FITYK_PROFILE_H_
+
+#include <string>
+#include <unordered_map>
+#include "fityk.h" // FITYK_API
+
+namespace fityk {
+
+class Function;
+
+struct FITYK_API ProfileCounter
+{
+    long calls;
+    long points;
+    double seconds;
+
+    ProfileCounter() : calls(0), points(0), seconds(0.) {}
+    void add(int n, double t) { ++calls; points += n; seconds += t; }
+};
+
+/// Statistics of model evaluation, collected when the profiling option
+/// is set, and reported by "info profile".
+class FITYK_API Profiler
+{
+public:
+    enum Phase
+    {
+        kPrecomputation, // calculation of variables and function parameters
+        kJacobian,       // accumulation of J^T J in Levenberg-Marquardt
+        kSolve,          // solving linear system in Levenberg-Marquardt
+        kPhaseCount
+    };
+
+    static double now(); // wall-clock time in seconds
+
+    ProfileCounter& phase(Phase p) { return phases_[p]; }
+    ProfileCounter& function_value(const Function* f)
+                                { return function_stats(f).value; }
+    ProfileCounter& function_deriv(const Function* f)
+                                { return function_stats(f).deriv; }
+    void clear();
+    std::string report() const;
+
+private:
+    struct FunctionStats
+    {
+        std::string type;
+        ProfileCounter value, deriv;
+    };
+    ProfileCounter phases_[kPhaseCount];
+    std::unordered_map<std::string, FunctionStats> functions_;
+
+    FunctionStats& function_stats(const Function* f);
+};
+
+/// adds the time elapsed from construction to destruction to the counter,
+/// does nothing if the counter is NULL
+class ScopedProfile
+{
+public:
+    ScopedProfile(ProfileCounter* counter, int points)
+        : counter_(counter), points_(points),
+          start_(counter ? Profiler::now() : 0.) {}
+    ~ScopedProfile()
+        { if (counter_) counter_->add(points_, Profiler::now() - start_); }
+private:
+    ProfileCounter* counter_;
+    int points_;
+    double start_;
+};
+
+} // namespace fityk
+#endif // FITYK_PROFILE_H_
@@ -4,6 +4,7 @@
 #define BUILDING_LIBFITYK
 #include "runner.h"
 
+#include <sys/stat.h>
 #include <algorithm>  // for sort
 #include <memory>  // for unique_ptr
 
@@ -66,6 +67,8 @@ void Runner::command_set(const vector<Token>& args)
             sm->set_as_number(key, args[i].value.d);
         else
             sm->set_as_string(key, Lexer::get_string(args[i]));
+        if (key == "profiling") // each (re)start of profiling starts afresh
+            F_->mgr.profiler().clear();
     }
 }
 
@@ -310,7 +313,31 @@ void Runner::command_dataset_tr(const vector<Token>& args)
     ep_.parse_expr(lex, F_->dk.default_idx(), NULL, NULL,
                    ExpressionParser::kDatasetTrMode);
 
-    if (n == Lexer::kNew) {
+    // each dataset in the expression is copied,
+    // with @* at LHS - once for each dataset
+    const vector<int>& code = ep_.vm().code();
+    double extra = 0;
+    for (size_t i = 0; i < code.size(); ++i)
+        if (VMData::has_idx(code[i])) {
+            ++i;
+            if (code[i-1] != OP_DATASET)
+                continue;
+            if (code[i] == Lexer::kAll) {
+                // spilled datasets are not loaded here
+                for (int k = 0; k != F_->dk.count(); ++k)
+                    extra += F_->dk.point_count(k) * sizeof(Point);
+            } else if (n == Lexer::kAll)
+                extra += F_->dk.count() *
+                         F_->dk.data(code[i])->points().size() * sizeof(Point);
+            else
+                extra += F_->dk.data(code[i])->points().size() * sizeof(Point);
+        }
+    F_->check_memory_budget(extra, "dataset transformation");
+
+    if (n == Lexer::kAll)
+        run_data_transform_for_all(F_->dk, ep_.vm(),
+                                   F_->get_settings()->max_data_memory * 1e6);
+    else if (n == Lexer::kNew) {
         unique_ptr<Data> data_out(new Data(F_, F_->mgr.create_model()));
         run_data_transform(F_->dk, ep_.vm(), data_out.get());
         F_->dk.append(data_out.release());
@@ -612,6 +639,23 @@ void Runner::command_change_model(const vector<Token>& args, int ds)
     F_->outdated_plot();
 }
 
+// returns 0 if the file is not found;
+// the path can end with column and block indices, e.g. "foo.dat:1:2::"
+static
+double data_file_size(string path)
+{
+    struct stat st;
+    for (int i = 0; i <= 4; ++i) {
+        if (stat(path.c_str(), &st) == 0)
+            return st.st_size;
+        string::size_type pos = path.rfind(':');
+        if (pos == string::npos)
+            break;
+        path.resize(pos);
+    }
+    return 0.;
+}
+
 void Runner::command_load(const vector<Token>& args)
 {
     int dataset = args[0].value.i;
@@ -637,6 +681,9 @@ void Runner::command_load(const vector<Token>& args)
             while (++it != args.end())
                 options += (options.empty() ? "" : " ") + it->as_string();
         }
+        // points in memory and the copy cached by xylib take together
+        // roughly twice the size of a typical text data file
+        F_->check_memory_budget(2. * data_file_size(filename), "load");
         F_->dk.import_dataset(dataset, filename, format, options, F_, F_->mgr);
         if (F_->dk.count() == 1) {
             RealRange r; // default value: [:]
@@ -656,6 +703,9 @@ void Runner::command_all_points_tr(const vector<Token>& args, int ds)
         ep_.push_assign_lhs(args[i]);
     }
     Data *data = F_->dk.data(ds);
+    // transform_data() works on a copy of points
+    F_->check_memory_budget(data->points().size() * sizeof(Point),
+                            "transformation");
     ep_.transform_data(data->get_mutable_points());
     data->after_transform();
     F_->outdated_plot();
@@ -833,8 +883,13 @@ void Runner::recalculate_command(Command& c, int ds, Statement& st)
             c.type == kCmdDatasetTr)
         return;
 
+    recalculate_args(c.args, ds, st);
+}
+
+void Runner::recalculate_args(vector<Token>& args, int ds, Statement& st)
+{
     const vector<Point>& points = F_->dk.data(ds)->points();
-    for (Token& t : c.args)
+    for (Token& t : args)
         if (t.type == kTokenExpr) {
             Lexer lex(t.str);
             ep_.clear_vm();
@@ -850,12 +905,14 @@ void Runner::recalculate_command(Command& c, int ds, Statement& st)
 
 // Execute the last parsed string.
 // Throws ExecuteError, ExitRequestedException.
-void Runner::execute_statement(Statement& st)
+void Runner::execute_statement(Statement& st, bool reused)
 {
     unique_ptr<Settings> s_orig;
     vdlist_ = &st.vdlist;
     try {
         if (!st.with_args.empty()) {
+            if (reused)
+                recalculate_args(st.with_args, st.datasets[0], st);
             s_orig.reset(new Settings(*F_->get_settings()));
             command_set(st.with_args);
         }
@@ -867,7 +924,8 @@ void Runner::execute_statement(Statement& st)
                 // We need to re-evaluate it for all but the first dataset,
                 // and also if it is preceded by other command or by "with"
                 // (e.g. epsilon can change the result)
-                if (!first || !st.with_args.empty())
+                // Cached statements were parsed in a different context.
+                if (!first || !st.with_args.empty() || reused)
                     recalculate_command(c, ds, st);
                 first = false;
 
@@ -907,6 +965,11 @@ void Runner::execute_statement(Statement& st)
                     execute_command(c, ds);
                 }
             }
+            // datasets not used recently can be moved out of memory
+            // between statements and when looping over datasets (@*: ...)
+            double max_mem = F_->get_settings()->max_data_memory;
+            if (max_mem > 0)
+                F_->dk.limit_memory(max_mem * 1e6);
         }
     }
     catch (...) {
@@ -919,11 +982,80 @@ void Runner::execute_statement(Statement& st)
 }
 
 
+// Statements that change the parsing context or contain nested commands
+// (that may use the same cached statement) are not cached.
+static
+bool is_cacheable(const Statement& st)
+{
+    for (const Command& c : st.commands)
+        if (c.type == kCmdDefine || c.type == kCmdUndef ||
+                c.type == kCmdReset || c.type == kCmdExec ||
+                c.type == kCmdLua)
+            return false;
+    return true;
+}
+
 void CommandExecutor::raw_execute_line(const string& str)
 {
     Lexer lex(str.c_str());
-    while (parser_.parse_statement(lex))
+    if (lex.peek_token().type == kTokenNop)
+        return;
+    vector<int> datasets;
+    parser_.parse_datasets(lex, datasets);
+    string body = strip_string(lex.pchar());
+
+    auto it = statement_cache_.find(body);
+    if (it != statement_cache_.end()) {
+        Statement& st = it->second->st;
+        st.datasets = datasets;
+        runner_.execute_statement(st, /*reused=*/true);
+        return;
+    }
+
+    unique_ptr<CachedStatement> cs(new CachedStatement);
+    cs->text = body;
+    Lexer body_lex(cs->text.c_str());
+    try {
+        parser_.parse_statement_body(body_lex, datasets);
+    } catch (SyntaxError&) {
+        // parse the whole line again to report the error position
+        // relative to the line, not to the body
+        parser_.parse_statement_body(lex, datasets);
+        throw;
+    }
+    if (!is_cacheable(parser_.statement())) {
+        bool changes_context = false;
+        for (const Command& c : parser_.statement().commands)
+            if (c.type == kCmdDefine || c.type == kCmdUndef)
+                changes_context = true;
+        // cs->text must be alive during the execution
         runner_.execute_statement(parser_.statement());
+        if (changes_context)
+            clear_statement_cache();
+        return;
+    }
+    if (statement_cache_.size() >= kMaxCachedStatements)
+        clear_statement_cache();
+    cs->st = parser_.statement();
+    Statement& st = cs->st;
+    statement_cache_[body] = std::move(cs);
+    runner_.execute_statement(st);
+}
+
+size_t CommandExecutor::statement_cache_memory() const
+{
+    size_t bytes = 0;
+    for (const auto& i : statement_cache_) {
+        const Statement& st = i.second->st;
+        bytes += sizeof(CachedStatement) + 2 * i.first.capacity()
+                 + st.datasets.capacity() * sizeof(int)
+                 + st.with_args.capacity() * sizeof(Token);
+        for (const Command& c : st.commands)
+            bytes += sizeof(Command) + c.args.capacity() * sizeof(Token);
+        for (const VMData& vd : st.vdlist)
+            bytes += sizeof(VMData) + vd.memory_usage();
+    }
+    return bytes;
 }
 
 
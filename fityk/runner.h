@@ -5,6 +5,8 @@
 #define FITYK_RUNNER_H_
 
 #include <vector>
+#include <map>
+#include <memory>
 #include "lexer.h" // Token, TokenType
 #include "fityk.h" // RealRange
 #include "common.h" // DISALLOW_COPY_AND_ASSIGN
@@ -30,7 +32,9 @@ public:
     // Throws ExecuteError, ExitRequestedException.
     // The statement is not const, because expressions in it can be re-parsed 
     // when executing for multiple datasets.
-    void execute_statement(Statement& st);
+    // If reused is true, the statement was parsed earlier (it's cached)
+    // and all expressions must be re-evaluated.
+    void execute_statement(Statement& st, bool reused=false);
 
 private:
     Full* F_;
@@ -58,6 +62,7 @@ private:
     void command_name_var(const std::vector<Token>& args, int ds);
     void command_change_model(const std::vector<Token>& args, int ds);
     void recalculate_command(Command& c, int ds, Statement& st);
+    void recalculate_args(std::vector<Token>& args, int ds, Statement& st);
     int make_func_from_template(const std::string& name,
                                 const std::vector<Token>& args, int pos);
     VMData* get_vm_from_token(const Token& t) const;
@@ -70,17 +75,37 @@ private:
 class CommandExecutor
 {
 public:
+    // max. number of statements kept in the cache
+    static const int kMaxCachedStatements = 256;
+
     CommandExecutor(Full* F) : parser_(F), runner_(F) {}
 
     /// share parser -- it can be safely reused
     Parser* parser() { return &parser_; }
 
     // Calls Parser::parse_statement() and Runner::execute_statement().
+    // Parsed statements are cached, the key is the text after the dataset
+    // prefix, so e.g. "@1: fit" and "@2: fit" share one parsed statement.
     void raw_execute_line(const std::string& str);
 
+    // must be called when the parsing context changes (e.g. templates)
+    void clear_statement_cache() { statement_cache_.clear(); }
+    int cached_statement_count() const { return statement_cache_.size(); }
+    // approximate memory (in bytes) taken by the cache
+    size_t statement_cache_memory() const;
+
 private:
+    // Tokens in Statement point to the parsed text, so it's stored together.
+    struct CachedStatement
+    {
+        std::string text;
+        Statement st;
+    };
+
     Parser parser_;
     Runner runner_;
+    std::map<std::string, std::unique_ptr<CachedStatement> > statement_cache_;
+
     DISALLOW_COPY_AND_ASSIGN(CommandExecutor);
 };
 
@@ -8,6 +8,7 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <ctime> //time()
+#include <mutex> // call_once()
 #ifdef _WIN32
 #include <windows.h> // SetCurrentDirectoryA()
 #else
@@ -45,6 +46,7 @@ struct Option
     SettingsMgr::ValueType vtype;
     OptVal val;
     const char** allowed_values; // used only for kStringEnum
+    double min_value, max_value; // allowed range of kInt and kDouble
 };
 
 double epsilon = 1e-12; // declared in common.h
@@ -62,7 +64,12 @@ static const char* nm_distribution_enum[] =
 static const char* fit_method_enum[20] = { NULL };
 
 #define OPT(name, type, ini, allowed) \
-{ #name, SettingsMgr::type, OptVal(&Settings::name, ini), allowed }
+{ #name, SettingsMgr::type, OptVal(&Settings::name, ini), allowed, \
+  -HUGE_VAL, HUGE_VAL }
+
+// numeric option with values limited to [lo, hi]
+#define OPT_RANGE(name, type, ini, lo, hi) \
+{ #name, SettingsMgr::type, OptVal(&Settings::name, ini), NULL, lo, hi }
 
 static const Option options[] = {
     OPT(verbosity, kInt, 0, NULL),
@@ -76,6 +83,9 @@ static const Option options[] = {
     OPT(log_output, kBool, false, NULL),
     OPT(function_cutoff, kDouble, 0., NULL),
     OPT(cwd, kString, "", NULL),
+    OPT(max_data_memory, kDouble, 0., NULL),
+    OPT(memory_soft_limit, kDouble, 0., NULL),
+    OPT(profiling, kBool, false, NULL),
 
     OPT(height_correction, kDouble, 1., NULL),
     OPT(width_correction, kDouble, 1., NULL),
@@ -86,6 +96,9 @@ static const Option options[] = {
     OPT(max_fitting_time, kDouble, 0., NULL),
     OPT(refresh_period, kInt, 4, NULL),
     OPT(fit_replot, kBool, false, NULL),
+    OPT_RANGE(fit_coarse_levels, kInt, 0, 0, 10),
+    OPT(max_history_memory, kDouble, 256., NULL),
+    OPT(fit_trace, kString, "", NULL),
     OPT(domain_percent, kDouble, 30., NULL),
     OPT(box_constraints, kBool, true, NULL),
 
@@ -129,10 +142,14 @@ void change_current_working_dir(const char* path)
 }
 
 SettingsMgr::SettingsMgr(BasicContext const* ctx)
-    : ctx_(ctx)
+    : ctx_(ctx), cwd_locked_(false)
 {
-    for (int i = 0; FitManager::method_list[i][0]; ++i)
-        fit_method_enum[i] = FitManager::method_list[i][0];
+    // filled only once, SettingsMgr can be created in parallel threads
+    static std::once_flag fit_method_enum_flag;
+    std::call_once(fit_method_enum_flag, [] {
+        for (int i = 0; FitManager::method_list[i][0]; ++i)
+            fit_method_enum[i] = FitManager::method_list[i][0];
+    });
     size_t len = sizeof(options) / sizeof(options[0]);
     for (size_t i = 0; i != len; ++i) {
         const Option& opt = options[i];
@@ -228,6 +245,8 @@ void SettingsMgr::set_as_string(string const& k, string const& v)
                 throw ExecuteError("Exactly one `%' expected, e.g. '%.9g'");
             set_long_double_format(v);
         } else if (k == "cwd") {
+            if (cwd_locked_)
+                throw ExecuteError("cwd can't be changed in server mode.");
             change_current_working_dir(v.c_str());
         }
         m_.*opt.val.s.ptr = v;
@@ -253,6 +272,9 @@ void SettingsMgr::set_as_number(string const& k, double d)
     }
     const Option& opt = find_option(k);
     assert(opt.vtype == kInt || opt.vtype == kDouble || opt.vtype == kBool);
+    if (d < opt.min_value || d > opt.max_value)
+        throw ExecuteError(k + " must be in range [" + S(opt.min_value)
+                           + ", " + S(opt.max_value) + "].");
     if (opt.vtype == kInt) {
         m_.*opt.val.i.ptr = iround(d);
         if (k == "pseudo_random_seed")
@@ -262,6 +284,12 @@ void SettingsMgr::set_as_number(string const& k, double d)
             if (d <= 0.)
                 throw ExecuteError("Value of epsilon must be positive.");
             epsilon = d;
+        } else if (k == "max_data_memory" && d < 0) {
+            throw ExecuteError("max_data_memory can't be negative.");
+        } else if (k == "max_history_memory" && d < 0) {
+            throw ExecuteError("max_history_memory can't be negative.");
+        } else if (k == "memory_soft_limit" && d < 0) {
+            throw ExecuteError("memory_soft_limit can't be negative.");
         }
         m_.*opt.val.d.ptr = d;
     } else // if (opt.vtype == kBool)
@@ -281,9 +309,13 @@ SettingsMgr::ValueType SettingsMgr::get_value_type(const string& k)
 string SettingsMgr::get_type_desc(const string& k)
 {
     const Option& opt = find_option(k);
+    string range;
+    if (opt.min_value != -HUGE_VAL || opt.max_value != HUGE_VAL)
+        range = " in range [" + S(opt.min_value) + ", "
+                + S(opt.max_value) + "]";
     switch (opt.vtype) {
-        case kInt: return "integer number";
-        case kDouble: return "real number";
+        case kInt: return "integer number" + range;
+        case kDouble: return "real number" + range;
         case kBool: return "boolean (0/1)";
         case kString: return "'string'";
         case kEnum: {
@@ -318,7 +350,7 @@ void SettingsMgr::do_srand()
 {
     int seed = m_.pseudo_random_seed == 0 ? (int) time(NULL)
                                           : m_.pseudo_random_seed;
-    srand(seed);
+    ctx_->rng().seed(seed);
 #if HAVE_LIBNLOPT
     nlopt_srand(seed);
 #endif
@@ -24,6 +24,9 @@ struct FITYK_API Settings
     bool log_output;
     double function_cutoff;
     std::string cwd; // current working directory
+    double max_data_memory; // in MB, 0 = unlimited
+    double memory_soft_limit; // in MB, 0 = no warnings
+    bool profiling;
 
     // guess
     double height_correction;
@@ -36,6 +39,9 @@ struct FITYK_API Settings
     double max_fitting_time;
     int refresh_period;
     bool fit_replot;
+    int fit_coarse_levels;
+    double max_history_memory; // in MB, 0 = unlimited
+    std::string fit_trace; // JSON Lines file, empty = no trace
     double domain_percent;
     bool box_constraints;
     // fitting - LM
@@ -96,6 +102,10 @@ public:
     void set_as_string(const std::string& k, const std::string& v);
     void set_as_number(const std::string& k, double v);
     void set_all(const Settings& s) { m_ = s; epsilon = s.epsilon; }
+    /// makes option cwd read-only; cwd is process-wide, so it must not be
+    /// changed when a few engines run in the same process (cfityk --server)
+    void lock_cwd() { cwd_locked_ = true; }
+    bool cwd_locked() const { return cwd_locked_; }
 
     // utilities that use settings
     void do_srand();
@@ -108,6 +118,7 @@ private:
     const BasicContext* ctx_; // used for msg()
     Settings m_;
     std::string long_double_format_;
+    bool cwd_locked_;
 
     void set_long_double_format(const std::string& double_fmt);
     DISALLOW_COPY_AND_ASSIGN(SettingsMgr);
@@ -62,6 +62,28 @@ namespace std {
 // implementation, not api
 %ignore get_ftk;
 %ignore get_covariance_matrix_as_array;
+%ignore fityk::Fityk::load_data(int, const realt*, const realt*, const realt*,
+                                int, std::string const&);
+%ignore fityk::Fityk::load_data(int, const realt*, const realt*, const realt*,
+                                int);
+%ignore fityk::Fityk::add_points(const realt*, const realt*, const realt*,
+                                 int, int, int);
+%ignore fityk::Fityk::add_points(const realt*, const realt*, const realt*,
+                                 int, int);
+%ignore fityk::Fityk::add_points(const realt*, const realt*, const realt*,
+                                 int);
+%ignore fityk::Fityk::set_parameters(const realt*, int);
+%ignore fityk::Fityk::get_parameters;
+// wrapped below as *_into() methods that take arrays (Python) or tables (Lua)
+%ignore fityk::Fityk::get_model_values;
+%ignore fityk::Fityk::get_data_column;
+%ignore fityk::Func::values_at;
+// the callback is called from another thread, not supported in bindings
+%ignore fityk::Fityk::start_fit;
+%ignore fityk::FitJob;
+%ignore fityk::FitProgress;
+%ignore fityk::FitResult;
+%ignore fityk::Fityk::set_fit_trace_callback;
 
 #if defined(SWIGLUA) || defined(SWIGJAVA)
     namespace std
@@ -102,6 +124,71 @@ namespace std {
         lua_pushstring(L,$1.what()); SWIG_fail;
     }
 
+    // Typed access to model and data. The tables are read and filled
+    // in place, so no RealVector proxies are created.
+    %{
+    static int lua_table_length(SWIGLUA_TABLE t)
+    {
+    #if LUA_VERSION_NUM >= 502
+        return (int) lua_rawlen(t.L, t.idx);
+    #else
+        return (int) lua_objlen(t.L, t.idx);
+    #endif
+    }
+
+    static void lua_table_to_vector(SWIGLUA_TABLE t, std::vector<double>& v)
+    {
+        v.resize(lua_table_length(t));
+        for (size_t i = 0; i != v.size(); ++i) {
+            lua_rawgeti(t.L, t.idx, (int) i + 1);
+            v[i] = lua_tonumber(t.L, -1);
+            lua_pop(t.L, 1);
+        }
+    }
+
+    static void vector_to_lua_table(const std::vector<double>& v,
+                                    SWIGLUA_TABLE t)
+    {
+        for (size_t i = 0; i != v.size(); ++i) {
+            lua_pushnumber(t.L, v[i]);
+            lua_rawseti(t.L, t.idx, (int) i + 1);
+        }
+    }
+    %}
+
+    %extend fityk::Fityk {
+        // fills table y with model values at points from table x
+        void get_model_values_into(SWIGLUA_TABLE x, SWIGLUA_TABLE y,
+                                   int dataset=fityk::DEFAULT_DATASET)
+                                                throw(fityk::ExecuteError) {
+            std::vector<double> xx, yy;
+            lua_table_to_vector(x, xx);
+            yy.resize(xx.size());
+            self->get_model_values(dataset, xx.data(), yy.data(),
+                                   (int) xx.size());
+            vector_to_lua_table(yy, y);
+        }
+
+        // fills table out with column ('x', 'y', 's' or 'a') of dataset
+        void get_data_column_into(char column, SWIGLUA_TABLE out,
+                                  int dataset=fityk::DEFAULT_DATASET)
+                                                throw(fityk::ExecuteError) {
+            std::vector<double> v(self->get_data(dataset).size());
+            self->get_data_column(dataset, column, v.data(), (int) v.size());
+            vector_to_lua_table(v, out);
+        }
+    }
+
+    %extend fityk::Func {
+        void values_at_into(SWIGLUA_TABLE x, SWIGLUA_TABLE y) {
+            std::vector<double> xx, yy;
+            lua_table_to_vector(x, xx);
+            yy.resize(xx.size());
+            self->values_at(xx.data(), yy.data(), (int) xx.size());
+            vector_to_lua_table(yy, y);
+        }
+    }
+
     %typemap(in) FILE * {
         FILE **f;
         if (lua_isnil(L, $input))
@@ -206,6 +293,169 @@ namespace std {
     }
 
     %include "ui_api.h"
+
+    // Loads data from objects supporting the buffer protocol
+    // (numpy.float64 arrays, array.array('d'), ...) without converting
+    // them to lists.
+    %{
+    static double* get_double_buffer(PyObject *obj, Py_buffer *view,
+                                     Py_ssize_t *len, bool writable=false)
+    {
+        int flags = PyBUF_C_CONTIGUOUS | PyBUF_FORMAT;
+        if (writable)
+            flags |= PyBUF_WRITABLE;
+        if (PyObject_GetBuffer(obj, view, flags) != 0)
+            return NULL;
+        if (view->itemsize != sizeof(double) || view->format == NULL ||
+                (strcmp(view->format, "d") != 0 &&
+                 strcmp(view->format, "=d") != 0 &&
+                 strcmp(view->format, "<d") != 0 &&
+                 strcmp(view->format, "@d") != 0)) {
+            PyBuffer_Release(view);
+            PyErr_SetString(PyExc_TypeError,
+                            "expected contiguous array of float64");
+            return NULL;
+        }
+        *len = view->len / view->itemsize;
+        return (double*) view->buf;
+    }
+
+    // raises fityk.ExecuteError, as the wrappers of API methods do
+    static void raise_execute_error(const fityk::ExecuteError& e)
+    {
+        SWIG_Python_Raise(SWIG_NewPointerObj(new fityk::ExecuteError(e),
+                                             SWIGTYPE_p_fityk__ExecuteError,
+                                             SWIG_POINTER_OWN),
+                          "fityk::ExecuteError",
+                          SWIGTYPE_p_fityk__ExecuteError);
+    }
+
+    // calls f(x, out, n) with x and out obtained from buffers of equal size
+    template<typename F>
+    static PyObject* fill_buffer_from_buffer(PyObject *x, PyObject *out, F f)
+    {
+        Py_buffer xv, ov;
+        Py_ssize_t nx, no;
+        const double *xp = get_double_buffer(x, &xv, &nx);
+        if (xp == NULL)
+            return NULL;
+        double *op = get_double_buffer(out, &ov, &no, true);
+        if (op == NULL) {
+            PyBuffer_Release(&xv);
+            return NULL;
+        }
+        PyObject *ret = Py_None;
+        if (nx != no) {
+            PyErr_SetString(PyExc_ValueError, "arrays of different sizes");
+            ret = NULL;
+        } else {
+            try {
+                f(xp, op, (int) nx);
+            } catch (const fityk::ExecuteError& e) {
+                raise_execute_error(e);
+                ret = NULL;
+            } catch (const std::exception& e) {
+                PyErr_SetString(PyExc_RuntimeError, e.what());
+                ret = NULL;
+            }
+        }
+        PyBuffer_Release(&xv);
+        PyBuffer_Release(&ov);
+        Py_XINCREF(ret);
+        return ret;
+    }
+    %}
+
+    %extend fityk::Fityk {
+        PyObject* load_data_from_buffers(int dataset, PyObject *x,
+                                         PyObject *y, PyObject *sigma,
+                                         std::string const& title="") {
+            Py_buffer xv, yv, sv;
+            Py_ssize_t nx, ny, ns;
+            const double *xp = get_double_buffer(x, &xv, &nx);
+            if (xp == NULL)
+                return NULL;
+            const double *yp = get_double_buffer(y, &yv, &ny);
+            if (yp == NULL) {
+                PyBuffer_Release(&xv);
+                return NULL;
+            }
+            const double *sp = NULL;
+            if (sigma != Py_None) {
+                sp = get_double_buffer(sigma, &sv, &ns);
+                if (sp == NULL) {
+                    PyBuffer_Release(&xv);
+                    PyBuffer_Release(&yv);
+                    return NULL;
+                }
+            }
+            PyObject *ret = Py_None;
+            if (nx != ny || (sp != NULL && ns != ny)) {
+                PyErr_SetString(PyExc_ValueError, "arrays of different sizes");
+                ret = NULL;
+            } else {
+                try {
+                    self->load_data(dataset, xp, yp, sp, (int) ny, title);
+                } catch (const fityk::ExecuteError& e) {
+                    raise_execute_error(e);
+                    ret = NULL;
+                } catch (const std::exception& e) {
+                    PyErr_SetString(PyExc_RuntimeError, e.what());
+                    ret = NULL;
+                }
+            }
+            PyBuffer_Release(&xv);
+            PyBuffer_Release(&yv);
+            if (sp != NULL)
+                PyBuffer_Release(&sv);
+            Py_XINCREF(ret);
+            return ret;
+        }
+
+        // writes model values at points from array x to array out
+        PyObject* get_model_values_into(PyObject *x, PyObject *out,
+                                  int dataset=fityk::DEFAULT_DATASET) {
+            fityk::Fityk *f = self;
+            return fill_buffer_from_buffer(x, out,
+                    [f, dataset](const double* xp, double* op, int n) {
+                        f->get_model_values(dataset, xp, op, n);
+                    });
+        }
+
+        // writes column ('x', 'y', 's' or 'a') of dataset to array out
+        PyObject* get_data_column_into(char column, PyObject *out,
+                                  int dataset=fityk::DEFAULT_DATASET) {
+            Py_buffer ov;
+            Py_ssize_t n;
+            double *op = get_double_buffer(out, &ov, &n, true);
+            if (op == NULL)
+                return NULL;
+            PyObject *ret = Py_None;
+            try {
+                self->get_data_column(dataset, column, op, (int) n);
+            } catch (const fityk::ExecuteError& e) {
+                raise_execute_error(e);
+                ret = NULL;
+            } catch (const std::exception& e) {
+                PyErr_SetString(PyExc_RuntimeError, e.what());
+                ret = NULL;
+            }
+            PyBuffer_Release(&ov);
+            Py_XINCREF(ret);
+            return ret;
+        }
+    }
+
+    %extend fityk::Func {
+        // writes function values at points from array x to array out
+        PyObject* values_at_into(PyObject *x, PyObject *out) {
+            const fityk::Func *func = self;
+            return fill_buffer_from_buffer(x, out,
+                    [func](const double* xp, double* op, int n) {
+                        func->values_at(xp, op, n);
+                    });
+        }
+    }
 #else
     %ignore get_ui_api;
 #endif
@@ -6,38 +6,192 @@
 #include "transform.h"
 #include "logic.h"
 #include "data.h"
+#include "fft.h"
+#include "lexer.h" // Lexer::kAll
+#include "numfuncs.h"
 #include "root/background.hpp"
 #include <stdio.h>
+#include <math.h>
 #include <assert.h>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <list>
+#include <set>
+#include <thread>
 
 using namespace std;
 
 namespace {
 using namespace fityk;
 
+// Returns y of sorted points pp interpolated at x (or the first/last y
+// if x is outside of the range), like a function that does binary search
+// for each x, but if x is not decreasing in the consecutive calls,
+// the points are scanned only once.
+class ExtrapolatedY
+{
+public:
+    ExtrapolatedY(const vector<Point>& pp) : pp_(pp), pos_(0) {}
+
+    realt operator()(realt x)
+    {
+        if (pp_.empty())
+            return 0;
+        else if (x <= pp_.front().x)
+            return pp_.front().y;
+        else if (x >= pp_.back().x)
+            return pp_.back().y;
+        // pos_ is the lower bound of x, the same as from lower_bound()
+        if (pos_ > 0 && pp_[pos_-1].x >= x)
+            pos_ = lower_bound(pp_.begin(), pp_.end(), Point(x, 0))
+                   - pp_.begin();
+        while (pp_[pos_].x < x)
+            ++pos_;
+        const Point* i = &pp_[pos_];
+        assert(pos_ > 0 && pos_ < pp_.size());
+        if (is_eq(x, i->x))
+            return i->y;
+        else
+            return (i-1)->y + (i->y - (i-1)->y) * (i->x - x)
+                                                / (i->x - (i-1)->x);
+    }
+
+private:
+    const vector<Point>& pp_;
+    size_t pos_;
+};
+
+// +, -, * or unary - that was not applied yet
+struct DtOp
+{
+    int op;                  // OP_ADD, OP_SUB, OP_MUL or OP_NEG
+    realt num;               // used with OP_MUL
+    const vector<Point>* pp; // used with OP_ADD and OP_SUB
+};
+
+// Number or dataset. Points of @n are not copied when put on the stack,
+// they are copied only when changed (copy-on-write).
+// Arithmetic operations on a dataset are recorded in `ops' and evaluated
+// later in a single pass over the points (see apply_ops()).
 struct DtStackItem
 {
     bool is_num;
     realt num;
-    vector<Point> points;
+    const vector<Point>* src; // points of @n, or NULL if own is used
+    vector<Point> own;
+    vector<DtOp> ops;
+    // operands of ops that are not datasets, must be kept until apply_ops()
+    list<vector<Point> > kept;
     string title;
+
+    DtStackItem() : is_num(true), num(0.), src(NULL) {}
+
+    void set_num(realt d)
+    {
+        is_num = true;
+        num = d;
+        reset_points();
+    }
+
+    void set_dataset(const vector<Point>* p, const string& t)
+    {
+        is_num = false;
+        reset_points();
+        src = p;
+        title = t;
+    }
+
+    // result of all recorded ops
+    const vector<Point>& points()
+    {
+        apply_ops();
+        return base();
+    }
+
+    void set_points(vector<Point>& p)
+    {
+        reset_points();
+        own.swap(p);
+    }
+
+    vector<Point>& mutable_points()
+    {
+        apply_ops();
+        if (src != NULL) {
+            own = *src;
+            src = NULL;
+        }
+        return own;
+    }
+
+    // operand of + or -; the points are moved from `other'
+    const vector<Point>* take_operand(DtStackItem& other)
+    {
+        other.apply_ops();
+        if (other.src != NULL)
+            return other.src;
+        kept.push_back(vector<Point>());
+        kept.back().swap(other.own);
+        return &kept.back();
+    }
+
+    void add_op(int op, realt d, const vector<Point>* pp)
+    {
+        DtOp dt_op = { op, d, pp };
+        ops.push_back(dt_op);
+    }
+
+    void swap(DtStackItem& other)
+    {
+        std::swap(is_num, other.is_num);
+        std::swap(num, other.num);
+        std::swap(src, other.src);
+        own.swap(other.own);
+        ops.swap(other.ops);
+        kept.swap(other.kept);
+        title.swap(other.title);
+    }
+
+private:
+    const vector<Point>& base() const { return src != NULL ? *src : own; }
+
+    void reset_points()
+    {
+        src = NULL;
+        own.clear();
+        ops.clear();
+        kept.clear();
+    }
+
+    void apply_ops();
 };
 
-realt find_extrapolated_y(vector<Point> const& pp, realt x)
+void DtStackItem::apply_ops()
 {
-    if (pp.empty())
-        return 0;
-    else if (x <= pp.front().x)
-        return pp.front().y;
-    else if (x >= pp.back().x)
-        return pp.back().y;
-    vector<Point>::const_iterator i = lower_bound(pp.begin(), pp.end(),
-                                                  Point(x, 0));
-    assert(i > pp.begin() && i < pp.end());
-    if (is_eq(x, i->x))
-        return i->y;
-    else
-        return (i-1)->y + (i->y - (i-1)->y) * (i->x - x) / (i->x - (i-1)->x);
+    if (ops.empty())
+        return;
+    if (src != NULL) {
+        own = *src;
+        src = NULL;
+    }
+    vector<ExtrapolatedY> ey;
+    ey.reserve(ops.size());
+    for (const DtOp& op : ops)
+        // for other ops pp is NULL and ey is not used
+        ey.push_back(ExtrapolatedY(op.pp != NULL ? *op.pp : own));
+    for (Point& p : own) {
+        for (size_t k = 0; k != ops.size(); ++k) {
+            switch (ops[k].op) {
+                case OP_ADD: p.y += ey[k](p.x); break;
+                case OP_SUB: p.y -= ey[k](p.x); break;
+                case OP_MUL: p.y *= ops[k].num; break;
+                case OP_NEG: p.y = -p.y; break;
+            }
+        }
+    }
+    ops.clear();
+    kept.clear();
 }
 
 void merge_same_x(vector<Point> &pp, bool avg)
@@ -70,34 +224,99 @@ void merge_same_x(vector<Point> &pp, bool avg)
     }
 }
 
-void shirley_bg(vector<Point> &pp)
+// appends points b to a, keeping a sorted
+void concatenate(vector<Point>& a, const vector<Point>& b)
 {
-    const int max_iter = 50;
-    const double max_rdiff = 1e-6;
-    const int n = pp.size();
-    double ya = pp[0].y; // lowest bg
-    double yb = pp[n-1].y; // highest bg
-    double dy = yb - ya;
-    vector<double> B(n, ya);
-    vector<double> PA(n, 0.);
-    double old_A = 0;
-    for (int iter = 0; iter < max_iter; ++iter) {
-        vector<double> Y(n);
-        for (int i = 0; i < n; ++i)
-            Y[i] = pp[i].y - B[i];
-        for (int i = 1; i < n; ++i)
-            PA[i] = PA[i-1] + (Y[i] + Y[i-1]) / 2 * (pp[i].x - pp[i-1].x);
-        double rel_diff = old_A != 0. ? fabs(PA[n-1] - old_A) / old_A : 1.;
-        if (rel_diff < max_rdiff)
-            break;
-        old_A = PA[n-1];
-        for (int i = 0; i < n; ++i)
-            B[i] = ya + dy / PA[n-1] * PA[i];
+    if (is_sorted(a.begin(), a.end()) && is_sorted(b.begin(), b.end())) {
+        vector<Point> merged(a.size() + b.size());
+        merge(a.begin(), a.end(), b.begin(), b.end(), merged.begin());
+        a.swap(merged);
+    } else {
+        a.insert(a.end(), b.begin(), b.end());
+        sort(a.begin(), a.end());
     }
-    for (int i = 0; i < n; ++i)
-        pp[i].y = B[i];
 }
 
+// Iterative Shirley background, applied to all points or to each slice
+// of active points.
+// The classic iteration is B_i = ya + (yb-ya) P_i / P_n, where P_i is
+// the trapezoidal integral of y-B from the first point to point i.
+// Here, for a given c = (yb-ya)/P_n, the integral P with B = ya + c P
+// is computed exactly in one pass (P is on both sides of the trapezoid
+// formula), and the fixed point of P_n is found with Aitken's acceleration.
+class ShirleyBackground
+{
+public:
+    ShirleyBackground(int max_iter, double max_rdiff)
+        : max_iter_(max_iter), max_rdiff_(max_rdiff) {}
+
+    void operator()(const vector<double>& x, vector<double>& y)
+    {
+        const int n = y.size();
+        if (n < 2)
+            return;
+        double ya = y[0]; // lowest bg
+        double dy = y[n-1] - ya;
+        p_.resize(n);
+        // A_{k+1} = g(A_k), where g(A) is the integral for c = dy/A
+        double c = 0.;
+        double A = integrate(x, y, ya, c);
+        double prev_A = 0.;
+        bool has_prev = false;
+        for (int iter = 1; iter < max_iter_; ++iter) {
+            if (A == 0. || !is_finite(A))
+                break;
+            c = dy / A;
+            double new_A = integrate(x, y, ya, c);
+            if (new_A == A)
+                break;
+            if (has_prev) {
+                // Aitken's delta-squared extrapolation of prev_A, A, new_A;
+                // the difference new_A-A alone is not a good measure
+                // of convergence, the iteration can be slow
+                double d2 = new_A - 2 * A + prev_A;
+                double extr = new_A - (new_A - A) * (new_A - A) / d2;
+                if (d2 != 0. && is_finite(extr)) {
+                    if (fabs(extr - new_A) < max_rdiff_ * fabs(extr))
+                        break;
+                    A = extr;
+                    has_prev = false;
+                    continue;
+                }
+                if (fabs(new_A - A) < max_rdiff_ * fabs(A))
+                    break;
+            }
+            prev_A = A;
+            has_prev = true;
+            A = new_A;
+        }
+        // as in the classic iteration, the background ends at the last y
+        double scale = dy / p_[n-1];
+        if (!is_finite(scale))
+            scale = c;
+        for (int i = 0; i < n; ++i)
+            y[i] = ya + scale * p_[i];
+    }
+
+private:
+    int max_iter_;
+    double max_rdiff_;
+    vector<double> p_; // integral of (y - bg), reused between slices
+
+    // fills p_ for bg = ya + c * p_, returns p_[n-1]
+    double integrate(const vector<double>& x, const vector<double>& y,
+                     double ya, double c)
+    {
+        p_[0] = 0.;
+        for (size_t i = 1; i < y.size(); ++i) {
+            double h = (x[i] - x[i-1]) / 2;
+            p_[i] = (p_[i-1] * (1 - c * h) + h * (y[i] + y[i-1] - 2 * ya))
+                    / (1 + c * h);
+        }
+        return p_.back();
+    }
+};
+
 // Calculates the SNIP background iteratively in the
 // given slice of the vector of points.
 // The active points are modified in-place, inactive
@@ -145,12 +364,594 @@ vector<Point>::iterator snip_bg_slice(vector<Point>::iterator begin,
     return end;
 }
 
-} // anonymous namespace
+// y sampled on the grid x0 + i*dx, i=0..n-1
+struct UniformGrid
+{
+    double x0, dx;
+    vector<double> y;
+    bool resampled; // false if the points were already evenly spaced
+};
 
-namespace fityk {
+// FFT needs evenly spaced points, other data is linearly interpolated
+// onto n points evenly spaced between the first and the last x.
+UniformGrid make_uniform_grid(const vector<Point>& pp)
+{
+    const int n = pp.size();
+    if (n < 2 || !(pp.back().x > pp.front().x))
+        throw ExecuteError("at least two points with different x needed");
+    UniformGrid g;
+    g.x0 = pp.front().x;
+    g.dx = (pp.back().x - pp.front().x) / (n - 1);
+    g.y.resize(n);
+    // the same criterion as in Data::find_step()
+    double min_step = pp[1].x - pp[0].x;
+    double max_step = min_step;
+    for (int i = 2; i < n; ++i) {
+        double step = pp[i].x - pp[i-1].x;
+        min_step = min(min_step, step);
+        max_step = max(max_step, step);
+    }
+    g.resampled = (max_step - min_step >= 1e-4 * g.dx);
+    if (!g.resampled) {
+        for (int i = 0; i < n; ++i)
+            g.y[i] = pp[i].y;
+        return g;
+    }
+    int k = 0;
+    for (int i = 0; i < n; ++i) {
+        double x = g.x0 + i * g.dx;
+        while (k < n - 2 && pp[k+1].x < x)
+            ++k;
+        double w = (x - pp[k].x) / (pp[k+1].x - pp[k].x);
+        g.y[i] = pp[k].y + w * (pp[k+1].y - pp[k].y);
+    }
+    return g;
+}
 
-/// executes VM code and stores results in dataset `data_out'
-void run_data_transform(const DataKeeper& dk, const VMData& vm, Data* data_out)
+// sets y of points pp to values from the grid g (interpolated if needed)
+void set_from_uniform_grid(const UniformGrid& g, vector<Point>& pp)
+{
+    const int n = g.y.size();
+    if (!g.resampled) {
+        for (int i = 0; i < n; ++i)
+            pp[i].y = g.y[i];
+        return;
+    }
+    for (vector<Point>::iterator p = pp.begin(); p != pp.end(); ++p) {
+        double t = (p->x - g.x0) / g.dx;
+        int i = min(max(int(t), 0), n - 2);
+        double w = t - i;
+        p->y = g.y[i] + w * (g.y[i+1] - g.y[i]);
+    }
+}
+
+// samples of convolution kernel at x = j*dx, j=jmin,...,jmin+v.size()-1;
+// normalized to unit sum
+struct Kernel
+{
+    int jmin;
+    vector<double> v;
+
+    int jmax() const { return jmin + (int) v.size() - 1; }
+    void normalize()
+    {
+        double sum = 0;
+        for (size_t j = 0; j != v.size(); ++j)
+            sum += v[j];
+        if (sum == 0.)
+            throw ExecuteError("convolution kernel has zero area");
+        for (size_t j = 0; j != v.size(); ++j)
+            v[j] /= sum;
+    }
+};
+
+// Gaussian with given FWHM, cut at 5 sigma
+Kernel gaussian_kernel(double fwhm, double dx, int max_half_width)
+{
+    if (!(fwhm > 0))
+        throw ExecuteError("Gaussian width must be positive");
+    double sigma = fwhm / (2 * sqrt(2 * M_LN2));
+    int hw = (int) min(ceil(5 * sigma / dx), (double) max_half_width);
+    Kernel k;
+    k.jmin = -hw;
+    k.v.resize(2 * hw + 1);
+    for (int j = -hw; j <= hw; ++j) {
+        double t = j * dx / sigma;
+        k.v[j+hw] = exp(-0.5 * t * t);
+    }
+    k.normalize();
+    return k;
+}
+
+// dataset pp (with x as offsets) sampled with step dx
+Kernel dataset_kernel(const vector<Point>& pp, double dx, int max_half_width)
+{
+    if (pp.empty())
+        throw ExecuteError("empty dataset used as convolution kernel");
+    double lo = max(pp.front().x / dx, (double) -max_half_width);
+    double hi = min(pp.back().x / dx, (double) max_half_width);
+    Kernel k;
+    k.jmin = (int) ceil(lo - 1e-9);
+    int jmax = (int) floor(hi + 1e-9);
+    if (jmax < k.jmin) // kernel narrower than dx
+        k.jmin = jmax = (int) floor(0.5 * (lo + hi) + 0.5);
+    k.v.resize(jmax - k.jmin + 1);
+    size_t pos = 0;
+    for (int j = k.jmin; j <= jmax; ++j) {
+        double x = j * dx;
+        while (pos + 2 < pp.size() && pp[pos+1].x < x)
+            ++pos;
+        if (pp.size() == 1 || x <= pp.front().x)
+            k.v[j-k.jmin] = pp.front().y;
+        else if (x >= pp.back().x)
+            k.v[j-k.jmin] = pp.back().y;
+        else {
+            const Point& a = pp[pos];
+            const Point& b = pp[pos+1];
+            k.v[j-k.jmin] = a.y + (x - a.x) / (b.x - a.x) * (b.y - a.y);
+        }
+    }
+    k.normalize();
+    return k;
+}
+
+// y padded with edge values, prepared for filtering in frequency domain;
+// pad is the number of points added on each side, FFT length is
+// large enough to avoid wrap-around of a kernel of width kernel_width
+struct PaddedSpectrum
+{
+    int n, pad, size;
+    RealFft fft;
+    vector<Complex> ft;
+
+    PaddedSpectrum(const vector<double>& y, int pad_, int kernel_width)
+        : n(y.size()), pad(pad_),
+          size(fft_good_size(n + 2 * pad + kernel_width)), fft(size)
+    {
+        vector<double> e(size);
+        for (int t = 0; t < size; ++t) {
+            // the remaining part is filled with the nearer edge value,
+            // to avoid the jump between the last and the first point
+            int i = t - pad;
+            if (i >= n)
+                i = (i - n < (size - n) / 2 ? n - 1 : 0);
+            e[t] = y[max(i, 0)];
+        }
+        fft.forward(e, &ft);
+    }
+
+    // FFT of the kernel placed circularly (j=0 at index 0)
+    vector<Complex> kernel_ft(const Kernel& k) const
+    {
+        vector<double> kc(size, 0.);
+        for (int j = k.jmin; j <= k.jmax(); ++j)
+            kc[(j % size + size) % size] += k.v[j - k.jmin];
+        vector<Complex> r;
+        fft.forward(kc, &r);
+        return r;
+    }
+
+    void inverse(vector<double>& y) const
+    {
+        vector<double> e;
+        fft.inverse(ft, &e);
+        for (int i = 0; i < n; ++i)
+            y[i] = e[i + pad];
+    }
+};
+
+// convolution with dataset kernel_pp or, if it is NULL, with Gaussian;
+// if inverse is set -- deconvolution with regularization parameter lambda
+void convolve(vector<Point>& pp, const vector<Point>* kernel_pp, double fwhm,
+              bool inverse, double lambda)
+{
+    UniformGrid g = make_uniform_grid(pp);
+    const int n = g.y.size();
+    Kernel k = kernel_pp != NULL ? dataset_kernel(*kernel_pp, g.dx, n)
+                                 : gaussian_kernel(fwhm, g.dx, n);
+    int width = k.jmax() - k.jmin;
+    int pad = max(max(k.jmax(), -k.jmin), 0) + (inverse ? width : 0);
+    PaddedSpectrum s(g.y, pad, width);
+    vector<Complex> kft = s.kernel_ft(k);
+    for (size_t i = 0; i != s.ft.size(); ++i) {
+        if (!inverse)
+            s.ft[i] *= kft[i];
+        else {
+            double denom = norm(kft[i]) + lambda;
+            s.ft[i] = denom > 0 ? s.ft[i] * conj(kft[i]) / denom : 0.;
+        }
+    }
+    s.inverse(g.y);
+    set_from_uniform_grid(g, pp);
+}
+
+void lowpass(vector<Point>& pp, double cutoff)
+{
+    if (!(cutoff > 0))
+        throw ExecuteError("lowpass: cutoff frequency must be positive");
+    UniformGrid g = make_uniform_grid(pp);
+    const int n = g.y.size();
+    PaddedSpectrum s(g.y, max(n / 2, 16), 0);
+    // frequency of coefficient k is k / (size * dx)
+    double k_cut = cutoff * s.size * g.dx;
+    for (size_t i = 0; i != s.ft.size(); ++i)
+        if (i > k_cut)
+            s.ft[i] = 0.;
+    s.inverse(g.y);
+    set_from_uniform_grid(g, pp);
+}
+
+// discrete Fourier transform, one point per frequency k/(n*dx), k=0..n/2
+vector<Point> fourier_transform(const vector<Point>& pp, int op)
+{
+    UniformGrid g = make_uniform_grid(pp);
+    const int n = g.y.size();
+    vector<Complex> ft;
+    RealFft(n).forward(g.y, &ft);
+    vector<Point> result(ft.size());
+    for (size_t k = 0; k != ft.size(); ++k) {
+        result[k].x = k / (n * g.dx);
+        if (op == OP_DT_FFT_RE)
+            result[k].y = ft[k].real();
+        else if (op == OP_DT_FFT_IM)
+            result[k].y = ft[k].imag();
+        else
+            result[k].y = abs(ft[k]);
+    }
+    return result;
+}
+
+// Applies filter to y of each slice of consecutive active points.
+// Inactive points are left as they are (cf. snip_bg_slice()).
+// filter(x, y) gets x and y of the slice and changes y.
+template<typename T>
+void filter_active_slices(vector<Point>& pp, T&& filter)
+{
+    vector<double> x, y;
+    vector<Point>::iterator begin = pp.begin();
+    for (;;) {
+        while (begin != pp.end() && !begin->is_active)
+            ++begin;
+        if (begin == pp.end())
+            break;
+        vector<Point>::iterator end = begin + 1;
+        while (end != pp.end() && end->is_active)
+            ++end;
+        x.clear();
+        y.clear();
+        for (vector<Point>::iterator i = begin; i != end; ++i) {
+            x.push_back(i->x);
+            y.push_back(i->y);
+        }
+        filter(x, y);
+        for (vector<Point>::iterator i = begin; i != end; ++i)
+            i->y = y[i - begin];
+        begin = end;
+    }
+}
+
+// Applies filter to y of all points, active or not
+// (cf. filter_active_slices()).
+template<typename T>
+void filter_all_points(vector<Point>& pp, T&& filter)
+{
+    vector<double> x(pp.size()), y(pp.size());
+    for (size_t i = 0; i != pp.size(); ++i) {
+        x[i] = pp[i].x;
+        y[i] = pp[i].y;
+    }
+    filter(x, y);
+    for (size_t i = 0; i != pp.size(); ++i)
+        pp[i].y = y[i];
+}
+
+int get_half_width(const DtStackItem& item, const string& fname)
+{
+    if (!item.is_num || item.num < 1 || item.num > 1e6)
+        throw ExecuteError(fname + ": half-width must be a number >= 1");
+    return iround(item.num);
+}
+
+// Savitzky-Golay filter: least-squares fit of polynomial of given order
+// to 2m+1 points and its value (or derivative) in the middle point.
+// In the first and last m points the polynomial fitted to the first or
+// last 2m+1 points is used.
+class SavitzkyGolay
+{
+public:
+    SavitzkyGolay(int m, int order, int deriv)
+        : m_(m), order_(order), deriv_(deriv) {}
+
+    void operator()(const vector<double>& x, vector<double>& y) const
+    {
+        const int n = y.size();
+        int m = min(m_, (n - 1) / 2);
+        int order = min(order_, 2 * m);
+        if (order < deriv_) { // too few points to estimate derivative
+            fill(y.begin(), y.end(), 0.);
+            return;
+        }
+        vector<double> table = coefficients(m, order);
+        const int w = 2 * m + 1;
+        // derivatives are calculated assuming evenly spaced points
+        double scale = deriv_ == 0 ? 1. : pow(m * (x[n-1] - x[0]) / (n - 1),
+                                              -deriv_);
+        vector<double> z(n);
+        for (int i = 0; i < n; ++i) {
+            int start = min(max(i - m, 0), n - w); // first point of window
+            const double* c = &table[(i - start) * w];
+            double sum = 0;
+            for (int j = 0; j < w; ++j)
+                sum += c[j] * y[start + j];
+            z[i] = sum * scale;
+        }
+        y.swap(z);
+    }
+
+private:
+    int m_, order_, deriv_;
+
+    // Returns table of w*w coefficients (w=2m+1): the row t contains
+    // coefficients for the point t in a window of w points.
+    // The fitting uses u = (j-m)/m in [-1,1] as polynomial argument.
+    vector<double> coefficients(int m, int order) const
+    {
+        const int w = 2 * m + 1;
+        const int np = order + 1;
+        // J[j][k] = u_j^k
+        vector<double> J(w * np);
+        for (int j = 0; j < w; ++j) {
+            double u = m == 0 ? 0. : double(j - m) / m;
+            double t = 1.;
+            for (int k = 0; k < np; ++k, t *= u)
+                J[j*np+k] = t;
+        }
+        vector<realt> JTJ(np * np, 0.);
+        for (int k = 0; k < np; ++k)
+            for (int l = 0; l < np; ++l)
+                for (int j = 0; j < w; ++j)
+                    JTJ[k*np+l] += J[j*np+k] * J[j*np+l];
+        invert_matrix(JTJ, np);
+        // G = (J^T J)^-1 J^T, polynomial coefficients are G y
+        vector<double> G(np * w, 0.);
+        for (int k = 0; k < np; ++k)
+            for (int j = 0; j < w; ++j)
+                for (int l = 0; l < np; ++l)
+                    G[k*w+j] += JTJ[k*np+l] * J[j*np+l];
+        vector<double> table(w * w, 0.);
+        for (int t = 0; t < w; ++t) {
+            double u = m == 0 ? 0. : double(t - m) / m;
+            // d^deriv/du^deriv of u^k is k!/(k-deriv)! u^(k-deriv)
+            for (int k = deriv_; k < np; ++k) {
+                double f = 1.;
+                for (int i = k - deriv_ + 1; i <= k; ++i)
+                    f *= i;
+                f *= pow(u, k - deriv_);
+                for (int j = 0; j < w; ++j)
+                    table[t*w+j] += f * G[k*w+j];
+            }
+        }
+        return table;
+    }
+};
+
+// mean of points in the window [i-m, i+m], computed using running sum;
+// the window is truncated at the ends of data
+void moving_average(vector<double>& y, int m)
+{
+    const int n = y.size();
+    vector<double> z(n);
+    double sum = 0;
+    for (int i = 0; i < min(m, n); ++i)
+        sum += y[i];
+    for (int i = 0; i < n; ++i) {
+        if (i + m < n)
+            sum += y[i+m];
+        if (i - m - 1 >= 0)
+            sum -= y[i-m-1];
+        z[i] = sum / (min(i + m, n - 1) - max(i - m, 0) + 1);
+    }
+    y.swap(z);
+}
+
+// Median of points in the window [i-m, i+m] (truncated at the ends).
+// The window is kept as two halves, the lower and the upper one;
+// multisets are used instead of heaps, because points leaving the window
+// need to be removed.
+void median_filter(vector<double>& y, int m)
+{
+    const int n = y.size();
+    multiset<double> lo, hi;
+    vector<double> z(n);
+    for (int i = -m; i < n; ++i) {
+        if (i + m < n) { // point entering the window
+            double v = y[i+m];
+            if (lo.empty() || v <= *lo.rbegin())
+                lo.insert(v);
+            else
+                hi.insert(v);
+        }
+        if (i - m - 1 >= 0) { // point leaving the window
+            double v = y[i-m-1];
+            if (v <= *lo.rbegin())
+                lo.erase(lo.find(v));
+            else
+                hi.erase(hi.find(v));
+        }
+        // keep lo.size() == hi.size() or hi.size() + 1
+        if (lo.size() > hi.size() + 1) {
+            hi.insert(*lo.rbegin());
+            lo.erase(--lo.end());
+        } else if (hi.size() > lo.size()) {
+            lo.insert(*hi.begin());
+            hi.erase(hi.begin());
+        }
+        if (i >= 0)
+            z[i] = lo.size() > hi.size() ? *lo.rbegin()
+                                         : (*lo.rbegin() + *hi.begin()) / 2;
+    }
+    y.swap(z);
+}
+
+// Whittaker smoother: minimizes sum (y-z)^2 + lambda * sum (second
+// difference of z)^2, i.e. solves (I + lambda D'D) z = y, where D'D
+// is pentadiagonal. LDL' decomposition of band matrix takes O(n).
+void whittaker_smooth(vector<double>& y, double lambda)
+{
+    const int n = y.size();
+    if (n < 3)
+        return;
+    // diagonals of A = I + lambda D'D: a0[i]=A(i,i), a1[i]=A(i,i+1), ...
+    vector<double> a0(n, 1.), a1(n, 0.), a2(n, 0.);
+    for (int r = 0; r + 2 < n; ++r) {
+        a0[r] += lambda;
+        a0[r+1] += 4 * lambda;
+        a0[r+2] += lambda;
+        a1[r] -= 2 * lambda;
+        a1[r+1] -= 2 * lambda;
+        a2[r] += lambda;
+    }
+    // A = L D L', L has ones on diagonal and l1, l2 below it
+    vector<double> d(n), l1(n, 0.), l2(n, 0.);
+    for (int i = 0; i < n; ++i) {
+        if (i >= 2)
+            l2[i] = a2[i-2] / d[i-2];
+        if (i >= 1)
+            l1[i] = (a1[i-1] - (i >= 2 ? l1[i-1] * l2[i] * d[i-2] : 0.))
+                    / d[i-1];
+        d[i] = a0[i] - (i >= 1 ? l1[i] * l1[i] * d[i-1] : 0.)
+                     - (i >= 2 ? l2[i] * l2[i] * d[i-2] : 0.);
+    }
+    for (int i = 1; i < n; ++i)
+        y[i] -= l1[i] * y[i-1] + (i >= 2 ? l2[i] * y[i-2] : 0.);
+    for (int i = 0; i < n; ++i)
+        y[i] /= d[i];
+    for (int i = n - 2; i >= 0; --i)
+        y[i] -= l1[i+1] * y[i+1] + (i + 2 < n ? l2[i+2] * y[i+2] : 0.);
+}
+
+enum ResampleMethod { kResampleLinear, kResampleCubic, kResampleBins };
+
+// Resamples sorted points onto the grid x = k*step, in one pass.
+// Interpolation (linear or cubic, i.e. 4-point Lagrange) gives points
+// from the first to the last x; sigma is propagated as for a weighted sum.
+// In the bin-averaging mode, points with x in [(k-1/2)*step, (k+1/2)*step)
+// are averaged, and empty bins are skipped.
+vector<Point> resample(const vector<Point>& pp, double step,
+                       ResampleMethod method)
+{
+    if (!(step > 0))
+        throw ExecuteError("resampling step must be positive");
+    vector<Point> result;
+    if (pp.empty())
+        return result;
+    const int n = pp.size();
+    double span = (pp.back().x - pp.front().x) / step;
+    if (!is_finite(span) || span > 1e9)
+        throw ExecuteError("resampling would give too many points");
+
+    if (method == kResampleBins) {
+        result.reserve(min(n, (int) span + 2));
+        for (int i = 0; i < n; ) {
+            double k = floor(pp[i].x / step + 0.5);
+            double sum_x = 0, sum_y = 0, sum_s2 = 0;
+            bool active = false;
+            int count = 0;
+            for ( ; i < n && floor(pp[i].x / step + 0.5) == k; ++i) {
+                sum_x += pp[i].x;
+                sum_y += pp[i].y;
+                sum_s2 += pp[i].sigma * pp[i].sigma;
+                active = active || pp[i].is_active;
+                ++count;
+            }
+            Point p(k * step, sum_y / count, sqrt(sum_s2) / count);
+            p.is_active = active;
+            result.push_back(p);
+        }
+        return result;
+    }
+
+    double k_first = ceil(pp.front().x / step - 1e-9);
+    double k_last = floor(pp.back().x / step + 1e-9);
+    if (n == 1 || k_last < k_first)
+        return result;
+    result.resize((size_t) (k_last - k_first) + 1);
+    int j = 0; // pp[j].x <= x < pp[j+1].x (if possible)
+    for (size_t r = 0; r != result.size(); ++r) {
+        double x = (k_first + r) * step;
+        while (j < n - 2 && pp[j+1].x <= x)
+            ++j;
+        const Point& a = pp[j];
+        const Point& b = pp[j+1];
+        // indices and weights of points used for interpolation
+        int idx[4];
+        double w[4];
+        int m = 2;
+        idx[0] = j;
+        idx[1] = j + 1;
+        double d = b.x - a.x;
+        w[1] = d > 0 ? min(max((x - a.x) / d, 0.), 1.) : 0.;
+        w[0] = 1 - w[1];
+        if (method == kResampleCubic && n >= 4) {
+            int first = min(max(j - 1, 0), n - 4);
+            bool distinct = true;
+            for (int t = first; t < first + 3; ++t)
+                if (!(pp[t+1].x > pp[t].x))
+                    distinct = false;
+            if (distinct) {
+                m = 4;
+                for (int t = 0; t < 4; ++t) {
+                    idx[t] = first + t;
+                    w[t] = 1.;
+                    for (int u = 0; u < 4; ++u)
+                        if (u != t)
+                            w[t] *= (x - pp[first+u].x)
+                                    / (pp[first+t].x - pp[first+u].x);
+                }
+            }
+        }
+        Point& p = result[r];
+        p.x = x;
+        p.y = 0;
+        double s2 = 0;
+        for (int t = 0; t < m; ++t) {
+            p.y += w[t] * pp[idx[t]].y;
+            s2 += w[t] * w[t] * pp[idx[t]].sigma * pp[idx[t]].sigma;
+        }
+        p.sigma = sqrt(s2);
+        p.is_active = (x - a.x <= b.x - x ? a.is_active : b.is_active);
+    }
+    return result;
+}
+
+// datasets used in transformation
+struct DtInput
+{
+    const DataKeeper* dk;
+    // if set, used instead of dk->data() which is not thread-safe
+    const vector<Data*>* datas;
+    int current; // dataset referred to as @*, or -1
+
+    const Data* data(int n) const
+    {
+        if (n == Lexer::kAll) {
+            if (current < 0)
+                throw ExecuteError("@* can be used at RHS only if it is "
+                                   "also at LHS");
+            n = current;
+        }
+        if (datas == NULL)
+            return dk->data(n);
+        if (!is_index(n, *datas))
+            throw ExecuteError("No such dataset: @" + S(n));
+        assert((*datas)[n] != NULL); // loaded before threads are started
+        return (*datas)[n];
+    }
+};
+
+// executes VM code, the result is left in `result'
+void eval_data_transform(const DtInput& in, const VMData& vm,
+                         DtStackItem* result)
 {
     DtStackItem stack[6];
     DtStackItem* stackPtr = stack - 1; // will be ++'ed first
@@ -163,18 +964,16 @@ void run_data_transform(const DataKeeper& dk, const VMData& vm, Data* data_out)
                 if (stackPtr - stack >= 6)
                     throw ExecuteError("stack overflow");
                 ++i;
-                stackPtr->is_num = true;
-                stackPtr->num = vm.numbers()[*i];
+                stackPtr->set_num(vm.numbers()[*i]);
                 break;
 
             case OP_DATASET:
                 stackPtr += 1;
                 if (stackPtr - stack >= 6)
                     throw ExecuteError("stack overflow");
-                stackPtr->is_num = false;
                 ++i;
-                stackPtr->points = dk.data(*i)->points();
-                stackPtr->title = dk.data(*i)->get_title();
+                stackPtr->set_dataset(&in.data(*i)->points(),
+                                      in.data(*i)->get_title());
                 if (stackPtr->title.empty())
                     stackPtr->title = "nt"; // no title
                 break;
@@ -183,8 +982,7 @@ void run_data_transform(const DataKeeper& dk, const VMData& vm, Data* data_out)
                 if (stackPtr->is_num)
                     stackPtr->num = -stackPtr->num;
                 else {
-                    vm_foreach (Point, j, stackPtr->points)
-                        j->y = -j->y;
+                    stackPtr->add_op(OP_NEG, 0, NULL);
                     stackPtr->title = "-" + stackPtr->title;
                 }
                 break;
@@ -194,8 +992,8 @@ void run_data_transform(const DataKeeper& dk, const VMData& vm, Data* data_out)
                 if (stackPtr->is_num && (stackPtr+1)->is_num)
                     stackPtr->num += (stackPtr+1)->num;
                 else if (!stackPtr->is_num && !(stackPtr+1)->is_num) {
-                    vm_foreach (Point, j, stackPtr->points)
-                        j->y += find_extrapolated_y((stackPtr+1)->points, j->x);
+                    stackPtr->add_op(OP_ADD, 0,
+                                     stackPtr->take_operand(*(stackPtr+1)));
                     stackPtr->title += "+" + (stackPtr+1)->title;
                 } else
                     throw ExecuteError("adding number and dataset");
@@ -206,8 +1004,8 @@ void run_data_transform(const DataKeeper& dk, const VMData& vm, Data* data_out)
                 if (stackPtr->is_num && (stackPtr+1)->is_num)
                     stackPtr->num -= (stackPtr+1)->num;
                 else if (!stackPtr->is_num && !(stackPtr+1)->is_num) {
-                    vm_foreach (Point, j, stackPtr->points)
-                        j->y -= find_extrapolated_y((stackPtr+1)->points, j->x);
+                    stackPtr->add_op(OP_SUB, 0,
+                                     stackPtr->take_operand(*(stackPtr+1)));
                     stackPtr->title += "-" + (stackPtr+1)->title;
                 } else
                     throw ExecuteError("substracting number and dataset");
@@ -221,36 +1019,47 @@ void run_data_transform(const DataKeeper& dk, const VMData& vm, Data* data_out)
                     throw ExecuteError("multiplying two datasets");
                 } else if (!stackPtr->is_num && (stackPtr+1)->is_num) {
                     realt mult = (stackPtr+1)->num;
-                    vm_foreach (Point, j, stackPtr->points)
-                        j->y *= mult;
+                    stackPtr->add_op(OP_MUL, mult, NULL);
                     stackPtr->title += "*" + S(mult);
                 } else if (stackPtr->is_num && !(stackPtr+1)->is_num) {
                     realt mult = stackPtr->num;
-                    stackPtr->points.swap((stackPtr+1)->points);
-                    stackPtr->is_num = false;
-                    vm_foreach (Point, j, stackPtr->points)
-                        j->y *= mult;
-                    stackPtr->title = S(mult) + "*" + (stackPtr+1)->title;
+                    stackPtr->swap(*(stackPtr+1));
+                    stackPtr->add_op(OP_MUL, mult, NULL);
+                    stackPtr->title = S(mult) + "*" + stackPtr->title;
                 }
                 break;
 
             case OP_DT_SUM_SAME_X:
                 if (stackPtr->is_num)
                     throw ExecuteError(op2str(*i) + " is defined only for @n");
-                merge_same_x(stackPtr->points, false);
+                merge_same_x(stackPtr->mutable_points(), false);
                 break;
 
             case OP_DT_AVG_SAME_X:
                 if (stackPtr->is_num)
                     throw ExecuteError(op2str(*i) + " is defined only for @n");
-                merge_same_x(stackPtr->points, true);
+                merge_same_x(stackPtr->mutable_points(), true);
                 break;
 
-            case OP_DT_SHIRLEY_BG:
+            case OP_DT_SHIRLEY_BG: {
+                stackPtr -= 3;
                 if (stackPtr->is_num)
                     throw ExecuteError(op2str(*i) + " is defined only for @n");
-                shirley_bg(stackPtr->points);
+                int max_iter = iround((stackPtr+1)->num);
+                double max_rdiff = (stackPtr+2)->num;
+                if (max_iter < 1)
+                    throw ExecuteError(op2str(*i) + ": max. number of "
+                                       "iterations must be positive");
+                if (!(max_rdiff > 0.))
+                    throw ExecuteError(op2str(*i) + ": tolerance must be "
+                                       "positive");
+                ShirleyBackground shirley(max_iter, max_rdiff);
+                if ((stackPtr+3)->num > 0)
+                    filter_active_slices(stackPtr->mutable_points(), shirley);
+                else
+                    filter_all_points(stackPtr->mutable_points(), shirley);
                 break;
+            }
 
             case OP_DT_SNIP_BG: {
                 stackPtr -= 4;
@@ -266,10 +1075,11 @@ void run_data_transform(const DataKeeper& dk, const VMData& vm, Data* data_out)
                 int smooth_window = ROOT::kBackSmoothing3;
                 bool estimate_compton = (stackPtr+4)->num > 0 ? true : false;
 
-                vector<Point>::iterator start = stackPtr->points.begin();
-                while (start != stackPtr->points.end())
+                vector<Point>& points = stackPtr->mutable_points();
+                vector<Point>::iterator start = points.begin();
+                while (start != points.end())
                     start = snip_bg_slice(start,
-                                          stackPtr->points.end(),
+                                          points.end(),
                                           window_width,
                                           direction,
                                           filter_order,
@@ -279,6 +1089,111 @@ void run_data_transform(const DataKeeper& dk, const VMData& vm, Data* data_out)
                 break;
             }
 
+            case OP_DT_FFT_RE:
+            case OP_DT_FFT_IM:
+            case OP_DT_FFT_AMP: {
+                if (stackPtr->is_num)
+                    throw ExecuteError(op2str(*i) + " is defined only for @n");
+                vector<Point> ft = fourier_transform(stackPtr->points(), *i);
+                stackPtr->set_points(ft);
+                break;
+            }
+
+            case OP_DT_CONVOLVE:
+            case OP_DT_DECONVOLVE: {
+                bool inverse = (*i == OP_DT_DECONVOLVE);
+                stackPtr -= (inverse ? 2 : 1);
+                if (stackPtr->is_num)
+                    throw ExecuteError(op2str(*i) + " is defined only for @n");
+                DtStackItem& kernel = *(stackPtr+1);
+                double lambda = 0;
+                if (inverse) {
+                    if (!(stackPtr+2)->is_num || (stackPtr+2)->num < 0)
+                        throw ExecuteError(op2str(*i) + ": the last argument "
+                                           "must be a non-negative number");
+                    lambda = (stackPtr+2)->num;
+                }
+                convolve(stackPtr->mutable_points(),
+                         kernel.is_num ? NULL : &kernel.points(),
+                         kernel.num, inverse, lambda);
+                break;
+            }
+
+            case OP_DT_LOWPASS:
+                stackPtr -= 1;
+                if (stackPtr->is_num || !(stackPtr+1)->is_num)
+                    throw ExecuteError(op2str(*i) + " expects @n and number");
+                lowpass(stackPtr->mutable_points(), (stackPtr+1)->num);
+                break;
+
+            case OP_DT_SAVITZKY_GOLAY: {
+                stackPtr -= 3;
+                if (stackPtr->is_num)
+                    throw ExecuteError(op2str(*i) + " is defined only for @n");
+                int m = get_half_width(*(stackPtr+1), "savitzky_golay");
+                double order = (stackPtr+2)->num;
+                double deriv = (stackPtr+3)->num;
+                if (!(stackPtr+2)->is_num || order < 0 || order > 20)
+                    throw ExecuteError("savitzky_golay: polynomial order "
+                                       "must be in the range 0-20");
+                if (!(stackPtr+3)->is_num || deriv < 0 || deriv > order)
+                    throw ExecuteError("savitzky_golay: derivative order "
+                                       "must be in the range 0-order");
+                SavitzkyGolay sg(m, iround(order), iround(deriv));
+                filter_active_slices(stackPtr->mutable_points(), sg);
+                break;
+            }
+
+            case OP_DT_MOVING_AVG:
+            case OP_DT_MEDIAN_FILTER: {
+                stackPtr -= 1;
+                if (stackPtr->is_num)
+                    throw ExecuteError(op2str(*i) + " is defined only for @n");
+                bool median = (*i == OP_DT_MEDIAN_FILTER);
+                int m = get_half_width(*(stackPtr+1),
+                                       median ? "median_filter" : "moving_avg");
+                filter_active_slices(stackPtr->mutable_points(),
+                        [&](const vector<double>&, vector<double>& y) {
+                    if (median)
+                        median_filter(y, m);
+                    else
+                        moving_average(y, m);
+                });
+                break;
+            }
+
+            case OP_DT_WHITTAKER: {
+                stackPtr -= 1;
+                if (stackPtr->is_num)
+                    throw ExecuteError(op2str(*i) + " is defined only for @n");
+                double lambda = (stackPtr+1)->num;
+                if (!(stackPtr+1)->is_num || !(lambda >= 0))
+                    throw ExecuteError("whittaker: lambda must be a "
+                                       "non-negative number");
+                filter_active_slices(stackPtr->mutable_points(),
+                        [&](const vector<double>&, vector<double>& y) {
+                    whittaker_smooth(y, lambda);
+                });
+                break;
+            }
+
+            case OP_DT_RESAMPLE:
+            case OP_DT_RESAMPLE_CUBIC:
+            case OP_DT_REBIN: {
+                stackPtr -= 1;
+                if (stackPtr->is_num || !(stackPtr+1)->is_num)
+                    throw ExecuteError(op2str(*i) + " expects @n and number");
+                ResampleMethod method = kResampleLinear;
+                if (*i == OP_DT_RESAMPLE_CUBIC)
+                    method = kResampleCubic;
+                else if (*i == OP_DT_REBIN)
+                    method = kResampleBins;
+                vector<Point> pp = resample(stackPtr->points(),
+                                            (stackPtr+1)->num, method);
+                stackPtr->set_points(pp);
+                break;
+            }
+
             case OP_AND:
                 // do nothing
                 break;
@@ -287,10 +1202,8 @@ void run_data_transform(const DataKeeper& dk, const VMData& vm, Data* data_out)
                 stackPtr -= 1;
                 if (stackPtr->is_num || (stackPtr+1)->is_num)
                     throw ExecuteError("expected @n on both sides of `and'");
-                stackPtr->points.insert(stackPtr->points.end(),
-                                        (stackPtr+1)->points.begin(),
-                                        (stackPtr+1)->points.end());
-                sort(stackPtr->points.begin(), stackPtr->points.end());
+                concatenate(stackPtr->mutable_points(),
+                            (stackPtr+1)->points());
                 stackPtr->title += "&" + (stackPtr+1)->title;
                 break;
 
@@ -300,14 +1213,124 @@ void run_data_transform(const DataKeeper& dk, const VMData& vm, Data* data_out)
         }
     }
     assert(stackPtr == stack);
+    if (!stackPtr->is_num)
+        stackPtr->points(); // evaluates recorded ops
+    else if (stackPtr->num != 0.)
+        throw ExecuteError("dataset or 0 expected on RHS");
+    result->swap(*stackPtr);
+}
 
-    if (!stackPtr->is_num) {
-        data_out->set_points(stackPtr->points);
-        data_out->set_title(stackPtr->title);
-    } else if (stackPtr->num == 0.)
+void store_data_transform(DtStackItem& r, Data* data_out)
+{
+    if (!r.is_num) {
+        // copy points only if they are referenced from other dataset
+        if (r.src != NULL)
+            data_out->set_points(*r.src);
+        else
+            data_out->set_points(std::move(r.own));
+        data_out->set_title(r.title);
+    } else
         data_out->clear();
-    else
-        throw ExecuteError("dataset or 0 expected on RHS");
+}
+
+} // anonymous namespace
+
+namespace fityk {
+
+/// executes VM code and stores results in dataset `data_out'
+void run_data_transform(const DataKeeper& dk, const VMData& vm, Data* data_out)
+{
+    DtInput in = { &dk, NULL, -1 };
+    DtStackItem result;
+    eval_data_transform(in, vm, &result);
+    store_data_transform(result, data_out);
+}
+
+/// executes VM code for each dataset (with @* standing for this dataset)
+/// and stores results in the datasets. Datasets are processed in batches,
+/// datasets in a batch in parallel threads. If max_bytes > 0, the points
+/// in a batch take at most half of max_bytes and DataKeeper::limit_memory()
+/// is called between batches; otherwise, all datasets are one batch.
+void run_data_transform_for_all(DataKeeper& dk, const VMData& vm,
+                                double max_bytes)
+{
+    const int count = dk.count();
+    // datasets given explicitly (@n) are needed in all batches, with their
+    // original points, so results for them are stored after the last batch
+    set<int> referenced;
+    const vector<int>& code = vm.code();
+    for (size_t i = 0; i < code.size(); ++i)
+        if (VMData::has_idx(code[i])) {
+            ++i;
+            if (code[i-1] == OP_DATASET && code[i] != Lexer::kAll)
+                referenced.insert(code[i]);
+        }
+    vector<pair<int, DtStackItem> > deferred;
+
+    // dk.data() is not called in threads, datasets are loaded before,
+    // other items are NULL
+    vector<Data*> datas(count, (Data*) NULL);
+    auto bytes_of = [&](int n) { return dk.point_count(n) * sizeof(Point); };
+    int start = 0;
+    while (start < count) {
+        int end = start + 1;
+        double bytes = bytes_of(start);
+        while (end < count && (max_bytes <= 0 ||
+                               bytes + bytes_of(end) <= max_bytes / 2)) {
+            bytes += bytes_of(end);
+            ++end;
+        }
+        fill(datas.begin(), datas.end(), (Data*) NULL);
+        for (int n : referenced)
+            datas[n] = dk.data(n); // throws if there is no such dataset
+        for (int n = start; n != end; ++n)
+            datas[n] = dk.data(n);
+
+        vector<DtStackItem> results(end - start);
+        atomic<int> next(start);
+        vector<exception_ptr> errors(end - start);
+        auto worker = [&]() {
+            for (int n = next++; n < end; n = next++) {
+                try {
+                    DtInput in = { &dk, &datas, n };
+                    DtStackItem& r = results[n - start];
+                    eval_data_transform(in, vm, &r);
+                    // results can't reference datasets that will be changed
+                    if (!r.is_num)
+                        r.mutable_points();
+                } catch (...) {
+                    errors[n - start] = current_exception();
+                }
+            }
+        };
+        int n_threads = min<int>(max<unsigned>(thread::hardware_concurrency(),
+                                               1),
+                                 end - start);
+        vector<thread> threads;
+        for (int t = 1; t < n_threads; ++t)
+            threads.push_back(thread(worker));
+        worker();
+        for (thread& th : threads)
+            th.join();
+        for (const exception_ptr& e : errors)
+            if (e)
+                rethrow_exception(e);
+
+        for (int n = start; n != end; ++n) {
+            DtStackItem& r = results[n - start];
+            if (referenced.count(n) != 0) {
+                deferred.push_back(make_pair(n, DtStackItem()));
+                deferred.back().second.swap(r);
+            } else
+                store_data_transform(r, datas[n]);
+        }
+        results.clear();
+        if (max_bytes > 0)
+            dk.limit_memory(max_bytes);
+        start = end;
+    }
+    for (size_t i = 0; i != deferred.size(); ++i)
+        store_data_transform(deferred[i].second, dk.data(deferred[i].first));
 }
 
 } // namespace fityk
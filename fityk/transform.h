@@ -13,6 +13,8 @@ class Data;
 class DataKeeper;
 
 void run_data_transform(const DataKeeper& dk, const VMData& vm, Data* data_out);
+void run_data_transform_for_all(DataKeeper& dk, const VMData& vm,
+                                double max_bytes);
 
 } // namespace fityk
 #endif // FITYK_TRANSFORM_H_
@@ -72,15 +72,25 @@ void CompoundFunction::init()
     }
 }
 
-void CompoundFunction::update_var_indices(vector<Variable*> const& variables)
+void CompoundFunction::update_var_indices(const vector<Variable*>& variables,
+                                          const NameIndex* index)
 {
-    Function::update_var_indices(variables);
+    Function::update_var_indices(variables, index);
     for (int i = 0; i < nv(); ++i) {
         const Variable* orig = variables[used_vars_.get_idx(i)];
         intern_variables_[i]->set_original(orig);
     }
 }
 
+void CompoundFunction::count_memory(size_t* cache, size_t* code) const
+{
+    Function::count_memory(cache, code);
+    v_foreach (Variable*, i, intern_variables_)
+        (*i)->count_memory(cache, code);
+    v_foreach (Function*, i, intern_functions_)
+        (*i)->count_memory(cache, code);
+}
+
 void CompoundFunction::more_precomputations()
 {
     vm_foreach (Variable*, i, intern_variables_)
@@ -215,9 +225,10 @@ CustomFunction::~CustomFunction()
 {
 }
 
-void CustomFunction::update_var_indices(const vector<Variable*>& variables)
+void CustomFunction::update_var_indices(const vector<Variable*>& variables,
+                                        const NameIndex* index)
 {
-    Function::update_var_indices(variables);
+    Function::update_var_indices(variables, index);
 
     assert(used_vars().get_count() + 2 == (int) tp_->op_trees.size());
     // we put function's parameter index rather than variable index after
@@ -272,6 +283,13 @@ void CustomFunction::calculate_value_deriv_in_range(const vector<realt> &xx,
     }
 }
 
+void CustomFunction::count_memory(size_t* cache, size_t* code) const
+{
+    Function::count_memory(cache, code);
+    *cache += derivatives_.capacity() * sizeof(realt);
+    *code += vm_.memory_usage() + substituted_vm_.memory_usage();
+}
+
 string CustomFunction::get_bytecode() const
 {
     const VMData& s = substituted_vm_;
@@ -332,15 +350,25 @@ void SplitFunction::init()
     intern_variables_.push_back(v);
 }
 
-void SplitFunction::update_var_indices(vector<Variable*> const& variables)
+void SplitFunction::update_var_indices(const vector<Variable*>& variables,
+                                       const NameIndex* index)
 {
-    Function::update_var_indices(variables);
+    Function::update_var_indices(variables, index);
     for (int i = 0; i < nv(); ++i) {
         const Variable* orig = variables[used_vars_.get_idx(i)];
         intern_variables_[i]->set_original(orig);
     }
 }
 
+void SplitFunction::count_memory(size_t* cache, size_t* code) const
+{
+    Function::count_memory(cache, code);
+    v_foreach (Variable*, i, intern_variables_)
+        (*i)->count_memory(cache, code);
+    left_->count_memory(cache, code);
+    right_->count_memory(cache, code);
+}
+
 void SplitFunction::more_precomputations()
 {
     vm_foreach (Variable*, i, intern_variables_)
@@ -38,7 +38,9 @@ public:
     bool get_fwhm(realt* a) const;
     bool get_area(realt* a) const;
     bool get_nonzero_range(double level, realt& left, realt& right) const;
-    void update_var_indices(const std::vector<Variable*>& variables);
+    void update_var_indices(const std::vector<Variable*>& variables,
+                            const NameIndex* index=NULL);
+    void count_memory(size_t* cache, size_t* code) const;
 
 protected:
     std::vector<Variable*> intern_variables_;
@@ -71,7 +73,9 @@ public:
                                         int first, int last) const;
     std::string get_current_formula(const std::string& x,
                                     const char *num_fmt) const;
-    void update_var_indices(std::vector<Variable*> const& variables);
+    void update_var_indices(const std::vector<Variable*>& variables,
+                            const NameIndex* index=NULL);
+    void count_memory(size_t* cache, size_t* code) const;
     std::string get_bytecode() const;
 
 
@@ -117,7 +121,9 @@ public:
     bool get_fwhm(realt* a) const;
     bool get_area(realt* a) const;
     bool get_nonzero_range(double level, realt& left, realt& right) const;
-    void update_var_indices(const std::vector<Variable*>& variables);
+    void update_var_indices(const std::vector<Variable*>& variables,
+                            const NameIndex* index=NULL);
+    void count_memory(size_t* cache, size_t* code) const;
 
 private:
     std::vector<Variable*> intern_variables_;
@@ -145,10 +145,20 @@ string UserInterface::get_history_summary() const
 
 
 UserInterface::UserInterface(BasicContext* ctx, CommandExecutor* ce)
-        : ctx_(ctx), cmd_executor_(ce), cmd_count_(0), dirty_plot_(false)
+        : ctx_(ctx), cmd_executor_(ce), cmd_count_(0), dirty_plot_(false),
+          message_sink_(NULL)
 {
 }
 
+void UserInterface::show_message(Style style, const string& s) const
+{
+    if (message_sink_) {
+        if (style != kInput)
+            fprintf(message_sink_, "%s\n", s.c_str());
+    } else if (show_message_callback_)
+        (*show_message_callback_)(style, s);
+}
+
 UiApi::Status UserInterface::exec_and_log(const string& c)
 {
     if (strip_string(c).empty())
@@ -253,7 +263,7 @@ private:
 
 void UserInterface::exec_fityk_script(const string& filename)
 {
-    user_interrupt = 0;
+    std::sig_atomic_t interrupt_mark = user_interrupt;
 
     unique_ptr<FileOpener> opener;
     if (endswith(filename, ".gz"))
@@ -288,7 +298,7 @@ void UserInterface::exec_fityk_script(const string& filename)
         if (r != kStatusOk &&
                 ctx_->get_settings()->on_error[0] != 'n' /*nothing*/)
             break;
-        if (user_interrupt) {
+        if (user_interrupt != interrupt_mark) {
             mesg("Script stopped by signal INT.");
             break;
         }
@@ -5,6 +5,7 @@
 #define FITYK_UI_H_
 
 #include <csignal> // sig_atomic_t
+#include <cstdio> // FILE
 #include "common.h"
 #include "ui_api.h"
 
@@ -45,6 +46,10 @@ public:
     /// Send implicitely requested message
     void mesg(std::string const &s) const { output_message(kNormal, s); }
 
+    /// if set (not NULL), messages are written to this stream instead of
+    /// being passed to the show_message callback
+    void set_message_sink(FILE* stream) { message_sink_ = stream; }
+
 
     /// Excute commands from file, i.e. run a script (.fit).
     void exec_fityk_script(const std::string& filename);
@@ -81,10 +86,10 @@ private:
     int cmd_count_; //!=cmds_.size() if max_cmd was exceeded
     std::vector<Cmd> cmds_;
     bool dirty_plot_;
+    FILE* message_sink_;
 
     /// show message to user
-    void show_message(Style style, const std::string& s) const
-        { if (show_message_callback_) (*show_message_callback_)(style, s); }
+    void show_message(Style style, const std::string& s) const;
 
     // It can finish the program (eg. if s=="quit").
     UiApi::Status execute_line_via_callback(const std::string& s);
@@ -92,6 +97,8 @@ private:
     DISALLOW_COPY_AND_ASSIGN(UserInterface);
 };
 
+/// incremented by interrupt_computations(); computations save the value
+/// when they start and stop when it changes
 extern volatile std::sig_atomic_t user_interrupt;
 
 } // namespace fityk
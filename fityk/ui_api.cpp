@@ -56,7 +56,8 @@ volatile std::sig_atomic_t user_interrupt = 0;
 
 void interrupt_computations()
 {
-    user_interrupt = 1;
+    // a counter, not a flag, so that no engine needs to reset it
+    user_interrupt = user_interrupt + 1;
 }
 
 static
@@ -8,6 +8,8 @@
 
 #include <stdlib.h>
 #include <algorithm>
+#include <atomic>
+#include <map>
 
 using namespace std;
 
@@ -16,23 +18,45 @@ namespace fityk {
 /// checks if *this depends (directly or indirectly) on variable with index idx
 bool IndexedVars::depends_on(int idx, vector<Variable*> const &variables) const
 {
-    v_foreach (int, i, indices_)
-        if (*i == idx || variables[*i]->used_vars().depends_on(idx, variables))
+    // each variable is visited once, plain recursion would be exponential
+    // in the depth of graphs where variables share dependencies
+    vector<bool> visited(variables.size(), false);
+    vector<int> stack(indices_);
+    while (!stack.empty()) {
+        int v = stack.back();
+        stack.pop_back();
+        if (v == idx)
             return true;
+        if (visited[v])
+            continue;
+        visited[v] = true;
+        const vector<int>& used = variables[v]->used_vars().indices();
+        stack.insert(stack.end(), used.begin(), used.end());
+    }
     return false;
 }
 
-void IndexedVars::update_indices(vector<Variable*> const &variables)
+void IndexedVars::update_indices(vector<Variable*> const &variables,
+                                 const NameIndex* index)
 {
     const int n = names_.size();
     indices_.resize(n);
     for (int v = 0; v < n; ++v) {
         bool found = false;
-        for (int i = 0; i < size(variables); ++i) {
-            if (names_[v] == variables[i]->name) {
-                indices_[v] = i;
+        if (index != NULL) {
+            NameIndex::const_iterator it = index->find(names_[v]);
+            if (it != index->end()) {
+                assert(variables[it->second]->name == names_[v]);
+                indices_[v] = it->second;
                 found = true;
-                break;
+            }
+        } else {
+            for (int i = 0; i < size(variables); ++i) {
+                if (names_[v] == variables[i]->name) {
+                    indices_[v] = i;
+                    found = true;
+                    break;
+                }
             }
         }
         if (!found)
@@ -50,9 +74,15 @@ int IndexedVars::get_max_idx() const
 
 ////////////////////////////////////////////////////////////////////////////
 
+unsigned long new_chain_id()
+{
+    static std::atomic<unsigned long> counter(0);
+    return ++counter;
+}
+
 // ctor for simple variables and mirror variables
 Variable::Variable(string const &name_, int gpos)
-    : Var(name_, gpos), original_(NULL)
+    : Var(name_, gpos), original_(NULL), chain_id_(new_chain_id())
 {
     assert(!name_.empty());
     if (gpos_ != -2) {
@@ -67,7 +97,8 @@ Variable::Variable(string const &name_, int gpos)
 Variable::Variable(string const &name_, vector<string> const &vars,
                    vector<OpTree*> const &op_trees)
     : Var(name_, -1), used_vars_(vars),
-      derivatives_(vars.size()), op_trees_(op_trees), original_(NULL)
+      derivatives_(vars.size()), op_trees_(op_trees), original_(NULL),
+      chain_id_(new_chain_id())
 {
     assert(!name_.empty());
 }
@@ -77,9 +108,10 @@ Variable::~Variable()
     purge_all_elements(op_trees_);
 }
 
-void Variable::set_var_idx(vector<Variable*> const& variables)
+void Variable::set_var_idx(vector<Variable*> const& variables,
+                           const NameIndex* index)
 {
-    used_vars_.update_indices(variables);
+    used_vars_.update_indices(variables, index);
     if (gpos_ == -1) {
         /// (re-)create bytecode, required after update_indices()
         assert(used_vars_.indices().size() + 1 == op_trees_.size());
@@ -95,6 +127,15 @@ void Variable::set_var_idx(vector<Variable*> const& variables)
     }
 }
 
+void Variable::count_memory(size_t* cache, size_t* code) const
+{
+    *cache += sizeof(*this) + derivatives_.capacity() * sizeof(realt)
+              + recursive_derivatives_.capacity() * sizeof(ParMult)
+              + chain_.capacity() * sizeof(ChainTerm)
+              + used_chain_ids_.capacity() * sizeof(unsigned long);
+    *code += vm_.memory_usage();
+}
+
 string Variable::get_formula(vector<realt> const &parameters) const
 {
     if (gpos_ >= 0)
@@ -116,31 +157,72 @@ void Variable::recalculate(vector<Variable*> const &variables,
         assert(derivatives_.empty());
     } else if (gpos_ == -1) {
         value_ = run_code_for_variable(vm_, variables, derivatives_);
-        recursive_derivatives_.clear();
-        for (int i = 0; i < size(derivatives_); ++i) {
-            Variable *v = variables[used_vars_.get_idx(i)];
-            v_foreach (ParMult, j, v->recursive_derivatives()) {
-                recursive_derivatives_.push_back(*j);
-                recursive_derivatives_.back().mult *= derivatives_[i];
-            }
+        if (!is_chain_current(variables))
+            compile_chain(variables);
+        for (ParMult& pm : recursive_derivatives_)
+            pm.mult = 0.;
+        for (const ChainTerm& t : chain_) {
+            const Variable *v = variables[used_vars_.get_idx(t.n)];
+            recursive_derivatives_[t.k].mult +=
+                derivatives_[t.n] * v->recursive_derivatives_[t.j].mult;
         }
     } else if (gpos_ == -2) {
         if (original_) {
             value_ = original_->value_;
             recursive_derivatives_ = original_->recursive_derivatives_;
+            chain_id_ = original_->chain_id_;
         }
     } else
         assert(0);
 }
 
-void Variable::erased_parameter(int k)
+bool Variable::is_chain_current(const vector<Variable*> &variables) const
 {
-    if (gpos_ != -1 && gpos_ > k)
-            --gpos_;
-    for (vector<ParMult>::iterator i = recursive_derivatives_.begin();
-                                        i != recursive_derivatives_.end(); ++i)
-        if (i->p > k)
-            -- i->p;
+    if (used_chain_ids_.size() != derivatives_.size())
+        return false;
+    for (size_t i = 0; i != used_chain_ids_.size(); ++i)
+        if (variables[used_vars_.get_idx(i)]->chain_id_ != used_chain_ids_[i])
+            return false;
+    return true;
+}
+
+// Each parameter gets only one item in recursive_derivatives_, even if
+// it is reached through many paths, so the size of recursive_derivatives_
+// doesn't grow with the depth of the variable graph.
+void Variable::compile_chain(const vector<Variable*> &variables)
+{
+    recursive_derivatives_.clear();
+    chain_.clear();
+    used_chain_ids_.resize(derivatives_.size());
+    map<int, int> par_to_k;
+    for (int i = 0; i < size(derivatives_); ++i) {
+        const Variable *v = variables[used_vars_.get_idx(i)];
+        used_chain_ids_[i] = v->chain_id_;
+        for (int j = 0; j < size(v->recursive_derivatives_); ++j) {
+            int p = v->recursive_derivatives_[j].p;
+            map<int, int>::const_iterator it = par_to_k.find(p);
+            int k;
+            if (it != par_to_k.end()) {
+                k = it->second;
+            } else {
+                k = recursive_derivatives_.size();
+                par_to_k[p] = k;
+                ParMult pm = { p, 0. };
+                recursive_derivatives_.push_back(pm);
+            }
+            ChainTerm t = { k, i, j };
+            chain_.push_back(t);
+        }
+    }
+    chain_id_ = new_chain_id();
+}
+
+void Variable::renumber_parameters(const vector<int>& new_gpos)
+{
+    if (gpos_ >= 0)
+        gpos_ = new_gpos[gpos_];
+    for (ParMult& pm : recursive_derivatives_)
+        pm.p = new_gpos[pm.p];
 }
 
 bool Variable::is_constant() const
@@ -5,6 +5,7 @@
 #define FITYK_VAR_H_
 
 #include <assert.h>
+#include <unordered_map>
 #include "common.h"
 #include "vm.h"
 
@@ -12,6 +13,9 @@ namespace fityk {
 struct OpTree;
 class Variable;
 
+/// maps names of variables to their positions in a vector of variables
+typedef std::unordered_map<std::string, int> NameIndex;
+
 class FITYK_API IndexedVars
 {
 public:
@@ -34,7 +38,9 @@ public:
 
     void set_name(int n, const std::string &new_p)
                          { assert(is_index(n, names_)); names_[n] = new_p; }
-    void update_indices(const std::vector<Variable*>& variables);
+    // index (if given) must correspond to variables
+    void update_indices(const std::vector<Variable*>& variables,
+                        const NameIndex* index=NULL);
 
 private:
     // variable names
@@ -60,6 +66,12 @@ private:
 ///    (VMData, again) that will be used to calculate value and derivatives.
 /// -  recalculate() calculates (using run_code_for_variable()) value
 ///    and derivatives for current parameter value
+///
+/// Derivatives with respect to parameters (recursive_derivatives()) are
+/// calculated using the chain rule. The structure of this calculation
+/// (chain_) is compiled once and recompiled only when any of the used
+/// variables changes its chain_id(); in other calls only multipliers
+/// are updated.
 
 class FITYK_API Variable : public Var
 {
@@ -74,9 +86,11 @@ public:
     void recalculate(const std::vector<Variable*> &variables,
                      const std::vector<realt> &parameters);
 
-    void erased_parameter(int k);
+    /// new_gpos[old_gpos] is new position of parameter (-1 if erased)
+    void renumber_parameters(const std::vector<int>& new_gpos);
     bool is_visible() const { return true; } //for future use
-    void set_var_idx(const std::vector<Variable*> &variables);
+    void set_var_idx(const std::vector<Variable*> &variables,
+                     const NameIndex* index=NULL);
     const std::vector<ParMult>& recursive_derivatives() const
                                             { return recursive_derivatives_; }
     std::vector<OpTree*> const& get_op_trees() const { return op_trees_; }
@@ -84,15 +98,35 @@ public:
                                  { assert(gpos_ == -2); original_ = orig; }
     realt get_derivative(int n) const { return derivatives_[n]; }
     const IndexedVars& used_vars() const { return used_vars_; }
+    /// adds approximate memory (in bytes) taken by cached derivatives
+    /// and by bytecode to *cache and *code
+    void count_memory(size_t* cache, size_t* code) const;
+    /// unique id of the current structure of recursive_derivatives()
+    unsigned long chain_id() const { return chain_id_; }
 
 private:
+    // one term of the chain rule:
+    // recursive_derivatives_[k].mult += derivatives_[n] * mult of
+    //                   j-th recursive derivative of n-th used variable
+    struct ChainTerm { int k; int n; int j; };
+
     IndexedVars used_vars_;
     std::vector<realt> derivatives_;
     std::vector<ParMult> recursive_derivatives_;
     std::vector<OpTree*> op_trees_;
     VMData vm_;
     Variable const* original_;
+    std::vector<ChainTerm> chain_;
+    // chain_id() of used variables when chain_ was compiled
+    std::vector<unsigned long> used_chain_ids_;
+    unsigned long chain_id_;
+
+    bool is_chain_current(const std::vector<Variable*> &variables) const;
+    void compile_chain(const std::vector<Variable*> &variables);
 };
 
+/// returns a new value for Variable::chain_id(), unique in the program
+unsigned long new_chain_id();
+
 } // namespace fityk
 #endif // FITYK_VAR_H_
@@ -7,6 +7,8 @@
 
 #include <boost/math/special_functions/gamma.hpp>
 #include <boost/math/special_functions/digamma.hpp>
+#include <exception>
+#include <thread>
 
 #include "common.h"
 #include "voigt.h"
@@ -67,8 +69,9 @@ realt find_idx_in_sorted(vector<Point> const& pp, realt x)
         return 0;
     else if (x >= pp.back().x)
         return pp.size() - 1;
-    vector<Point>::const_iterator i = lower_bound(pp.begin(), pp.end(),
-                                                  Point(x, 0));
+    // step is only a hint, makes the search O(1) for evenly spaced points
+    double step = (pp.back().x - pp.front().x) / (pp.size() - 1);
+    vector<Point>::const_iterator i = pp.begin() + lower_bound_idx(pp, x, step);
     assert (i > pp.begin() && i < pp.end());
     if (is_eq(x, i->x))
         return i - pp.begin();
@@ -110,6 +113,10 @@ string op2str(int op)
         OP_(NUMAREA) OP_(FINDX) OP_(FIND_EXTR)
         OP_(TILDE)
         OP_(DATASET) OP_(DT_SUM_SAME_X) OP_(DT_AVG_SAME_X) OP_(DT_SHIRLEY_BG) OP_(DT_SNIP_BG)
+        OP_(DT_FFT_RE) OP_(DT_FFT_IM) OP_(DT_FFT_AMP)
+        OP_(DT_CONVOLVE) OP_(DT_DECONVOLVE) OP_(DT_LOWPASS)
+        OP_(DT_SAVITZKY_GOLAY) OP_(DT_MOVING_AVG) OP_(DT_MEDIAN_FILTER)
+        OP_(DT_WHITTAKER) OP_(DT_RESAMPLE) OP_(DT_RESAMPLE_CUBIC) OP_(DT_REBIN)
         OP_(OPEN_ROUND)  OP_(OPEN_SQUARE)
     }
     return S(op); // unreachable (if all OPs are listed above)
@@ -335,11 +342,15 @@ void run_const_op(const Full* F, const std::vector<realt>& numbers,
             break;
         case OP_RANDU:
             STACK_OFFSET_CHANGE(-1);
-            *stackPtr = rand_uniform(*stackPtr, *(stackPtr+1));
+            if (F == NULL)
+                throw ExecuteError("randuniform() can't be used here.");
+            *stackPtr = F->rng().rand_uniform(*stackPtr, *(stackPtr+1));
             break;
         case OP_RANDNORM:
             STACK_OFFSET_CHANGE(-1);
-            *stackPtr += rand_gauss() * *(stackPtr+1);
+            if (F == NULL)
+                throw ExecuteError("randnormal() can't be used here.");
+            *stackPtr += F->rng().rand_gauss() * *(stackPtr+1);
             break;
         case OP_ADD:
             STACK_OFFSET_CHANGE(-1);
@@ -647,11 +658,586 @@ void run_func_op(const vector<realt>& numbers, vector<int>::const_iterator &i,
 }
 
 
+namespace {
+
+// Column-oriented execution of data transformations (X=..., Y=...).
+// Each op is applied to a chunk of points before the next op is executed,
+// so the code is interpreted once per chunk, not once per point,
+// and the inner loops can be vectorized by the compiler.
+// It gives the same results as the point-by-point execution only if
+// the result for point n doesn't depend on new values of other points
+// (like in Y=Y[n-1]+y) and on the order of evaluation (randnormal()),
+// see analyze_for_columns().
+
+const int kChunkSize = 1024;
+// large datasets are split between threads
+const int kMinPointsPerThread = 65536;
+
+struct ColumnPlan
+{
+    int depth;          // max. stack depth, -1 if columns can't be used
+    bool in_place;      // old_points can be the same vector as new_points
+    bool thread_safe;   // can be split between threads
+};
+
+bool is_upper_point_op(int op)
+{
+    return op == OP_PX || op == OP_PY || op == OP_PS || op == OP_PA;
+}
+
+bool is_lower_point_op(int op)
+{
+    return op == OP_Px || op == OP_Py || op == OP_Ps || op == OP_Pa;
+}
+
+// index of the field of Point used by OP_Px, OP_PX, OP_ASSIGN_X, etc.
+int point_field(int op)
+{
+    switch (op) {
+        case OP_Px: case OP_PX: case OP_ASSIGN_X: return 0;
+        case OP_Py: case OP_PY: case OP_ASSIGN_Y: return 1;
+        case OP_Ps: case OP_PS: case OP_ASSIGN_S: return 2;
+        default: return 3;
+    }
+}
+
+ColumnPlan analyze_for_columns(const VMData& vm)
+{
+    ColumnPlan plan = { -1, true, true };
+    const vector<int>& code = vm.code();
+    int depth = 0, max_depth = 0;
+    bool conditional = false, special_func = false, indexed = false;
+    bool assigned[4] = { false, false, false, false };
+    int prev = -1;
+    for (size_t i = 0; i < code.size(); ++i) {
+        int op = code[i];
+        if (op >= OP_ONE_ARG && op < OP_TWO_ARG) {
+            if (op == OP_GAMMA || op == OP_LGAMMA || op == OP_DIGAMMA)
+                special_func = true; // they can throw exceptions
+        } else if (op >= OP_TWO_ARG && op <= OP_NEQ) {
+            if (op == OP_RANDNORM || op == OP_RANDU)
+                return plan; // the order of random numbers would change
+            --depth;
+        } else {
+            switch (op) {
+                case OP_NUMBER:
+                case OP_PM:
+                    ++depth;
+                    break;
+                case OP_Pn:
+                    ++depth;
+                    if (i+1 < code.size() && is_lower_point_op(code[i+1])
+                            && assigned[point_field(code[i+1])])
+                        plan.in_place = false;
+                    break;
+                case OP_Px: case OP_Py: case OP_Ps: case OP_Pa:
+                    if (prev != OP_Pn) {
+                        plan.in_place = false; // e.g. y[n-1]
+                        indexed = true;
+                    }
+                    break;
+                case OP_PX: case OP_PY: case OP_PS: case OP_PA:
+                    if (prev != OP_Pn)
+                        return plan; // e.g. Y[n-1]
+                    break;
+                case OP_XINDEX:
+                    plan.in_place = false;
+                    indexed = true;
+                    break;
+                case OP_NOT:
+                case OP_AFTER_AND:
+                case OP_AFTER_OR:
+                    if (op != OP_NOT)
+                        --depth;
+                    break;
+                case OP_AND:
+                case OP_OR:
+                case OP_TERNARY:
+                    conditional = true;
+                    break;
+                case OP_TERNARY_MID:
+                case OP_TILDE:
+                    break;
+                case OP_AFTER_TERNARY:
+                    depth -= 2;
+                    break;
+                case OP_FUNC:
+                case OP_SUM_F:
+                case OP_SUM_Z:
+                    // functions use internal buffers
+                    plan.thread_safe = false;
+                    break;
+                case OP_ASSIGN_X: case OP_ASSIGN_Y:
+                case OP_ASSIGN_S: case OP_ASSIGN_A:
+                    assigned[point_field(op)] = true;
+                    --depth;
+                    break;
+                default:
+                    return plan;
+            }
+        }
+        if (VMData::has_idx(op))
+            ++i;
+        prev = op;
+        if (depth < 0)
+            return plan;
+        max_depth = max(max_depth, depth);
+    }
+    // branches are evaluated for all points, exceptions can't be ignored,
+    // and an index in the branch not taken can be NaN (y[ln(x)] for x<0)
+    if (conditional && (special_func || indexed))
+        return plan;
+    // the point-by-point execution would report stack overflow
+    if (depth != 0 || max_depth == 0 || max_depth > 16)
+        return plan;
+    // after an exception the points must be left unchanged
+    if (special_func || !plan.thread_safe)
+        plan.in_place = false;
+    plan.depth = max_depth;
+    return plan;
+}
+
+// one item of the stack; constants are not expanded to columns
+struct Column
+{
+    realt* v; // kChunkSize values, used if !is_const; fixed for each slot
+    bool is_const;
+    realt c;
+};
+
+template<typename Fn>
+void apply1(Column& a, int len, Fn fn)
+{
+    if (a.is_const)
+        a.c = fn(a.c);
+    else
+        for (int k = 0; k < len; ++k)
+            a.v[k] = fn(a.v[k]);
+}
+
+template<typename Fn>
+void apply2(Column& a, const Column& b, int len, Fn fn)
+{
+    if (a.is_const && b.is_const) {
+        a.c = fn(a.c, b.c);
+    } else if (b.is_const) {
+        realt c = b.c;
+        for (int k = 0; k < len; ++k)
+            a.v[k] = fn(a.v[k], c);
+    } else if (a.is_const) {
+        realt c = a.c;
+        for (int k = 0; k < len; ++k)
+            a.v[k] = fn(c, b.v[k]);
+        a.is_const = false;
+    } else {
+        for (int k = 0; k < len; ++k)
+            a.v[k] = fn(a.v[k], b.v[k]);
+    }
+}
+
+void load_field(realt* v, const Point* p, int len, int op)
+{
+    switch (point_field(op)) {
+        case 0:
+            for (int k = 0; k < len; ++k)
+                v[k] = p[k].x;
+            break;
+        case 1:
+            for (int k = 0; k < len; ++k)
+                v[k] = p[k].y;
+            break;
+        case 2:
+            for (int k = 0; k < len; ++k)
+                v[k] = p[k].sigma;
+            break;
+        default:
+            for (int k = 0; k < len; ++k)
+                v[k] = p[k].is_active ? 1. : 0.;
+    }
+}
+
+realt get_field_with_idx(realt idx, const vector<Point>& points, int op)
+{
+    switch (point_field(op)) {
+        case 0: return get_var_with_idx(idx, points, &Point::x);
+        case 1: return get_var_with_idx(idx, points, &Point::y);
+        case 2: return get_var_with_idx(idx, points, &Point::sigma);
+        default: return as_bool(get_var_with_idx(idx, points,
+                                                 &Point::is_active));
+    }
+}
+
+class ColumnRunner
+{
+public:
+    ColumnRunner(const Full* F, const VMData& vm, int depth,
+                 const vector<Point>& old_points, vector<Point>& new_points)
+        : F_(F), vm_(vm), old_(old_points), new_(new_points),
+          buf_(depth * kChunkSize), stack_(depth)
+    {
+        for (int k = 0; k != depth; ++k)
+            stack_[k].v = &buf_[k * kChunkSize];
+    }
+
+    // transforms points [start, end)
+    void run(int start, int end)
+    {
+        for (int n = start; n < end; n += kChunkSize)
+            run_chunk(n, min(end - n, kChunkSize));
+    }
+
+private:
+    const Full* F_;
+    const VMData& vm_;
+    const vector<Point>& old_;
+    vector<Point>& new_;
+    vector<realt> buf_;
+    vector<Column> stack_;
+
+    void run_chunk(int start, int len);
+    void assign(const Column& col, int start, int len, int op);
+};
+
+void ColumnRunner::run_chunk(int start, int len)
+{
+    const vector<int>& code = vm_.code();
+    const vector<realt>& numbers = vm_.numbers();
+    Column* top = &stack_[0] - 1;
+    for (vector<int>::const_iterator i = code.begin(); i != code.end(); ++i) {
+        switch (*i) {
+            case OP_NUMBER:
+                ++top;
+                top->is_const = true;
+                top->c = numbers[*++i];
+                break;
+            case OP_PM:
+                ++top;
+                top->is_const = true;
+                top->c = static_cast<realt>(old_.size());
+                break;
+            case OP_Pn:
+                ++top;
+                top->is_const = false;
+                if (is_lower_point_op(*(i+1))) {
+                    ++i;
+                    load_field(top->v, &old_[start], len, *i);
+                } else if (is_upper_point_op(*(i+1))) {
+                    ++i;
+                    load_field(top->v, &new_[start], len, *i);
+                } else {
+                    for (int k = 0; k < len; ++k)
+                        top->v[k] = static_cast<realt>(start + k);
+                }
+                break;
+            case OP_Px: case OP_Py: case OP_Ps: case OP_Pa: {
+                int op = *i;
+                const vector<Point>& pp = old_;
+                apply1(*top, len, [&](realt idx) {
+                        return get_field_with_idx(idx, pp, op); });
+                break;
+            }
+
+            case OP_NEG:
+                apply1(*top, len, [](realt a) { return -a; });
+                break;
+            case OP_SQRT:
+                apply1(*top, len, [](realt a) { return sqrt(a); });
+                break;
+            case OP_GAMMA:
+                apply1(*top, len, [](realt a) {
+                        return boost::math::tgamma(a); });
+                break;
+            case OP_LGAMMA:
+                apply1(*top, len, [](realt a) {
+                        return boost::math::lgamma(a); });
+                break;
+            case OP_DIGAMMA:
+                apply1(*top, len, [](realt a) {
+                        return boost::math::digamma(a); });
+                break;
+            case OP_EXP:
+                apply1(*top, len, [](realt a) { return exp(a); });
+                break;
+            case OP_ERFC:
+                apply1(*top, len, [](realt a) { return erfc(a); });
+                break;
+            case OP_ERF:
+                apply1(*top, len, [](realt a) { return erf(a); });
+                break;
+            case OP_LOG10:
+                apply1(*top, len, [](realt a) { return log10(a); });
+                break;
+            case OP_LN:
+                apply1(*top, len, [](realt a) { return log(a); });
+                break;
+            case OP_SIN:
+                apply1(*top, len, [](realt a) { return sin(a); });
+                break;
+            case OP_COS:
+                apply1(*top, len, [](realt a) { return cos(a); });
+                break;
+            case OP_TAN:
+                apply1(*top, len, [](realt a) { return tan(a); });
+                break;
+            case OP_SINH:
+                apply1(*top, len, [](realt a) { return sinh(a); });
+                break;
+            case OP_COSH:
+                apply1(*top, len, [](realt a) { return cosh(a); });
+                break;
+            case OP_TANH:
+                apply1(*top, len, [](realt a) { return tanh(a); });
+                break;
+            case OP_ATAN:
+                apply1(*top, len, [](realt a) { return atan(a); });
+                break;
+            case OP_ASIN:
+                apply1(*top, len, [](realt a) { return asin(a); });
+                break;
+            case OP_ACOS:
+                apply1(*top, len, [](realt a) { return acos(a); });
+                break;
+            case OP_ABS:
+                apply1(*top, len, [](realt a) { return fabs(a); });
+                break;
+            case OP_ROUND:
+                apply1(*top, len, [](realt a) { return floor(a + 0.5); });
+                break;
+            case OP_NOT:
+                apply1(*top, len, [](realt a) -> realt {
+                        return is_eq(a, 0.); });
+                break;
+            case OP_XINDEX: {
+                const vector<Point>& pp = old_;
+                apply1(*top, len, [&](realt a) {
+                        return find_idx_in_sorted(pp, a); });
+                break;
+            }
+            case OP_FUNC: {
+                const Function* f = F_->mgr.get_function(*++i);
+                apply1(*top, len, [f](realt a) {
+                        return f->calculate_value(a); });
+                break;
+            }
+            case OP_SUM_F: {
+                const Model* model = F_->dk.get_model(*++i);
+                apply1(*top, len, [model](realt a) {
+                        return model->value(a); });
+                break;
+            }
+            case OP_SUM_Z: {
+                const Model* model = F_->dk.get_model(*++i);
+                apply1(*top, len, [model](realt a) {
+                        return model->zero_shift(a); });
+                break;
+            }
+
+            case OP_ADD:
+                --top;
+                apply2(*top, *(top+1), len, [](realt a, realt b) {
+                        return a + b; });
+                break;
+            case OP_SUB:
+                --top;
+                apply2(*top, *(top+1), len, [](realt a, realt b) {
+                        return a - b; });
+                break;
+            case OP_MUL:
+                --top;
+                apply2(*top, *(top+1), len, [](realt a, realt b) {
+                        return a * b; });
+                break;
+            case OP_DIV:
+                --top;
+                apply2(*top, *(top+1), len, [](realt a, realt b) {
+                        return a / b; });
+                break;
+            case OP_MOD:
+                --top;
+                apply2(*top, *(top+1), len, [](realt a, realt b) {
+                        return a - floor(a / b) * b; });
+                break;
+            case OP_POW:
+                --top;
+                apply2(*top, *(top+1), len, [](realt a, realt b) {
+                        return pow(a, b); });
+                break;
+            case OP_MIN2:
+                --top;
+                apply2(*top, *(top+1), len, [](realt a, realt b) {
+                        return min(a, b); });
+                break;
+            case OP_MAX2:
+                --top;
+                apply2(*top, *(top+1), len, [](realt a, realt b) {
+                        return max(a, b); });
+                break;
+            case OP_VOIGT:
+                --top;
+                apply2(*top, *(top+1), len, [](realt a, realt b) {
+                        return humlik(a, b) / sqrt(M_PI); });
+                break;
+            case OP_DVOIGT_DX:
+                --top;
+                apply2(*top, *(top+1), len, [](realt a, realt b) {
+                        return humdev_dkdx(a, b) / sqrt(M_PI); });
+                break;
+            case OP_DVOIGT_DY:
+                --top;
+                apply2(*top, *(top+1), len, [](realt a, realt b) {
+                        return humdev_dkdy(a, b) / sqrt(M_PI); });
+                break;
+            case OP_LT:
+                --top;
+                apply2(*top, *(top+1), len, [](realt a, realt b) -> realt {
+                        return is_lt(a, b); });
+                break;
+            case OP_GT:
+                --top;
+                apply2(*top, *(top+1), len, [](realt a, realt b) -> realt {
+                        return is_gt(a, b); });
+                break;
+            case OP_LE:
+                --top;
+                apply2(*top, *(top+1), len, [](realt a, realt b) -> realt {
+                        return is_le(a, b); });
+                break;
+            case OP_GE:
+                --top;
+                apply2(*top, *(top+1), len, [](realt a, realt b) -> realt {
+                        return is_ge(a, b); });
+                break;
+            case OP_EQ:
+                --top;
+                apply2(*top, *(top+1), len, [](realt a, realt b) -> realt {
+                        return is_eq(a, b); });
+                break;
+            case OP_NEQ:
+                --top;
+                apply2(*top, *(top+1), len, [](realt a, realt b) -> realt {
+                        return is_neq(a, b); });
+                break;
+
+            // both operands are evaluated and then one of them is selected
+            case OP_AND:
+            case OP_OR:
+            case OP_TERNARY:
+            case OP_TERNARY_MID:
+            case OP_TILDE:
+                break;
+            case OP_AFTER_AND:
+                --top;
+                apply2(*top, *(top+1), len, [](realt a, realt b) {
+                        return is_neq(a, 0) ? b : a; });
+                break;
+            case OP_AFTER_OR:
+                --top;
+                apply2(*top, *(top+1), len, [](realt a, realt b) {
+                        return is_neq(a, 0) ? a : b; });
+                break;
+            case OP_AFTER_TERNARY: {
+                top -= 2;
+                // if the condition is constant, select one of the columns
+                Column& cond = *top;
+                const Column& yes = *(top+1);
+                const Column& no = *(top+2);
+                if (cond.is_const) {
+                    const Column& sel = (cond.c ? yes : no);
+                    if (sel.is_const)
+                        cond.c = sel.c;
+                    else {
+                        cond.is_const = false;
+                        copy(sel.v, sel.v + len, cond.v);
+                    }
+                    break;
+                }
+                for (int k = 0; k < len; ++k) {
+                    const Column& s = (cond.v[k] ? yes : no);
+                    cond.v[k] = s.is_const ? s.c : s.v[k];
+                }
+                break;
+            }
+
+            case OP_ASSIGN_X: case OP_ASSIGN_Y:
+            case OP_ASSIGN_S: case OP_ASSIGN_A:
+                assign(*top, start, len, *i);
+                --top;
+                break;
+
+            default:
+                assert(0); // excluded in analyze_for_columns()
+        }
+    }
+    assert(top == &stack_[0] - 1);
+}
+
+void ColumnRunner::assign(const Column& col, int start, int len, int op)
+{
+    Point* p = &new_[start];
+    for (int k = 0; k < len; ++k) {
+        realt a = col.is_const ? col.c : col.v[k];
+        switch (op) {
+            case OP_ASSIGN_X: p[k].x = a; break;
+            case OP_ASSIGN_Y: p[k].y = a; break;
+            case OP_ASSIGN_S: p[k].sigma = a; break;
+            default: p[k].is_active = is_neq(a, 0.);
+        }
+    }
+}
+
+void run_by_columns(const Full* F, const VMData& vm, const ColumnPlan& plan,
+                    const vector<Point>& old_points, vector<Point>& new_points)
+{
+    int size = new_points.size();
+    int n_threads = 1;
+    if (plan.thread_safe)
+        n_threads = min<int>(max<unsigned>(thread::hardware_concurrency(), 1),
+                             size / kMinPointsPerThread);
+    if (n_threads <= 1) {
+        ColumnRunner(F, vm, plan.depth, old_points, new_points).run(0, size);
+        return;
+    }
+    vector<thread> threads;
+    vector<exception_ptr> errors(n_threads);
+    for (int t = 0; t < n_threads; ++t) {
+        int start = (long) size * t / n_threads;
+        int end = (long) size * (t+1) / n_threads;
+        threads.push_back(thread([&, t, start, end]() {
+            try {
+                ColumnRunner(F, vm, plan.depth, old_points, new_points)
+                    .run(start, end);
+            } catch (...) {
+                errors[t] = current_exception();
+            }
+        }));
+    }
+    for (thread& th : threads)
+        th.join();
+    for (const exception_ptr& e : errors)
+        if (e)
+            rethrow_exception(e);
+}
+
+} // anonymous namespace
+
 void ExprCalculator::transform_data(vector<Point>& points)
 {
     if (points.empty())
         return;
 
+    ColumnPlan plan = analyze_for_columns(vm_);
+    if (plan.depth >= 0) {
+        if (plan.in_place) {
+            run_by_columns(F_, vm_, plan, points, points);
+        } else {
+            vector<Point> new_points = points;
+            run_by_columns(F_, vm_, plan, points, new_points);
+            points.swap(new_points);
+        }
+        return;
+    }
+
+    // point-by-point execution
     realt stack[16];
     realt* stackPtr = stack - 1; // will be ++'ed first
     vector<Point> new_points = points;
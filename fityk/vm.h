@@ -102,6 +102,19 @@ enum Op
     OP_DT_AVG_SAME_X,
     OP_DT_SHIRLEY_BG,
     OP_DT_SNIP_BG,
+    OP_DT_FFT_RE,
+    OP_DT_FFT_IM,
+    OP_DT_FFT_AMP,
+    OP_DT_CONVOLVE,
+    OP_DT_DECONVOLVE,
+    OP_DT_LOWPASS,
+    OP_DT_SAVITZKY_GOLAY,
+    OP_DT_MOVING_AVG,
+    OP_DT_MEDIAN_FILTER,
+    OP_DT_WHITTAKER,
+    OP_DT_RESAMPLE,
+    OP_DT_RESAMPLE_CUBIC,
+    OP_DT_REBIN,
 
     // these two are not VM operators, but are handy to have here,
     // they and are used in implementation of shunting yard algorithm
@@ -127,6 +140,9 @@ public:
     bool single_symbol() const {return code_.size()==2 && code_[0]==OP_SYMBOL;}
     bool has_op(int op) const;
     std::vector<int>& get_mutable_code() { return code_; }
+    size_t memory_usage() const // in bytes
+        { return code_.capacity() * sizeof(int)
+                 + numbers_.capacity() * sizeof(realt); }
 
 private:
     std::vector<int> code_;    //  VM code
@@ -29,16 +29,18 @@ void humdev(const float x, const float y,
     static const float rrtpi = 0.56418958f; // 1/SQRT(pi)
     static const double drtpi = 0.5641895835477563; // 1/SQRT(pi)
 
-    static float a0, b1, c0, c2, d0, d1, d2, e0, e2, e4, f1, f3, f5,
+    // values cached between calls with the same y (thread_local is for
+    // independent Fityk instances used in parallel)
+    thread_local float a0, b1, c0, c2, d0, d1, d2, e0, e2, e4, f1, f3, f5,
                  g0, g2, g4, g6, h0, h2, h4, h6, p0, p2, p4, p6, p8,
                  q1, q3, q5, q7, r0, r2, w0, w2, w4, z0, z2, z4, z6, z8,
                  mf[6], pf[6], mq[6], mt[6], pq[6], pt[6], xm[6], ym[6],
                  xp[6], yp[6];
 
-    static float old_y = -1.f;
+    thread_local float old_y = -1.f;
 
-    static bool rgb, rgc, rgd;
-    static float yq, xlima, xlimb, xlimc, xlim4;
+    thread_local bool rgb, rgc, rgd;
+    thread_local float yq, xlima, xlimb, xlimc, xlim4;
 
     if (y != old_y) {
         old_y = y;
@@ -250,13 +252,13 @@ float humlik(const float x, const float y)
 
     const float rrtpi = 0.56418958f; // 1/SQRT(pi)
 
-    static float a0, d0, d2, e0, e2, e4, h0, h2, h4, h6,
+    thread_local float a0, d0, d2, e0, e2, e4, h0, h2, h4, h6,
                  p0, p2, p4, p6, p8, z0, z2, z4, z6, z8;
-    static float mf[6], pf[6], mq[6], pq[6], xm[6], ym[6], xp[6], yp[6];
-    static float old_y = -1.f;
-    static bool rg1, rg2, rg3;
-    static float xlim0, xlim1, xlim2, xlim3, xlim4;
-    static float yq, yrrtpi;
+    thread_local float mf[6], pf[6], mq[6], pq[6], xm[6], ym[6], xp[6], yp[6];
+    thread_local float old_y = -1.f;
+    thread_local bool rg1, rg2, rg3;
+    thread_local float xlim0, xlim1, xlim2, xlim3, xlim4;
+    thread_local float yq, yrrtpi;
     if (y != old_y) {
         old_y = y;
         yq = y * y;
@@ -0,0 +1,232 @@
+// Micro-benchmarks of the code paths that dominate fitting time.
+// Not a test -- run with "make bench" and compare the output between builds.
+//
+// Usage: bench [-t seconds] [substring...]
+//   -t  minimal time spent in each benchmark (default: 0.2s)
+//   only benchmarks with names containing any of the substrings are run.
+// Output: tab-separated columns, one line per benchmark:
+//   name, points, parameters, repetitions, seconds per repetition.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <memory>  // for unique_ptr
+#include <string>
+#include <vector>
+#include "fityk/logic.h"
+#include "fityk/data.h"
+#include "fityk/fit.h"
+#include "fityk/func.h"
+#include "fityk/model.h"
+#include "fityk/tplate.h"
+
+using namespace std;
+using namespace fityk;
+
+static double min_time = 0.2;
+static vector<string> filters;
+
+// gives access to protected members of Fit
+class BenchFit : public Fit
+{
+public:
+    BenchFit(Full* F) : Fit(F, "bench") {}
+    void prepare(const vector<Data*>& datas) { update_par_usage(datas); }
+    using Fit::compute_derivatives;
+private:
+    virtual double run_method(vector<realt>*) { return 0.; }
+};
+
+static bool selected(const string& name)
+{
+    if (filters.empty())
+        return true;
+    for (size_t i = 0; i != filters.size(); ++i)
+        if (name.find(filters[i]) != string::npos)
+            return true;
+    return false;
+}
+
+// calls func() repeatedly for at least min_time seconds and prints result
+template<typename T>
+static void run(const string& name, int points, int params, T func)
+{
+    if (!selected(name))
+        return;
+    typedef chrono::steady_clock clock;
+    try {
+        func(); // warm-up
+        int reps = 0;
+        double elapsed;
+        clock::time_point start = clock::now();
+        do {
+            func();
+            ++reps;
+            elapsed = chrono::duration<double>(clock::now() - start).count();
+        } while (elapsed < min_time);
+        printf("%s\t%d\t%d\t%d\t%.4g\n", name.c_str(), points, params, reps,
+               elapsed / reps);
+        fflush(stdout);
+    } catch (const exception& e) {
+        fprintf(stderr, "%s skipped: %s\n", name.c_str(), e.what());
+    }
+}
+
+static Fityk* new_engine()
+{
+    Fityk* ftk = new Fityk;
+    ftk->set_option_as_number("verbosity", -1);
+    ftk->set_option_as_number("pseudo_random_seed", 1);
+    return ftk;
+}
+
+// n points in x = [0, 100) with k Gaussian peaks and noise,
+// the model has k Gaussians with slightly wrong parameters
+static void make_dataset(Fityk* ftk, int n, int k)
+{
+    ftk->execute("M=" + S(n) + "; x=100.*n/M; y=randnormal(0, 0.1); s=0.1");
+    string peaks;
+    for (int i = 0; i != k; ++i) {
+        double ctr = 100. * (i + 0.5) / k;
+        ftk->execute("Y = y + 10*exp(-ln(2)*((x-" + S(ctr) + ")/0.8)^2)");
+        ftk->execute("F += Gaussian(~9.5, ~" + S(ctr + 0.05) + ", ~0.85)");
+    }
+}
+
+static void bench_fit(int n, int k)
+{
+    unique_ptr<Fityk> ftk(new_engine());
+    make_dataset(ftk.get(), n, k);
+    Full* priv = ftk->priv();
+    const vector<Data*>& datas = priv->dk.datas();
+    BenchFit fit(priv);
+    fit.prepare(datas);
+    // alternate two parameter vectors, as it happens during fitting
+    vector<realt> a1 = priv->mgr.parameters(), a2 = a1;
+    for (size_t i = 0; i != a2.size(); ++i)
+        a2[i] *= 1.001;
+    int na = a1.size();
+    bool flip = false;
+    run("wssr", n, na, [&]() {
+        flip = !flip;
+        fit.compute_wssr(flip ? a1 : a2, datas);
+    });
+    vector<realt> alpha(na * na), beta(na);
+    run("derivatives", n, na, [&]() {
+        flip = !flip;
+        fit.compute_derivatives(flip ? a1 : a2, datas, alpha, beta);
+    });
+}
+
+// parameter values that make sense for most built-in functions
+static string arg_value(const Tplate& tp, int n)
+{
+    const string& name = tp.fargs[n];
+    const string& defval = tp.defvals[n];
+    if (!defval.empty()
+            && defval.find_first_not_of("0123456789.") == string::npos)
+        return defval;
+    if (name == "center" || name == "xmid")
+        return "50";
+    if (name == "height" || name == "upper")
+        return "10";
+    if (name == "lower")
+        return "0";
+    if (name == "hwhm" || name == "fwhm" || name == "wsig"
+            || name == "width" || name.find("hwhm") != string::npos)
+        return "2";
+    return "0.5";
+}
+
+static void bench_function(Fityk* ftk, const Tplate& tp, int n)
+{
+    string args;
+    for (size_t i = 0; i != tp.fargs.size(); ++i)
+        args += (i == 0 ? "~" : ", ~") + arg_value(tp, i);
+    ftk->execute("%bench = " + tp.name + "(" + args + ")");
+    Full* priv = ftk->priv();
+    const Function* f = priv->mgr.find_function("bench");
+    int na = priv->mgr.parameters().size();
+    vector<realt> xx(n), yy(n), dy_da(n * (na+1));
+    for (int i = 0; i != n; ++i)
+        xx[i] = 100. * i / n;
+    run("value/" + tp.name, n, na, [&]() {
+        f->calculate_value_in_range(xx, yy, 0, n);
+    });
+    run("deriv/" + tp.name, n, na, [&]() {
+        f->calculate_value_deriv_in_range(xx, yy, dy_da, false, 0, n);
+    });
+    ftk->execute("delete %bench");
+}
+
+static void bench_functions(int n)
+{
+    unique_ptr<Fityk> ftk(new_engine());
+    ftk->execute("define BenchUDF(height, center, hwhm) = "
+                 "height*exp(-ln(2)*((x-center)/hwhm)^2) + "
+                 "0.1*height*sin(x/hwhm) + center/(1+x^2)");
+    const vector<Tplate::Ptr>& tpvec = ftk->priv()->get_tpm()->tpvec();
+    for (size_t i = 0; i != tpvec.size(); ++i) {
+        try {
+            bench_function(ftk.get(), *tpvec[i], n);
+        } catch (const exception& e) {
+            fprintf(stderr, "%s skipped: %s\n", tpvec[i]->name.c_str(),
+                    e.what());
+            if (ftk->priv()->mgr.find_function_nr("bench") != -1)
+                ftk->execute("delete %bench");
+        }
+    }
+}
+
+static void bench_transform(int n)
+{
+    unique_ptr<Fityk> ftk(new_engine());
+    ftk->execute("M=" + S(n) + "; x=100.*n/M; y=sin(x)");
+    run("transform/simple", n, 0, [&]() { ftk->execute("Y = y * 1.01 + 1"); });
+    run("transform/functions", n, 0, [&]() {
+        ftk->execute("Y = exp(-abs(y)) + sqrt(x) * sin(x)");
+    });
+    run("transform/neighbours", n, 0, [&]() {
+        ftk->execute("Y = (y[n-1] + 2*y + y[n+1]) / 4");
+    });
+}
+
+static void bench_io(int n, int k)
+{
+    unique_ptr<Fityk> ftk(new_engine());
+    make_dataset(ftk.get(), n, k);
+    string data_file = "bench-data.tmp";
+    string state_file = "bench-state.tmp";
+    ftk->execute("print all: x, y, s > '" + data_file + "'");
+    run("load", n, 0, [&]() { ftk->execute("@0 < '" + data_file + "'"); });
+    run("save_state", n, k * 3, [&]() {
+        ftk->execute("info state >'" + state_file + "'");
+    });
+    remove(data_file.c_str());
+    remove(state_file.c_str());
+}
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-t") && i+1 < argc)
+            min_time = atof(argv[++i]);
+        else
+            filters.push_back(argv[i]);
+    }
+    printf("# name\tpoints\tparams\treps\tseconds\n");
+    const int sizes[] = { 1000, 100000 };
+    const int models[] = { 1, 10, 50 };
+    for (int n : sizes)
+        for (int k : models)
+            bench_fit(n, k);
+    // some functions are slow, 100000 points would take too long
+    for (int n : { 1000, 10000 })
+        bench_functions(n);
+    for (int n : sizes)
+        bench_transform(n);
+    for (int n : sizes)
+        bench_io(n, 10);
+    return 0;
+}
@@ -0,0 +1,90 @@
+// Cache of parsed statements in CommandExecutor.
+
+#include <memory>  // for unique_ptr
+#include <string>
+#include "fityk/logic.h"
+#include "fityk/runner.h"
+#include "fityk/var.h"
+
+#include "catch.hpp"
+
+using namespace std;
+using namespace fityk;
+
+static Fityk* new_engine()
+{
+    Fityk* fik = new Fityk;
+    fik->set_option_as_number("verbosity", -1);
+    fik->execute("M=5; x=n; y=0");
+    return fik;
+}
+
+static int cache_size(Fityk* fik)
+{
+    return fik->priv()->cmd_executor()->cached_statement_count();
+}
+
+TEST_CASE("cache-variables", "cached statement sees new values of $a, %f") {
+    unique_ptr<Fityk> fik(new_engine());
+    fik->execute("$a = 2");
+    fik->execute("@0: Y = $a * x");
+    REQUIRE(fik->get_data()[3].y == 6);
+    fik->execute("$a = 5");
+    fik->execute("@0: Y = $a * x");
+    REQUIRE(fik->get_data()[3].y == 15);
+
+    fik->execute("%f = Linear(1, 2)");
+    fik->execute("@0: Y = %f(x)");
+    REQUIRE(fik->get_data()[3].y == 7);
+    fik->execute("%g = Constant(-1)");
+    fik->execute("delete %f");
+    fik->execute("%f = Linear(~3, 0)");
+    fik->execute("@0: Y = %f(x)");
+    REQUIRE(fik->get_data()[3].y == 3);
+    // {...} is evaluated when the statement is executed
+    fik->execute("$a = {3*$a}");
+    fik->execute("$a = {3*$a}");
+    REQUIRE(fik->get_variable("a")->value() == 45);
+}
+
+TEST_CASE("cache-define", "define and undefine clear the cache") {
+    unique_ptr<Fityk> fik(new_engine());
+    fik->execute("define Foo(a) = a*x");
+    fik->execute("%foo = Foo(2)");
+    REQUIRE(fik->calculate_expr("%foo(3)") == 6);
+    REQUIRE(cache_size(fik.get()) > 0);
+    fik->execute("delete %foo");
+    fik->execute("undefine Foo");
+    REQUIRE(cache_size(fik.get()) == 0);
+    fik->execute("define Foo(a) = a*x*x");
+    fik->execute("%foo = Foo(2)");
+    REQUIRE(fik->calculate_expr("%foo(3)") == 18);
+}
+
+TEST_CASE("cache-limit", "the number of cached statements is limited") {
+    unique_ptr<Fityk> fik(new_engine());
+    const int max_size = CommandExecutor::kMaxCachedStatements;
+    for (int i = 0; i != 2 * max_size; ++i) {
+        fik->execute("$v" + S(i) + " = " + S(i));
+        REQUIRE(cache_size(fik.get()) <= max_size);
+    }
+    REQUIRE(fik->get_variable("v300")->value() == 300);
+}
+
+static string error_message(Fityk* fik, const string& cmd)
+{
+    try {
+        fik->execute(cmd);
+    } catch (const SyntaxError& e) {
+        return e.what();
+    }
+    return "";
+}
+
+TEST_CASE("cache-error-position", "syntax error position is in the line") {
+    unique_ptr<Fityk> fik(new_engine());
+    REQUIRE(error_message(fik.get(), "@0: fit foo bar")
+            == "at 11, near `0: fit foo': unexpected name after `fit'");
+    REQUIRE(error_message(fik.get(), "@0:   Y = y[x=50]")
+            == "at 13, near `   Y = y[x': mismatching bracket");
+}
@@ -0,0 +1,120 @@
+// Moving datasets to the temporary file (option max_data_memory).
+
+#include <memory>  // for unique_ptr
+#include <string>
+#include <vector>
+#include "fityk/logic.h"
+#include "fityk/data.h"
+
+#include "catch.hpp"
+
+using namespace std;
+using namespace fityk;
+
+static bool same_points(const vector<Point>& a, const vector<Point>& b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i != a.size(); ++i)
+        if (a[i].x != b[i].x || a[i].y != b[i].y ||
+                a[i].sigma != b[i].sigma || a[i].is_active != b[i].is_active)
+            return false;
+    return true;
+}
+
+// creates n datasets with different number of points
+static Fityk* engine_with_datasets(int n)
+{
+    Fityk* fik = new Fityk;
+    fik->set_option_as_number("verbosity", -1);
+    for (int i = 0; i != n; ++i) {
+        if (i != 0)
+            fik->execute("@+ = 0");
+        string ds = "@" + S(i) + ": ";
+        fik->execute(ds + "M=" + S(10 + i % 17));
+        fik->execute(ds + "x=n+" + S(i) + "; y=sin(x*" + S(i) + "); s=n+1");
+        fik->execute(ds + "A = sin(n) > -0.5");
+    }
+    return fik;
+}
+
+TEST_CASE("spill-unspill", "points are the same after spill and unspill") {
+    SpillStore store; // must outlive datasets
+    unique_ptr<Fityk> fik(engine_with_datasets(20));
+    DataKeeper& dk = fik->priv()->dk;
+    vector<vector<Point> > copies;
+    for (int i = 0; i != dk.count(); ++i)
+        copies.push_back(dk.data(i)->points());
+    for (int i = 0; i != dk.count(); ++i) {
+        dk.data(i)->spill(&store);
+        REQUIRE(dk.data(i)->is_spilled() == false); // data() loads it back
+        REQUIRE(same_points(dk.data(i)->points(), copies[i]));
+        int n_active = 0;
+        for (const Point& p : copies[i])
+            n_active += p.is_active;
+        REQUIRE(dk.data(i)->get_n() == n_active);
+    }
+    // all spilled at once, then loaded in different order
+    vector<Data*> datas = dk.datas();
+    for (Data* d : datas)
+        d->spill(&store);
+    long size = store.file_size();
+    REQUIRE(size > 0);
+    for (int i = dk.count() - 1; i >= 0; i -= 2)
+        datas[i]->unspill();
+    for (int i = dk.count() - 1; i >= 0; i -= 2) {
+        REQUIRE(same_points(datas[i]->points(), copies[i]));
+        datas[i]->spill(&store);
+    }
+    for (int i = 0; i != dk.count(); ++i) {
+        datas[i]->unspill();
+        REQUIRE(same_points(datas[i]->points(), copies[i]));
+    }
+    REQUIRE(store.file_size() == 0);
+    // freed space is reused
+    for (Data* d : datas)
+        d->spill(&store);
+    REQUIRE(store.file_size() == size);
+    for (Data* d : datas)
+        d->unspill();
+}
+
+TEST_CASE("max-data-memory", "many datasets moved to the temporary file") {
+    // more datasets than the typical limit of open files (1024)
+    const int n = 1500;
+    unique_ptr<Fityk> fik(engine_with_datasets(n));
+    DataKeeper& dk = fik->priv()->dk;
+    vector<vector<Point> > copies;
+    for (int i = 0; i != n; ++i)
+        copies.push_back(dk.data(i)->points());
+    fik->set_option_as_number("max_data_memory", 0.001);
+    fik->execute("@0: Y = y + 1");
+    copies[0] = dk.data(0)->points();
+    REQUIRE(dk.memory_usage() <= 1000);
+    string info = fik->get_info("data_store");
+    REQUIRE(info.find(" in memory") != string::npos);
+    // touching datasets brings them back
+    for (int i = 0; i < n; i += 7) {
+        REQUIRE(same_points(fik->get_data(i), copies[i]));
+        fik->execute("@" + S(i) + ": Y = y");
+    }
+    for (int i = n - 1; i >= 0; --i)
+        REQUIRE(same_points(dk.data(i)->points(), copies[i]));
+}
+
+TEST_CASE("transform-all", "@* = ... gives the same result in batches") {
+    const int n = 300;
+    unique_ptr<Fityk> plain(engine_with_datasets(n));
+    unique_ptr<Fityk> limited(engine_with_datasets(n));
+    limited->set_option_as_number("max_data_memory", 0.002);
+    // @3 is used with its original points also in batches after its own
+    const char* tr = "@* = -@* - @3";
+    plain->execute(tr);
+    limited->execute(tr);
+    DataKeeper& dk = limited->priv()->dk;
+    REQUIRE(dk.memory_usage() <= 2000);
+    string info = limited->get_info("data_store");
+    REQUIRE(info.find(" in memory") != string::npos);
+    for (int i = 0; i != n; ++i)
+        REQUIRE(same_points(limited->get_data(i), plain->get_data(i)));
+}
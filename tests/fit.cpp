@@ -0,0 +1,222 @@
+// Fitting options and fitting-related features of the Fityk API.
+
+#include <memory>  // for unique_ptr
+#include <string>
+#include <vector>
+#include "fityk/fityk.h"
+#include "fityk/ui_api.h"
+#include "fityk/logic.h"
+#include "fityk/fit.h"
+
+#include "catch.hpp"
+
+using namespace std;
+
+// engine with a noisy Gaussian peak (n points) and a Gaussian model
+// with slightly wrong parameters
+static fityk::Fityk* peak_engine(int n)
+{
+    fityk::Fityk* fik = new fityk::Fityk;
+    fik->set_option_as_number("verbosity", -1);
+    fik->set_option_as_number("pseudo_random_seed", 7);
+    fik->execute("M=" + to_string(n) + "; x=50.*n/M");
+    fik->execute("y=randnormal(30*exp(-ln(2)*((x-24)/3)^2) + 2, 0.5); s=0.5");
+    fik->execute("F = Gaussian(~25, ~25, ~3.5) + Constant(~1)");
+    return fik;
+}
+
+TEST_CASE("coarse-to-fine", "fit_coarse_levels doesn't change the result") {
+    unique_ptr<fityk::Fityk> plain(peak_engine(20000));
+    plain->execute("fit");
+    vector<double> expected = plain->all_parameters();
+
+    unique_ptr<fityk::Fityk> coarse(peak_engine(20000));
+    coarse->set_option_as_number("fit_coarse_levels", 2);
+    coarse->execute("fit");
+    vector<double> result = coarse->all_parameters();
+
+    REQUIRE(result.size() == expected.size());
+    for (size_t i = 0; i != result.size(); ++i)
+        REQUIRE(result[i] == Approx(expected[i]).epsilon(1e-5));
+    REQUIRE(coarse->get_wssr() == Approx(plain->get_wssr()).epsilon(1e-6));
+}
+
+TEST_CASE("coarse-levels-range", "fit_coarse_levels must be in [0, 10]") {
+    unique_ptr<fityk::Fityk> fik(new fityk::Fityk);
+    fik->set_option_as_number("verbosity", -1);
+    REQUIRE_THROWS_AS(fik->set_option_as_number("fit_coarse_levels", 11),
+                      fityk::ExecuteError);
+    REQUIRE_THROWS_AS(fik->set_option_as_number("fit_coarse_levels", -1),
+                      fityk::ExecuteError);
+    fik->set_option_as_number("fit_coarse_levels", 10);
+    REQUIRE(fik->get_option_as_number("fit_coarse_levels") == 10);
+}
+
+TEST_CASE("coarse-max-eval", "all levels share the evaluation limit") {
+    unique_ptr<fityk::Fityk> fik(peak_engine(20000));
+    fik->set_option_as_number("fit_coarse_levels", 3);
+    unique_ptr<fityk::FitJob> job(fik->start_fit(30));
+    const fityk::FitResult& r = job->result();
+    REQUIRE(r.error.empty());
+    REQUIRE(r.evaluations <= 30);
+}
+
+static vector<string> fit_messages;
+
+static void store_message(fityk::UiApi::Style, const string& s)
+{
+    fit_messages.push_back(s);
+}
+
+TEST_CASE("coarse-bins", "bins don't span inactive points") {
+    unique_ptr<fityk::Fityk> fik(peak_engine(20000));
+    fik->set_option_as_number("verbosity", 0);
+    fik->get_ui_api()->connect_show_message(store_message);
+    fik->set_option_as_number("fit_coarse_levels", 2);
+    // 8001 + 7999 active points, 16 or 4 points per bin
+    fik->execute("A = n <= 8000 or n > 12000");
+    fit_messages.clear();
+    fik->execute("fit");
+    vector<string> levels;
+    for (const string& m : fit_messages)
+        if (m.compare(0, 6, "Level ") == 0)
+            levels.push_back(m.substr(0, m.find(',')));
+    REQUIRE(levels.size() == 3);
+    REQUIRE(levels[0] == "Level 2: 1001 points");
+    REQUIRE(levels[1] == "Level 1: 4001 points");
+    REQUIRE(levels[2] == "Level 0: 16000 points");
+}
+
+static void count_iterations(const fityk::FitProgress&, void *user_data)
+{
+    ++*static_cast<int*>(user_data);
+}
+
+TEST_CASE("start-fit", "fitting in a background thread") {
+    unique_ptr<fityk::Fityk> fik(peak_engine(2000));
+    int iterations = 0;
+    unique_ptr<fityk::FitJob> job(fik->start_fit(0, fityk::DEFAULT_DATASET,
+                                                 count_iterations,
+                                                 &iterations));
+    job->wait();
+    REQUIRE(job->is_done());
+    const fityk::FitResult& r = job->result();
+    REQUIRE(r.error.empty());
+    REQUIRE(r.cancelled == false);
+    REQUIRE(r.wssr < r.initial_wssr);
+    REQUIRE(r.evaluations > 0);
+    REQUIRE(iterations > 0);
+    REQUIRE(r.wssr == Approx(fik->get_wssr()));
+}
+
+TEST_CASE("start-fit-cancel", "FitJob::cancel() stops fitting") {
+    unique_ptr<fityk::Fityk> fik(peak_engine(20000));
+    fik->execute("set fitting_method=nelder_mead_simplex");
+    fik->set_option_as_number("max_wssr_evaluations", 1e7);
+    unique_ptr<fityk::FitJob> job(fik->start_fit());
+    job->cancel();
+    const fityk::FitResult& r = job->result();
+    REQUIRE(job->is_done());
+    REQUIRE(r.error.empty());
+    REQUIRE(r.cancelled == true);
+    REQUIRE(r.evaluations < 1e7);
+}
+
+TEST_CASE("start-fit-error", "errors are reported in FitResult") {
+    unique_ptr<fityk::Fityk> fik(peak_engine(100));
+    fik->execute("F = Constant(1)");
+    unique_ptr<fityk::FitJob> job(fik->start_fit());
+    const fityk::FitResult& r = job->result();
+    REQUIRE(job->is_done());
+    REQUIRE(r.error.find("no fittable parameters") != string::npos);
+    REQUIRE(r.cancelled == false);
+}
+
+// n items, each differs from the previous one in one or two parameters
+static vector<vector<double> > sparse_history(int n_params, int n)
+{
+    vector<vector<double> > items;
+    vector<double> aa(n_params);
+    for (int i = 0; i != n_params; ++i)
+        aa[i] = i;
+    items.push_back(aa);
+    for (int k = 1; k != n; ++k) {
+        aa[(k * 7) % n_params] += 0.5 * k;
+        if (k % 3 == 0)
+            aa[(k * 11) % n_params] = -k;
+        items.push_back(aa);
+    }
+    return items;
+}
+
+static fityk::Fityk* engine_with_variables(int n_params)
+{
+    fityk::Fityk* fik = new fityk::Fityk;
+    fik->set_option_as_number("verbosity", -1);
+    for (int i = 0; i != n_params; ++i)
+        fik->execute("$v" + to_string(i) + " = ~" + to_string(i));
+    return fik;
+}
+
+TEST_CASE("param-history", "items stored as deltas are restored exactly") {
+    const int n_params = 40, n = 50; // n > kKeyframeInterval
+    unique_ptr<fityk::Fityk> fik(engine_with_variables(n_params));
+    fityk::FitManager* fm = fik->priv()->fit_manager();
+    vector<vector<double> > items = sparse_history(n_params, n);
+    for (size_t i = 0; i != items.size(); ++i)
+        REQUIRE(fm->push_param_history(items[i]));
+    REQUIRE(fm->push_param_history(items.back()) == false); // no change
+    REQUIRE(fm->get_param_history_size() == n);
+    // deltas take less memory than full copies
+    REQUIRE(fm->memory_usage() < n * n_params * sizeof(double));
+    for (int i = 0; i != n; ++i)
+        REQUIRE(fm->get_item(i) == items[i]);
+    for (int i = n - 1; i >= 0; i -= 3) {
+        fik->execute("fit history " + to_string(i));
+        REQUIRE(fik->all_parameters() == items[i]);
+    }
+    fik->execute("fit history " + to_string(n - 1));
+    for (int i = n - 2; i >= n - 20; --i) {
+        fik->execute("fit undo");
+        REQUIRE(fik->all_parameters() == items[i]);
+    }
+    for (int i = n - 19; i != n; ++i) {
+        fik->execute("fit redo");
+        REQUIRE(fik->all_parameters() == items[i]);
+    }
+    REQUIRE_THROWS_AS(fik->execute("fit redo"), fityk::ExecuteError);
+}
+
+TEST_CASE("param-history-memory", "max_history_memory removes old items") {
+    const int n_params = 40, n = 200;
+    unique_ptr<fityk::Fityk> fik(engine_with_variables(n_params));
+    fik->set_option_as_number("max_history_memory", 0.002);
+    fityk::FitManager* fm = fik->priv()->fit_manager();
+    vector<vector<double> > items = sparse_history(n_params, n);
+    for (size_t i = 0; i != items.size(); ++i)
+        fm->push_param_history(items[i]);
+    int size = fm->get_param_history_size();
+    REQUIRE(size > 1);
+    REQUIRE(size < n);
+    REQUIRE(fm->memory_usage() <= 0.002 * 1024 * 1024);
+    REQUIRE(fm->get_active_nr() == size - 1);
+    // the newest items are kept
+    for (int i = 0; i != size; ++i)
+        REQUIRE(fm->get_item(i) == items[n - size + i]);
+    fik->execute("fit history 0");
+    REQUIRE(fik->all_parameters() == items[n - size]);
+    REQUIRE_THROWS_AS(fik->execute("fit undo"), fityk::ExecuteError);
+}
+
+TEST_CASE("par-usage", "parameters used indirectly are fitted") {
+    unique_ptr<fityk::Fityk> fik(peak_engine(100));
+    fik->execute("$a = ~20");
+    fik->execute("$b = 1.5 * $a");
+    fik->execute("$c = ~5");
+    fik->execute("$d = $b + 1");
+    fik->execute("F = Gaussian($d, ~25, ~3.5)");
+    // $a, center and hwhm; $c is not used
+    REQUIRE(fik->get_dof() == 100 - 3);
+    fik->execute("F += Constant($c)");
+    REQUIRE(fik->get_dof() == 100 - 4);
+}
@@ -0,0 +1,131 @@
+// Requests sent to the cfityk server (cli/server.cpp) over a socket pair.
+
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "cli/server.h"
+
+#include "catch.hpp"
+
+using namespace std;
+
+struct Frame
+{
+    char type;
+    string payload;
+};
+
+static void send_request(int fd, char type, const string& payload)
+{
+    string frame = type + (" " + to_string(payload.size()) + "\n") + payload;
+    REQUIRE(write(fd, frame.c_str(), frame.size()) == (ssize_t) frame.size());
+}
+
+// reads one frame, returns false at the end of input
+static bool receive_frame(int fd, Frame* frame)
+{
+    string header;
+    char c;
+    while (read(fd, &c, 1) == 1 && c != '\n')
+        header += c;
+    if (header.size() < 3)
+        return false;
+    frame->type = header[0];
+    size_t len = strtoul(header.c_str() + 2, NULL, 10);
+    frame->payload.resize(len);
+    size_t pos = 0;
+    while (pos < len) {
+        ssize_t n = read(fd, &frame->payload[pos], len - pos);
+        if (n <= 0)
+            return false;
+        pos += n;
+    }
+    return true;
+}
+
+// reads frames up to and including the D frame
+static vector<Frame> receive_reply(int fd)
+{
+    vector<Frame> reply;
+    Frame frame;
+    while (receive_frame(fd, &frame)) {
+        reply.push_back(frame);
+        if (frame.type == 'D')
+            break;
+    }
+    return reply;
+}
+
+static bool has_frame(const vector<Frame>& reply, char type, const string& s)
+{
+    for (size_t i = 0; i != reply.size(); ++i)
+        if (reply[i].type == type && reply[i].payload.find(s) != string::npos)
+            return true;
+    return false;
+}
+
+TEST_CASE("server-requests", "C, S and R requests and their replies") {
+    EnginePool* pool = create_engine_pool(1, "");
+    int fds[2];
+    REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    thread server(serve_connection, pool, fds[1]);
+    int fd = fds[0];
+
+    send_request(fd, 'C', "print 2+3");
+    vector<Frame> reply = receive_reply(fd);
+    REQUIRE(reply.size() >= 2);
+    REQUIRE(has_frame(reply, 'N', "5"));
+    REQUIRE(reply.back().type == 'D');
+    REQUIRE(reply.back().payload == "ok");
+
+    send_request(fd, 'C', "print 2+");
+    REQUIRE(receive_reply(fd).back().payload == "syntax-error");
+
+    send_request(fd, 'S', "$a = 7\nprint $a*2\nprint $b\nprint 1");
+    reply = receive_reply(fd);
+    REQUIRE(has_frame(reply, 'N', "14"));
+    REQUIRE(has_frame(reply, 'W', "$b"));
+    REQUIRE(reply.back().payload == "error");
+
+    send_request(fd, 'R', "");
+    REQUIRE(receive_reply(fd).back().payload == "ok");
+    send_request(fd, 'C', "print $a");
+    REQUIRE(receive_reply(fd).back().payload == "error");
+
+    // engines share the process, so cwd is read-only
+    send_request(fd, 'C', "set cwd='/'");
+    reply = receive_reply(fd);
+    REQUIRE(has_frame(reply, 'W', "server mode"));
+    REQUIRE(reply.back().payload == "error");
+
+    send_request(fd, 'X', "");
+    REQUIRE(receive_reply(fd).back().payload == "syntax-error");
+
+    send_request(fd, 'C', "quit");
+    REQUIRE(receive_reply(fd).back().payload == "ok");
+    Frame frame;
+    REQUIRE(receive_frame(fd, &frame) == false);
+    server.join();
+    close(fd);
+}
+
+TEST_CASE("server-request-size", "too long request closes the connection") {
+    EnginePool* pool = create_engine_pool(1, "");
+    int fds[2];
+    REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    thread server(serve_connection, pool, fds[1]);
+    int fd = fds[0];
+    string header = "S 100000000000\n";
+    REQUIRE(write(fd, header.c_str(), header.size()) == (ssize_t)header.size());
+    vector<Frame> reply = receive_reply(fd);
+    REQUIRE(has_frame(reply, 'W', "too long"));
+    REQUIRE(reply.back().type == 'D');
+    REQUIRE(reply.back().payload == "error");
+    Frame frame;
+    REQUIRE(receive_frame(fd, &frame) == false);
+    server.join();
+    close(fd);
+}
@@ -169,6 +169,32 @@ class TestGzippedScript(unittest.TestCase):
         self.assertEqual(data[0].y, -5)
         self.assertEqual(data[0].sigma, 0.8)
 
+class TestAddPoints(unittest.TestCase):
+    def setUp(self):
+        self.ftk = fityk.Fityk()
+        self.ftk.set_option_as_number("verbosity", -1)
+
+    def test_append(self):
+        self.ftk.add_points([1, 2, 3], [5, 6, 7], [1, 1, 1])
+        self.ftk.add_points([4, 5], [8, 9], [1, 1])
+        data = self.ftk.get_data()
+        self.assertEqual([p.x for p in data], [1, 2, 3, 4, 5])
+        self.assertEqual(self.ftk.calculate_expr("count(a)"), 5)
+
+    def test_unsorted(self):
+        self.ftk.add_points([1, 3, 5], [1, 3, 5], [1, 1, 1])
+        self.ftk.add_points([4, 0, 2], [4, 0, 2], [1, 1, 1])
+        data = self.ftk.get_data()
+        self.assertEqual([p.x for p in data], [0, 1, 2, 3, 4, 5])
+        self.assertEqual([p.y for p in data], [0, 1, 2, 3, 4, 5])
+
+    def test_default_sigma(self):
+        self.ftk.set_option_as_string("default_sigma", "sqrt")
+        self.ftk.add_points([1, 2, 3], [0.5, 4, 9], [])
+        self.assertEqual([p.sigma for p in self.ftk.get_data()], [1, 2, 3])
+        self.assertRaises(fityk.ExecuteError, self.ftk.add_points,
+                          [4, 5], [1, 1], [1])
+
 
 if __name__ == '__main__':
     unittest.main()
@@ -35,6 +35,50 @@ class TestFormula(unittest.TestCase):
         formula = self.ftk.get_info("simplified_formula")
         self.assertEqual(formula, self.splitvoigt_formula)
 
+class GaussianTestCase(unittest.TestCase):
+    "Gaussian peak (500 points) with a guessed Gaussian function"
+    def setUp(self):
+        self.ftk = fityk.Fityk()
+        self.ftk.set_option_as_number("verbosity", -1)
+        self.ftk.execute("M=500; x=n/10; y=exp(-(x-25)^2)")
+        self.ftk.execute("guess Gaussian")
+
+class TestProfile(GaussianTestCase):
+    def test_disabled(self):
+        self.ftk.execute("fit")
+        info = self.ftk.get_info("profile")
+        self.assertTrue(info.startswith("Profiling is off"))
+        self.assertNotIn("%_1", info)
+    def test_enabled(self):
+        self.ftk.execute("set profiling=1")
+        self.ftk.execute("fit")
+        info = self.ftk.get_info("profile")
+        self.assertIn("%_1 (Gaussian) deriv", info)
+        self.ftk.execute("set profiling=1") # clears statistics
+        self.assertNotIn("%_1", self.ftk.get_info("profile"))
+
+class TestMemory(GaussianTestCase):
+    def test_report(self):
+        info = self.ftk.get_info("memory")
+        self.assertIn("@0: 500 points", info)
+        self.assertIn("model (3 variables, 1 functions)", info)
+        self.assertTrue(info.splitlines()[-1].startswith("total: "))
+    def test_soft_limit(self):
+        messages = []
+        self.ftk.get_ui_api().connect_show_message_py(
+                lambda style, s: messages.append((style, s)))
+        self.ftk.execute("set memory_soft_limit=0.001")
+        self.assertIn("memory_soft_limit: 0.001", self.ftk.get_info("memory"))
+        self.ftk.execute("Y = 2 * y") # only a warning is printed
+        self.assertEqual(len(messages), 1)
+        style, text = messages[0]
+        self.assertEqual(style, fityk.UiApi.kWarning)
+        self.assertIn("transformation may need", text)
+        self.assertTrue(text.endswith("above memory_soft_limit (0.001 MB)."))
+        self.assertEqual(self.ftk.get_data()[250].y, 2.0) # y(25) was 1
+        self.assertRaises(fityk.ExecuteError, self.ftk.execute,
+                          "set memory_soft_limit=-1")
+
 if __name__ == '__main__':
     unittest.main()
 
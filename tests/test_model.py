@@ -3,8 +3,11 @@
 # run tests with: python -m unittest test_model
 #             or  python -m unittest discover
 
+import array
+import json
 import os
 import sys
+import tempfile
 import unittest
 import fityk
 
@@ -156,5 +159,96 @@ class TestBoxConstraints(unittest.TestCase):
 
 
 
+
+class TestFitTrace(unittest.TestCase):
+    keys = ['cpu', 'evaluations', 'iteration', 'lambda', 'method',
+            'parameters', 'step_norm', 'wall', 'wssr']
+
+    def setUp(self):
+        self.ftk = fityk.Fityk()
+        self.ftk.set_option_as_number("verbosity", -1)
+        self.ftk.execute("M=500; x=n/10; y=exp(-(x-25)^2)")
+        self.ftk.execute("F = Gaussian(~0.8, ~25.1, ~0.9)")
+        fd, self.path = tempfile.mkstemp(suffix='.jsonl')
+        os.close(fd)
+
+    def tearDown(self):
+        os.remove(self.path)
+
+    def read_trace(self):
+        with open(self.path) as f:
+            return [json.loads(line) for line in f]
+
+    def test_trace(self):
+        self.ftk.set_option_as_string("fit_trace", self.path)
+        self.ftk.execute("fit")
+        records = self.read_trace()
+        self.assertTrue(len(records) > 1)
+        for n, r in enumerate(records, 1):
+            self.assertEqual(sorted(r.keys()), self.keys)
+            self.assertEqual(r['method'], 'levenberg_marquardt')
+            self.assertEqual(r['iteration'], n)
+            self.assertEqual(len(r['parameters']), 3)
+        wssr = [r['wssr'] for r in records]
+        self.assertEqual(wssr, sorted(wssr, reverse=True))
+        self.assertAlmostEqual(wssr[-1], self.ftk.get_wssr())
+        self.assertEqual(records[-1]['parameters'],
+                         list(self.ftk.all_parameters()))
+
+    def test_no_trace(self):
+        self.ftk.execute("fit")
+        self.assertEqual(self.read_trace(), [])
+
+
+class TestDirectAccess(unittest.TestCase):
+    def setUp(self):
+        self.ftk = fityk.Fityk()
+        self.ftk.set_option_as_number("verbosity", -1)
+        self.ftk.execute("M=5; x=n; y=x*x; s=1")
+        self.ftk.execute("F = Gaussian(~10, ~2, ~1)")
+
+    def test_parameters(self):
+        self.assertEqual(self.ftk.get_parameter(0), 10)
+        self.ftk.set_parameter(0, 20)
+        self.assertEqual(self.ftk.get_model_value(2), 20)
+        self.assertRaises(fityk.ExecuteError, self.ftk.get_parameter, 3)
+
+    def test_set_all_parameters(self):
+        self.ftk.set_parameters([20, 3, 1])
+        self.assertEqual(list(self.ftk.all_parameters()), [20, 3, 1])
+        self.assertEqual(self.ftk.get_model_value(3), 20)
+        self.assertRaises(fityk.ExecuteError, self.ftk.set_parameters, [1, 2])
+
+    def test_dependent_variables(self):
+        # only parts that depend on the changed parameter are recalculated
+        self.ftk.execute("$w = ~2")
+        self.ftk.execute("$w2 = $w * 3")
+        self.ftk.execute("%l = Lorentzian(~5, ~20, $w2)")
+        self.ftk.execute("F += %l")
+        w = self.ftk.get_variable("w")
+        self.ftk.set_parameter(w.gpos(), 0.5)
+        self.assertEqual(self.ftk.get_variable("w2").value(), 1.5)
+        self.assertAlmostEqual(self.ftk.get_function("l").value_at(21.5), 2.5)
+        self.assertAlmostEqual(self.ftk.get_model_value(21.5),
+                               2.5 + self.ftk.get_function("_1").value_at(21.5))
+
+    def test_model_values(self):
+        xx = array.array('d', [2, 3, 0])
+        out = array.array('d', [0, 0, 0])
+        self.ftk.get_model_values_into(xx, out)
+        self.assertEqual(list(out), [self.ftk.get_model_value(x) for x in xx])
+        func = self.ftk.all_functions()[0]
+        out2 = array.array('d', [0, 0, 0])
+        func.values_at_into(xx, out2)
+        self.assertEqual(out, out2)
+
+    def test_data_column(self):
+        out = array.array('d', [0] * 5)
+        self.ftk.get_data_column_into('y', out)
+        self.assertEqual(list(out), [0, 1, 4, 9, 16])
+        self.assertRaises(fityk.ExecuteError,
+                          self.ftk.get_data_column_into, 'y',
+                          array.array('d', [0] * 4))
+
 if __name__ == '__main__':
     unittest.main()
@@ -3,6 +3,7 @@
 # run tests with: python -m unittest test_tranform
 #                 python -m unittest discover
 
+import math
 import os
 import sys
 import unittest
@@ -83,6 +84,142 @@ class TestTransform(unittest.TestCase):
         self.assertEqual(yy[3], 1.2)
         self.assertEqual(yy[-2], 12.34)
 
+    def test_neighbours(self):
+        self.ftk.execute("Y = x > 0 ? (y[n-1] + y[n+1]) / 2 : -y")
+        xx, yy, ss = get_data_as_lists(self.ftk)
+        M = len(self.y)
+        expected = [(self.y[max(n-1, 0)] + self.y[min(n+1, M-1)]) / 2
+                    if self.x[n] > 0 else -self.y[n] for n in range(M)]
+        self.assertEqual(yy, expected)
+        # y[ln(x)] must not be evaluated for x <= 0
+        self.ftk.execute("M=2000; X=n/100-10")
+        self.ftk.execute("Y=x*x")
+        xx, yy, ss = get_data_as_lists(self.ftk)
+        self.ftk.execute("Y = x > 0 ? y[ln(x)] : y")
+        def y_at(idx): # interpolated y[idx]
+            if idx <= 0:
+                return yy[0]
+            n = int(idx)
+            return (n + 1 - idx) * yy[n] + (idx - n) * yy[n+1]
+        expected = [y_at(math.log(x)) if x > 0 else y for x, y in zip(xx, yy)]
+        for a, b in zip(get_data_as_lists(self.ftk)[1], expected):
+            self.assertAlmostEqual(a, b, places=12)
+
+    def test_cumulative_sum(self):
+        # new values of previous points are used
+        self.ftk.execute("Y = n > 0 ? Y[n-1] + y : y")
+        xx, yy, ss = get_data_as_lists(self.ftk)
+        expected = [sum(self.y[:n+1]) for n in range(len(self.y))]
+        for a, b in zip(yy, expected):
+            self.assertAlmostEqual(a, b, places=12)
+
+    def test_large(self):
+        self.ftk.execute("M=300000; x=n; y=2*n")
+        self.ftk.execute("Y = y/2 - x + 1, S = 3, A = mod(n, 3) == 0")
+        self.assert_expr("sum(y)", 300000)
+        self.assert_expr("max(s)", 3)
+        self.assert_expr("count(a)", 100000)
+
+    def test_dataset_algebra(self):
+        self.ftk.execute("@+ = 2 * @0")
+        self.ftk.execute("@+ = @1 - @0 - @0 + -@0")
+        self.assertEqual([p.y for p in self.ftk.get_data(2)],
+                         [-y for y in self.y])
+        self.ftk.execute("@+ = @0 and @1")
+        xx = [p.x for p in self.ftk.get_data(3)]
+        self.assertEqual(xx, sorted(self.x + self.x))
+
+    def test_convolution(self):
+        self.ftk.execute("@+ = 0")
+        self.ftk.execute("@1: M=101; x=n-50; y=(abs(x) <= 10)")
+        self.ftk.execute("@+ = convolve(@1, 2)")
+        self.assertAlmostEqual(self.ftk.calculate_expr("sum(y)", 2), 21)
+        self.assertAlmostEqual(self.ftk.calculate_expr("y[50]", 2), 1)
+        self.assertAlmostEqual(self.ftk.calculate_expr("y[40]", 2),
+                               self.ftk.calculate_expr("y[60]", 2))
+        self.ftk.execute("@+ = deconvolve(@2, 2, 1e-12)")
+        for a, b in zip(self.ftk.get_data(1), self.ftk.get_data(3)):
+            self.assertAlmostEqual(a.y, b.y, places=5)
+        self.ftk.execute("@+ = fft_re(@1)")
+        self.assertEqual(self.ftk.get_dataset_count(), 5)
+        self.assertAlmostEqual(self.ftk.calculate_expr("y[0]", 4), 21)
+
+    def test_smoothing(self):
+        # self.y is quadratic, it is not changed by Savitzky-Golay filter
+        self.ftk.execute("@+ = savitzky_golay(@0, 3, 2, 0)")
+        for a, b in zip(self.ftk.get_data(1), self.y):
+            self.assertAlmostEqual(a.y, b, places=10)
+        self.ftk.execute("@+ = savitzky_golay(@0, 3, 2, 1)")
+        for a, b in zip(self.ftk.get_data(2), self.x):
+            self.assertAlmostEqual(a.y, 2*b - 3.1, places=10)
+        self.ftk.execute("@+ = moving_avg(@0, 1)")
+        yy = [p.y for p in self.ftk.get_data(3)]
+        self.assertAlmostEqual(yy[5], sum(self.y[4:7]) / 3)
+        self.assertAlmostEqual(yy[0], sum(self.y[0:2]) / 2)
+        self.ftk.execute("@0: Y = y + 100 * (n == 7)")
+        self.ftk.execute("@+ = median_filter(@0, 2)")
+        self.assertEqual([p.y for p in self.ftk.get_data(4)][7], self.y[6])
+        # inactive points are not changed
+        self.ftk.execute("@0: A = x < 0")
+        self.ftk.execute("@+ = whittaker(@0, 100)")
+        for a, b in zip(self.ftk.get_data(5), self.ftk.get_data(0)):
+            if a.x >= 0:
+                self.assertEqual(a.y, b.y)
+
+    def test_resample(self):
+        self.ftk.execute("@0: X = x + 0.01 * sin(3*n)")
+        self.ftk.execute("@0: Y = x * (x - 3.1)")
+        self.ftk.execute("@+ = resample(@0, 0.1)")
+        data = self.ftk.get_data(1)
+        self.assertEqual(len(data), 96) # from -2.5 to 7
+        for n, p in enumerate(data):
+            self.assertAlmostEqual(p.x, (n - 25) * 0.1)
+            self.assertAlmostEqual(p.y, p.x * (p.x - 3.1), delta=0.1)
+            self.assertTrue(p.sigma <= 1)
+        self.ftk.execute("@+ = resample_cubic(@0, 0.1)")
+        for p in self.ftk.get_data(2):
+            self.assertAlmostEqual(p.y, p.x * (p.x - 3.1))
+        self.ftk.execute("@+ = rebin(@0, 2)")
+        data = self.ftk.get_data(3)
+        self.assertEqual([p.x for p in data], [-2, 0, 2, 4, 6, 8])
+        self.assertAlmostEqual(data[1].sigma, 0.5) # average of 4 points
+        self.assertEqual(data[5].sigma, 1)
+
+    def test_shirley_bg(self):
+        def classic_shirley(x, y, n_iter=1000):
+            B = [y[0]] * len(y)
+            for _ in range(n_iter):
+                P = [0.]
+                for i in range(1, len(y)):
+                    P.append(P[-1] + (y[i] - B[i] + y[i-1] - B[i-1]) / 2
+                                     * (x[i] - x[i-1]))
+                B = [y[0] + (y[-1] - y[0]) * p / P[-1] for p in P]
+            return B
+        self.ftk.execute("@0: M=100")
+        self.ftk.execute("@0: X = n/10")
+        self.ftk.execute("@0: Y = 10 + 5*(x>5) + 100*exp(-((x-5)/1.5)^2)")
+        xx, yy, _ = get_data_as_lists(self.ftk)
+        bg = classic_shirley(xx, yy)
+        self.ftk.execute("@+ = shirley_bg(@0, 100, 1e-12)")
+        for a, b in zip(self.ftk.get_data(1), bg):
+            self.assertAlmostEqual(a.y, b, places=6)
+        self.ftk.execute("@+ = shirley_bg(@0)")
+        for a, b in zip(self.ftk.get_data(2), bg):
+            self.assertAlmostEqual(a.y, b, delta=1e-4)
+        # by default, all points are used
+        self.ftk.execute("@0: A = x <= 8")
+        self.ftk.execute("@+ = shirley_bg(@0)")
+        for a, b in zip(self.ftk.get_data(3), bg):
+            self.assertAlmostEqual(a.y, b, delta=1e-4)
+        # with active_only, inactive points are not changed
+        bg = classic_shirley(xx[:81], yy[:81]) + yy[81:]
+        # @* = @* - ... subtracts background in each dataset
+        self.ftk.execute("@* = @* - shirley_bg(@*, 50, 1e-6, 1)")
+        for a, b, y in zip(self.ftk.get_data(0), bg, yy):
+            self.assertAlmostEqual(a.y, y - b, delta=1e-4)
+        self.assertRaises(fityk.ExecuteError, self.ftk.execute,
+                          "@0 = shirley_bg(@*)")
+
     def test_xy_swap(self):
         self.ftk.execute("X=y, Y=x") # swap & sort!
         xx, yy, ss = get_data_as_lists(self.ftk)
@@ -0,0 +1,49 @@
+// Independent Fityk instances used concurrently in separate threads.
+
+#include <memory>  // for unique_ptr
+#include <string>
+#include <thread>
+#include <vector>
+#include "fityk/fityk.h"
+#include "catch.hpp"
+
+using namespace std;
+
+// generates noisy Voigt peak (the noise depends on pseudo_random_seed),
+// fits it and returns fitted parameters
+static vector<double> generate_and_fit(int n)
+{
+    unique_ptr<fityk::Fityk> fik(new fityk::Fityk);
+    fik->set_option_as_number("verbosity", -1);
+    fik->set_option_as_number("pseudo_random_seed", 100 + n);
+    string height = to_string(20 + n), center = to_string(20 + n % 7);
+    fik->execute("%p = Voigt(" + height + ", " + center + ", 3, 0.5)");
+    fik->execute("M=20000; x=n/400; y=randnormal(%p(x), 0.1); s=0.1");
+    fik->execute("delete %p");
+    fik->execute("guess Voigt");
+    fik->execute("fit");
+    return fik->all_parameters();
+}
+
+TEST_CASE("parallel-engines", "Fityk instances fitting in parallel threads") {
+    const int n_threads = 8;
+    vector<vector<double> > serial(n_threads), parallel(n_threads);
+    for (int i = 0; i != n_threads; ++i)
+        serial[i] = generate_and_fit(i);
+
+    vector<thread> threads;
+    for (int i = 0; i != n_threads; ++i)
+        threads.push_back(thread([i, &parallel] {
+            parallel[i] = generate_and_fit(i);
+        }));
+    for (size_t i = 0; i != threads.size(); ++i)
+        threads[i].join();
+
+    for (int i = 0; i != n_threads; ++i) {
+        REQUIRE(serial[i].size() == 4);
+        REQUIRE(parallel[i] == serial[i]);
+        REQUIRE(serial[i][1] == Approx(20 + i % 7).epsilon(0.01));
+    }
+    // different seeds give different noise
+    REQUIRE(serial[0] != serial[7]);
+}
@@ -419,6 +419,63 @@ void FPlot::draw_data_by_activity(wxDC& dc, wxPoint2DDouble *pp,
     }
 }
 
+// When there are many more points than pixel columns, most of them
+// don't change the picture. In each run of points that have the same
+// activity and fall into the same pixel column, the polyline needs only
+// the first, the last, the lowest and the highest point, and separate points
+// need only one point per pixel. Removes other points from pp and aa,
+// returns the new length.
+static
+int decimate_points(wxPoint2DDouble *pp, vector<bool>& aa, bool lines)
+{
+    int len = aa.size();
+    int out = 0;
+    vector<wxPoint2DDouble> column;
+    int i = 0;
+    while (i < len) {
+        double col = floor(pp[i].m_x);
+        bool state = aa[i];
+        int j = i + 1;
+        while (j < len && aa[j] == state && floor(pp[j].m_x) == col)
+            ++j;
+        column.clear();
+        if (j - i <= 4) {
+            column.assign(pp + i, pp + j);
+        } else if (lines) {
+            int lo = i, hi = i;
+            for (int k = i + 1; k < j; ++k) {
+                if (pp[k].m_y < pp[lo].m_y)
+                    lo = k;
+                if (pp[k].m_y > pp[hi].m_y)
+                    hi = k;
+            }
+            column.push_back(pp[i]);
+            int a = min(lo, hi), b = max(lo, hi);
+            if (a != i)
+                column.push_back(pp[a]);
+            if (b != a && b != j-1)
+                column.push_back(pp[b]);
+            column.push_back(pp[j-1]);
+        } else {
+            vector<pair<int,int> > rows(j - i);
+            for (int k = i; k < j; ++k)
+                rows[k-i] = make_pair(iround(pp[k].m_y), k);
+            sort(rows.begin(), rows.end());
+            for (size_t k = 0; k != rows.size(); ++k)
+                if (k == 0 || rows[k].first != rows[k-1].first)
+                    column.push_back(pp[rows[k].second]);
+        }
+        for (size_t k = 0; k != column.size(); ++k) {
+            pp[out] = column[k];
+            aa[out] = state;
+            ++out;
+        }
+        i = j;
+    }
+    aa.resize(out);
+    return out;
+}
+
 void FPlot::draw_data (wxDC& dc,
                        double (*compute_y)(vector<Point>::const_iterator,
                                            Model const*),
@@ -453,6 +510,9 @@ void FPlot::draw_data (wxDC& dc,
         pp[i].m_y = ys.px_d(yy[i]) - Y_offset;
         aa[i] = p.is_active;
     }
+    // sigma bars are drawn for every point, so in this case nothing is removed
+    if (!draw_sigma && len > 2 * get_pixel_width(dc))
+        len = decimate_points(pp, aa, line_between_points);
 
     // draw inactive
     wxColour icol = inactive_color.Ok() ? inactive_color : inactiveDataCol;